@@ -15,7 +15,7 @@ EXTERN_GUID(CLSID_CResamplerMediaObject, 0xf447b69e, 0x1884, 0x4a7e, 0x80, 0x55,
 #undef min
 
 audio_resampler::audio_resampler() : 
-    buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_memory(new buffer_pool_memory_t("audio_resampler::buffer_pool_memory")),
     initialized(false)
 {
 }
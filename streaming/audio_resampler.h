@@ -1,6 +1,7 @@
 #pragma once
 
 #include "media_sample.h"
+#include "logger.h"
 #include <mfapi.h>
 #include <Mferror.h>
 #include <vector>
@@ -152,7 +153,7 @@ frame_unit audio_resampler::resample(
     };
     auto drain_all = [&]()
     {
-        std::cout << "drain on audio resampler" << std::endl;
+        LOG_DEBUG("drain on audio resampler");
 
         HRESULT hr = S_OK;
         CHECK_HR(hr = this->resampler->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
@@ -2,6 +2,7 @@
 
 #include "assert.h"
 #include "enable_shared_from_this.h"
+#include "lock_profiler.h"
 #include <memory>
 #include <stack>
 #include <mutex>
@@ -32,7 +33,7 @@ public:
         control_block_desc_t() : control_block_ptr(nullptr), control_block_len(0), in_use(false) {}
     };
 
-    typedef std::unique_lock<std::recursive_mutex> scoped_lock;
+    typedef std::unique_lock<profiled_mutex<std::recursive_mutex>> scoped_lock;
     typedef PooledBuffer pooled_buffer_t;
     typedef std::stack<std::shared_ptr<pooled_buffer_t>> buffer_pool_t;
     typedef std::stack<std::shared_ptr<control_block_desc_t>> control_block_pool_t;
@@ -41,10 +42,11 @@ private:
     buffer_pool_t container;
     control_block_pool_t control_block_descs;
 public:
-    buffer_pool();
+    // the name identifies the mutex of the pool in the lock profiler
+    explicit buffer_pool(const char* name);
 
     // mutex must be locked when using buffer_pool methods
-    std::recursive_mutex mutex;
+    profiled_mutex<std::recursive_mutex> mutex;
 
     // the buffer is uninitialized
     typename pooled_buffer_t::buffer_t acquire_buffer();
@@ -208,7 +210,7 @@ void control_block_allocator<T, U>::deallocate(T* p, size_type /*n*/)
 
 
 template<class T>
-buffer_pool<T>::buffer_pool() : disposed(false)
+buffer_pool<T>::buffer_pool(const char* name) : disposed(false), mutex(name)
 {
 }
 
@@ -117,6 +117,7 @@ void control_displaycapture::activate(const control_set_t& last_set, control_set
                     this->pipeline.shared_from_this<control_pipeline>(),
                     this->params.adapter_ordinal, this->params.output_ordinal, 
                     this->pipeline.dxgifactory, this->pipeline.d3d11dev, this->pipeline.devctx);
+            this->pipeline.record_source(*displaycapture_source);
 
             component = displaycapture_source;
         }
@@ -3,12 +3,20 @@
 #include "gui_threadwnd.h"
 #include "output_file.h"
 #include "output_rtmp.h"
+#include "output_tee.h"
+#include "logger.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#include <type_traits>
 #include <d3d11_4.h>
 #include <d2d1_2.h>
 
+#undef max
+
 #ifdef _DEBUG
 #define CREATE_DEVICE_DEBUG D3D11_CREATE_DEVICE_DEBUG
 #define CREATE_DEVICE_DEBUG_D2D1 D2D1_DEBUG_LEVEL_INFORMATION
@@ -19,6 +27,44 @@
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
 
+control_pipeline_load_params control_pipeline::load_params;
+
+std::vector<std::pair<std::string, std::string>> control_output_config::get_rtmp_destinations() const
+{
+    auto split = [](const std::string_view& str)
+    {
+        std::vector<std::string> items;
+        for(size_t pos = 0; pos <= str.size();)
+        {
+            size_t end = str.find(';', pos);
+            if(end == std::string_view::npos)
+                end = str.size();
+
+            std::string_view item = str.substr(pos, end - pos);
+            while(!item.empty() && item.front() == ' ')
+                item.remove_prefix(1);
+            while(!item.empty() && item.back() == ' ')
+                item.remove_suffix(1);
+            items.emplace_back(item);
+
+            pos = end + 1;
+        }
+        return items;
+    };
+
+    const std::vector<std::string> servers = split(this->ingest_server),
+        keys = split(this->stream_key);
+
+    std::vector<std::pair<std::string, std::string>> destinations;
+    for(size_t i = 0; i < servers.size(); i++)
+    {
+        if(servers[i].empty())
+            continue;
+        destinations.emplace_back(servers[i], i < keys.size() ? keys[i] : std::string());
+    }
+    return destinations;
+}
+
 std::wstring control_output_config::create_file_path() const
 {
     try
@@ -53,6 +99,13 @@ std::wstring control_output_config::create_file_path() const
     }
 }
 
+void control_pipeline_config::get_canvas_size(UINT32& width, UINT32& height) const
+{
+    const bool use_frame_size = !this->width_canvas || !this->height_canvas;
+    width = use_frame_size ? this->config_video.width_frame : this->width_canvas;
+    height = use_frame_size ? this->config_video.height_frame : this->height_canvas;
+}
+
 
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -63,7 +116,7 @@ control_pipeline::control_pipeline() :
     control_class(controls, event_provider),
     graphics_initialized(false),
     adapter_ordinal((UINT)-1),
-    context_mutex(new std::recursive_mutex),
+    context_mutex(new context_mutex_t::element_type("context_mutex")),
     root_scene(new control_scene(controls, *this)),
     preview_control(new control_preview(controls, *this)),
     recording(false), streaming(false)
@@ -156,28 +209,46 @@ void control_pipeline::activate_components()
         // before the topology is started
         this->time_source->start();
     }
+    if(!this->jitter_buffer)
+    {
+        jitter_buffer::params_t params;
+        params.initial_latency = BUFFERING_DEFAULT_VIDEO_LATENCY;
+        this->jitter_buffer.reset(new ::jitter_buffer(params));
+    }
     if(!this->session)
         this->session.reset(new media_session(this->time_source,
             this->get_current_config().config_video.fps_num, 
-            this->get_current_config().config_video.fps_den));
+            this->get_current_config().config_video.fps_den,
+            this->jitter_buffer));
     if(!this->audio_session)
         this->audio_session.reset(new media_session(this->time_source,
-            this->get_current_config().config_audio.sample_rate, 1));
+            this->get_current_config().config_audio.sample_rate, 1,
+            this->jitter_buffer));
 
     // must be called after resetting the video session
     frame_unit fps_num, fps_den;
     this->get_session_frame_rate(fps_num, fps_den);
 
+    UINT32 canvas_width, canvas_height;
+    this->get_current_config().get_canvas_size(canvas_width, canvas_height);
+    const bool scale_canvas =
+        canvas_width != this->get_current_config().config_video.width_frame ||
+        canvas_height != this->get_current_config().config_video.height_frame;
+
     // create videoprocessor transform
     if(!this->videomixer_transform ||
         this->videomixer_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE)
     {
         transform_videomixer_t videomixer_transform(new transform_videomixer(this->session,
             this->context_mutex));
-        videomixer_transform->initialize(this->shared_from_this<control_class>(),
-            this->get_current_config().config_video.width_frame,
-            this->get_current_config().config_video.height_frame,
-            this->d2d1factory, this->d2d1dev, this->d3d11dev, this->devctx);
+        // the cpu videomixer reads the frames of the capture sources back from the gpu
+        if(this->get_current_config().cpu_videomixer)
+            videomixer_transform->initialize(this->shared_from_this<control_class>(),
+                canvas_width, canvas_height, this->d3d11dev, this->devctx);
+        else
+            videomixer_transform->initialize(this->shared_from_this<control_class>(),
+                canvas_width, canvas_height,
+                this->d2d1factory, this->d2d1dev, this->d3d11dev, this->devctx);
 
         this->videomixer_transform = videomixer_transform;
     }
@@ -191,12 +262,16 @@ void control_pipeline::activate_components()
         // fallback
         // (signature error during activate call was fixed by a reboot)
         transform_h264_encoder_t h264_encoder_transform;
+        // the cpu videomixer outputs frames in system memory, so the encoder isn't fed
+        // with textures
+        const CComPtr<ID3D11Device> encoder_device =
+            this->get_current_config().cpu_videomixer ? nullptr : this->d3d11dev;
         try
         {
             h264_encoder_transform.reset(new transform_h264_encoder(
                 this->session, this->context_mutex));
             h264_encoder_transform->initialize(this->shared_from_this<control_class>(),
-                this->d3d11dev, 
+                encoder_device, 
                 (UINT32)fps_num, (UINT32)fps_den,
                 this->get_current_config().config_video.width_frame,
                 this->get_current_config().config_video.height_frame,
@@ -259,11 +334,14 @@ void control_pipeline::activate_components()
     if(this->recording && (!this->color_converter_transform ||
         this->color_converter_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE))
     {
+        // the video processor scales the gpu canvas to the encoded frame size;
+        // the frames of the cpu canvas are in system memory and are passed through
+        const bool gpu_canvas = !this->get_current_config().cpu_videomixer;
         transform_color_converter_t color_converter_transform(
             new transform_color_converter(this->session, this->context_mutex));
         color_converter_transform->initialize(this->shared_from_this<control_class>(),
-            this->get_current_config().config_video.width_frame,
-            this->get_current_config().config_video.height_frame,
+            gpu_canvas ? canvas_width : this->get_current_config().config_video.width_frame,
+            gpu_canvas ? canvas_height : this->get_current_config().config_video.height_frame,
             this->get_current_config().config_video.width_frame,
             this->get_current_config().config_video.height_frame,
             this->d3d11dev, this->devctx);
@@ -272,6 +350,23 @@ void control_pipeline::activate_components()
     else if(!this->recording)
         this->color_converter_transform = nullptr;
 
+    // create scaler transform
+    if(this->recording && this->get_current_config().cpu_videomixer && scale_canvas)
+    {
+        if(!this->scaler_transform ||
+            this->scaler_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE)
+        {
+            transform_scaler_t scaler_transform(new transform_scaler(this->session));
+            scaler_transform->initialize(this->shared_from_this<control_class>(),
+                canvas_width, canvas_height,
+                this->get_current_config().config_video.width_frame,
+                this->get_current_config().config_video.height_frame);
+            this->scaler_transform = scaler_transform;
+        }
+    }
+    else
+        this->scaler_transform = nullptr;
+
     // create aac encoder transform
     if(this->recording && (!this->aac_encoder_transform ||
         this->aac_encoder_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE))
@@ -306,15 +401,47 @@ void control_pipeline::activate_components()
         assert_(this->h264_encoder_transform);
         if(this->streaming)
         {
-            output_rtmp_t rtmp_output(new output_rtmp);
-            rtmp_output->initialize(
-                this->get_current_config().config_output.ingest_server,
-                this->get_current_config().config_output.stream_key,
-                this->recording_initiator_wnd,
-                this->h264_encoder_transform->output_type,
-                this->aac_encoder_transform->output_type);
+            // the same encoded stream is shared between the outputs;
+            // each rtmp destination has its own connection and queue in the tee, so that
+            // a slow destination doesn't affect the others
+            output_tee_t tee_output(new output_tee);
+            const auto destinations = this->get_current_config().config_output.get_rtmp_destinations();
+            if(destinations.empty())
+                throw HR_EXCEPTION(E_UNEXPECTED);
+            for(size_t i = 0; i < destinations.size(); i++)
+            {
+                // only the first destination notifies the initiator;
+                // an unreachable destination keeps reconnecting instead of stopping
+                // the stream to the other destinations
+                output_rtmp_t rtmp_output(new output_rtmp);
+                rtmp_output->initialize(
+                    destinations[i].first,
+                    destinations[i].second,
+                    i == 0 ? this->recording_initiator_wnd : ATL::CWindow(),
+                    this->h264_encoder_transform->output_type,
+                    this->aac_encoder_transform->output_type,
+                    destinations.size() > 1);
+
+                tee_output->add_output(rtmp_output);
+            }
+
+            if(this->get_current_config().record_while_streaming)
+            {
+                // the file output doesn't notify the initiator; the recording
+                // is stopped with the stream
+                output_file_t file_output(new output_file);
+                file_output->initialize(
+                    false,
+                    (bool)this->get_current_config().config_output.overwrite_old_file,
+                    this->get_current_config().config_output.create_file_path(),
+                    ATL::CWindow(),
+                    this->h264_encoder_transform->output_type,
+                    this->aac_encoder_transform->output_type);
+
+                tee_output->add_output(file_output);
+            }
 
-            class_output = rtmp_output;
+            class_output = tee_output;
         }
         else
         {
@@ -330,6 +457,9 @@ void control_pipeline::activate_components()
             class_output = file_output;
         }
 
+        // the outputs can request key frames from the encoder
+        class_output->set_key_frame_requester(this->h264_encoder_transform);
+
         sink_output_video_t output_sink(new sink_file_video(this->session));
         output_sink->initialize(class_output, true);
 
@@ -392,8 +522,137 @@ void control_pipeline::activate_components()
 
         this->audio_buffering_source = audio_buffering_source;
     }
+
+    this->activate_load_sources(canvas_width, canvas_height);
 }
 
+void control_pipeline::activate_load_sources(UINT32 canvas_width, UINT32 canvas_height)
+{
+    frame_unit fps_num, fps_den;
+    this->get_session_frame_rate(fps_num, fps_den);
+
+    // create the synthetic video sources;
+    // the sources are tiled over the canvas so that each of them is drawn
+    if(this->synthetic_video_sources.empty() && load_params.synthetic_video_count > 0)
+    {
+        const int count = load_params.synthetic_video_count;
+        const int columns = (int)std::ceil(std::sqrt((double)count));
+        const int rows = (count + columns - 1) / columns;
+        // the frames are uploaded to textures unless the videomixer composes on the cpu
+        const bool cpu_videomixer = this->get_current_config().cpu_videomixer;
+
+        source_synthetic_video::params_t params;
+        params.width = std::max(canvas_width / (UINT32)columns, 1U);
+        params.height = std::max(canvas_height / (UINT32)rows, 1U);
+        params.frame_rate_num = fps_num;
+        params.frame_rate_den = fps_den;
+        for(int i = 0; i < count; i++)
+        {
+            params.delivery.seed = (unsigned int)i;
+            source_synthetic_video_t synthetic_source(
+                new source_synthetic_video(this->session, this->context_mutex));
+            synthetic_source->initialize(this->shared_from_this<control_class>(), params,
+                cpu_videomixer ? nullptr : this->d3d11dev,
+                cpu_videomixer ? nullptr : this->devctx);
+            this->record_source(*synthetic_source);
+
+            stream_videomixer_controller::params_t mixer_params;
+            mixer_params.source_rect = mixer_params.dest_rect =
+                D2D1::RectF(0.f, 0.f, (FLOAT)params.width, (FLOAT)params.height);
+            mixer_params.source_m = D2D1::Matrix3x2F::Identity();
+            mixer_params.dest_m = D2D1::Matrix3x2F::Translation(
+                (FLOAT)(params.width * (i % columns)), (FLOAT)(params.height * (i / columns)));
+            mixer_params.axis_aligned_clip = true;
+            stream_videomixer_controller_t videomixer_params(new stream_videomixer_controller);
+            videomixer_params->set_params(mixer_params);
+
+            this->synthetic_video_sources.emplace_back(synthetic_source, videomixer_params);
+        }
+    }
+
+    // create the synthetic audio sources
+    if(this->synthetic_audio_sources.empty() && load_params.synthetic_audio_count > 0)
+    {
+        source_synthetic_audio::params_t params;
+        for(int i = 0; i < load_params.synthetic_audio_count; i++)
+        {
+            params.delivery.seed = (unsigned int)i;
+            // the tones of the sources are spread so that the sources can be told apart
+            params.frequency = 220.0 * (i + 1);
+            source_synthetic_audio_t synthetic_source(new source_synthetic_audio(this->audio_session));
+            synthetic_source->initialize(this->shared_from_this<control_class>(), params);
+            this->record_source(*synthetic_source);
+
+            this->synthetic_audio_sources.push_back(synthetic_source);
+        }
+    }
+
+    // create the replay sources;
+    // the pipeline keeps running without the replay if the trace couldn't be loaded
+    if(!this->replay_video_source && !load_params.replay_video_trace.empty())
+    {
+        if(this->get_current_config().cpu_videomixer)
+        {
+            try
+            {
+                source_replay_video_t replay_source(new source_replay_video(this->session));
+                replay_source->initialize(this->shared_from_this<control_class>(),
+                    load_params.replay_video_trace);
+                this->replay_video_source = replay_source;
+            }
+            catch(streaming::exception)
+            {
+            }
+        }
+        else
+            LOG_WARNING("the video trace is replayed only by the cpu videomixer");
+    }
+    if(!this->replay_audio_source && !load_params.replay_audio_trace.empty())
+    {
+        try
+        {
+            source_replay_audio_t replay_source(new source_replay_audio(this->audio_session));
+            replay_source->initialize(this->shared_from_this<control_class>(),
+                load_params.replay_audio_trace);
+            this->replay_audio_source = replay_source;
+        }
+        catch(streaming::exception)
+        {
+        }
+    }
+}
+
+template<class Args>
+void control_pipeline::record_source(source_base<Args>& source) const
+{
+    if(load_params.trace_directory.empty())
+        return;
+
+    // the traces are numbered in the order of the creation of the sources
+    static std::atomic<int> trace_count{0};
+    const bool audio = std::is_same_v<Args, media_component_audiomixer_args>;
+    const std::filesystem::path path = std::filesystem::path(load_params.trace_directory) /
+        ((audio ? L"audio_" : L"video_") + std::to_wstring(trace_count++) + L".strc");
+
+    std::shared_ptr<source_recorder<Args>> recorder(new source_recorder<Args>);
+    try
+    {
+        recorder->initialize(path.wstring(), source.session);
+    }
+    catch(streaming::exception)
+    {
+        // the source is used without recording
+        return;
+    }
+
+    LOG_TEXT(logger::LEVEL_INFO, "recording the source trace ", path.filename().string().c_str());
+    source.set_tap(recorder);
+}
+
+template void control_pipeline::record_source(source_base<media_component_videomixer_args>&) const;
+template void control_pipeline::record_source(source_base<media_component_audiomixer_args>&) const;
+template void control_pipeline::record_source(source_base<displaycapture_args>&) const;
+
 void control_pipeline::deactivate_components()
 {
     if(this->is_recording())
@@ -411,6 +670,7 @@ void control_pipeline::deactivate_components()
     this->videomixer_transform = nullptr;
     this->h264_encoder_transform = nullptr;
     this->color_converter_transform = nullptr;
+    this->scaler_transform = nullptr;
     this->output_sink = {};
     this->video_sink = nullptr;
     this->aac_encoder_transform = nullptr;
@@ -418,9 +678,14 @@ void control_pipeline::deactivate_components()
     this->audio_sink = nullptr;
     this->video_buffering_source = nullptr;
     this->audio_buffering_source = nullptr;
+    this->synthetic_video_sources.clear();
+    this->synthetic_audio_sources.clear();
+    this->replay_video_source = nullptr;
+    this->replay_audio_source = nullptr;
 
     this->session = nullptr;
     this->audio_session = nullptr;
+    this->jitter_buffer = nullptr;
     this->time_source = nullptr;
 
     this->deinit_graphics();
@@ -564,6 +829,11 @@ void control_pipeline::build_and_switch_topology()
     if(this->disabled)
         return;
 
+    using namespace std::chrono;
+    static metric& build_time = metrics::get_gauge("topology_build_us");
+    static metric& stream_count = metrics::get_gauge("topology_stream_count");
+    const steady_clock::time_point build_start = steady_clock::now();
+
     this->video_topology.reset(
         new media_topology(media_message_generator_t(new media_message_generator)));
     this->audio_topology.reset(
@@ -602,6 +872,36 @@ void control_pipeline::build_and_switch_topology()
     videomixer_stream->connect_streams(video_buffering_stream, nullptr, this->video_topology);
     audiomixer_stream->connect_streams(audio_buffering_stream, nullptr, this->audio_topology);
 
+    // connect the load generation sources to mixers
+    for(auto&& item : this->synthetic_video_sources)
+    {
+        media_stream_t synthetic_stream =
+            item.first->create_stream(this->video_topology->get_message_generator());
+        synthetic_stream->connect_streams(video_stream, this->video_topology);
+        videomixer_stream->connect_streams(synthetic_stream, item.second, this->video_topology);
+    }
+    for(auto&& item : this->synthetic_audio_sources)
+    {
+        media_stream_t synthetic_stream =
+            item->create_stream(this->audio_topology->get_message_generator());
+        synthetic_stream->connect_streams(audio_stream, this->audio_topology);
+        audiomixer_stream->connect_streams(synthetic_stream, nullptr, this->audio_topology);
+    }
+    if(this->replay_video_source)
+    {
+        media_stream_t replay_stream =
+            this->replay_video_source->create_stream(this->video_topology->get_message_generator());
+        replay_stream->connect_streams(video_stream, this->video_topology);
+        videomixer_stream->connect_streams(replay_stream, nullptr, this->video_topology);
+    }
+    if(this->replay_audio_source)
+    {
+        media_stream_t replay_stream =
+            this->replay_audio_source->create_stream(this->audio_topology->get_message_generator());
+        replay_stream->connect_streams(audio_stream, this->audio_topology);
+        audiomixer_stream->connect_streams(replay_stream, nullptr, this->audio_topology);
+    }
+
     if(!this->recording)
     {
         this->preview_control->build_video_topology(
@@ -624,8 +924,17 @@ void control_pipeline::build_and_switch_topology()
         video_stream->encoder_stream = 
             std::dynamic_pointer_cast<stream_h264_encoder>(encoder_stream_video);
 
-        this->preview_control->build_video_topology(
-            videomixer_stream, color_converter_stream, this->video_topology);
+        // the scaler resizes the cpu canvas before the color converter
+        if(this->scaler_transform)
+        {
+            media_stream_t scaler_stream = this->scaler_transform->create_stream();
+            this->preview_control->build_video_topology(
+                videomixer_stream, scaler_stream, this->video_topology);
+            color_converter_stream->connect_streams(scaler_stream, this->video_topology);
+        }
+        else
+            this->preview_control->build_video_topology(
+                videomixer_stream, color_converter_stream, this->video_topology);
         encoder_stream_video->connect_streams(color_converter_stream, this->video_topology);
         output_stream_video->connect_streams(encoder_stream_video, this->video_topology);
         video_stream->connect_streams(output_stream_video, this->video_topology);
@@ -644,6 +953,10 @@ void control_pipeline::build_and_switch_topology()
     }
     else
         this->video_sink->switch_topologies(this->video_topology, this->audio_topology);
+
+    build_time.set(duration_cast<microseconds>(steady_clock::now() - build_start).count());
+    stream_count.set((int64_t)(this->video_topology->get_stream_count() +
+        this->audio_topology->get_stream_count()));
 }
 
 void control_pipeline::set_selected_control(control_class* control, selection_type type)
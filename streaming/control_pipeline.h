@@ -9,12 +9,16 @@
 #include "transform_aac_encoder.h"
 #include "transform_h264_encoder.h"
 #include "transform_color_converter.h"
+#include "transform_scaler.h"
 #include "transform_videomixer.h"
 #include "transform_audiomixer2.h"
 #include "sink_video.h"
 #include "sink_audio.h"
 #include "sink_file.h"
 #include "source_buffering.h"
+#include "source_synthetic.h"
+#include "source_recorder.h"
+#include "source_replay.h"
 #include "enable_shared_from_this.h"
 #include "wtl.h"
 #include <atlbase.h>
@@ -24,10 +28,12 @@
 #include <mutex>
 #include <memory>
 #include <vector>
+#include <string>
 #include <string_view>
 
-// NOTE: buffering slightly increases processing usage
-#define BUFFERING_DEFAULT_VIDEO_LATENCY (SECOND_IN_TIME_UNIT / 2) // 100ms default buffering
+// NOTE: buffering slightly increases processing usage;
+// the jitter buffer starts from the video latency and adapts it to the lateness of the sources
+#define BUFFERING_DEFAULT_VIDEO_LATENCY (SECOND_IN_TIME_UNIT / 2) // 500ms initial buffering
 #define BUFFERING_DEFAULT_AUDIO_LATENCY (SECOND_IN_TIME_UNIT / 2)
 
 #pragma comment(lib, "D3D11.lib")
@@ -104,10 +110,14 @@ struct control_output_config
     WCHAR output_folder[MAX_PATH] = {};
     WCHAR output_filename[MAX_PATH] = L"test.mp4";
     BOOL overwrite_old_file = FALSE;
+    // multiple rtmp destinations are separated by ';';
+    // the stream keys are paired with the ingest servers in order
     CHAR ingest_server[MAX_PATH] = {};
     CHAR stream_key[MAX_PATH] = {};
 
     std::wstring create_file_path() const;
+    // returns the ingest server and stream key pairs
+    std::vector<std::pair<std::string, std::string>> get_rtmp_destinations() const;
 };
 
 struct control_pipeline_config
@@ -116,7 +126,7 @@ struct control_pipeline_config
     // version must be increased every time the config struct is changed;
     // new config versions are only allowed to extend the previous config versions,
     // which also means that only the control_pipeline_config struct can be altered
-    static constexpr int VERSION = 1;
+    static constexpr int VERSION = 4;
     static constexpr int LATEST_VERSION = VERSION;
 
     int magic_number = MAGIC_NUMBER;
@@ -124,6 +134,22 @@ struct control_pipeline_config
     control_video_config config_video;
     control_audio_config config_audio;
     control_output_config config_output;
+
+    // version 2:
+    // the encoded stream is also written to a file while streaming
+    BOOL record_while_streaming = FALSE;
+
+    // version 3:
+    // the videomixer composes on the cpu instead of the gpu;
+    // the frames of the video sources that serve textures are read back from the gpu
+    BOOL cpu_videomixer = FALSE;
+
+    // version 4:
+    // the size of the videomixer canvas; 0 uses the encoded frame size;
+    // the canvas is scaled to the encoded frame size if the sizes differ
+    UINT32 width_canvas = 0, height_canvas = 0;
+
+    void get_canvas_size(UINT32& width, UINT32& height) const;
 };
 #pragma pack(pop)
 
@@ -133,10 +159,25 @@ public:
     using std::runtime_error::runtime_error;
 };
 
+// sources that are connected to the mixers in every topology in addition to the scene sources;
+// set from the environment at startup, so that the pipeline can be loaded without capture devices
+struct control_pipeline_load_params
+{
+    // the synthetic video sources are tiled over the canvas
+    int synthetic_video_count = 0, synthetic_audio_count = 0;
+    // the sources record the samples they serve to traces in this directory if it is set
+    std::wstring trace_directory;
+    // the traces that are replayed; the video trace is replayed only by the cpu videomixer,
+    // because the replayed frames are in system memory
+    std::wstring replay_video_trace, replay_audio_trace;
+};
+
 class control_pipeline final : public control_class
 {
     friend class control_scene;
 private:
+    static control_pipeline_load_params load_params;
+
     bool graphics_initialized;
     UINT adapter_ordinal;
     bool recording, streaming;
@@ -144,10 +185,15 @@ private:
     gui_threadwnd wnd_thread;
 
     media_clock_t time_source;
+    // shared by the video and audio sessions so that both are buffered by the same latency
+    jitter_buffer_t jitter_buffer;
     media_topology_t video_topology, audio_topology;
     // these components are present in every scene
     transform_h264_encoder_t h264_encoder_transform;
     transform_color_converter_t color_converter_transform;
+    // scales the canvas of the cpu videomixer to the encoded frame size;
+    // null if the sizes match or the videomixer composes on the gpu
+    transform_scaler_t scaler_transform;
     transform_aac_encoder_t aac_encoder_transform;
     transform_audiomixer2_t audiomixer_transform;
     sink_output_t output_sink;
@@ -155,6 +201,12 @@ private:
     sink_audio_t audio_sink;
     source_buffering_video_t video_buffering_source;
     source_buffering_audio_t audio_buffering_source;
+    // the load generation sources and the placements of the video sources
+    std::vector<std::pair<source_synthetic_video_t, stream_videomixer_controller_t>>
+        synthetic_video_sources;
+    std::vector<source_synthetic_audio_t> synthetic_audio_sources;
+    source_replay_video_t replay_video_source;
+    source_replay_audio_t replay_audio_source;
 
     control_pipeline_config config;
 
@@ -168,6 +220,7 @@ private:
     void activate(const control_set_t& last_set, control_set_t& new_set) override;
 
     void activate_components();
+    void activate_load_sources(UINT32 canvas_width, UINT32 canvas_height);
     void deactivate_components();
 
     static HRESULT get_adapter(
@@ -203,6 +256,15 @@ public:
     control_pipeline();
     ~control_pipeline();
 
+    // must be called before the pipeline is activated
+    static void set_load_params(const control_pipeline_load_params& params)
+    { load_params = params; }
+
+    // sets a recorder as the tap of the source if the source traces are recorded;
+    // must be called before the streams of the source are created
+    template<class Args>
+    void record_source(source_base<Args>&) const;
+
     void run_in_gui_thread(callable_f) override;
 
     enum selection_type { ADD, SET, CLEAR };
@@ -3,6 +3,7 @@
 #include "source_empty.h"
 #include <algorithm>
 #include <iterator>
+#include <chrono>
 
 control_scene::control_scene(control_set_t& active_controls, control_pipeline& pipeline) :
     control_class(active_controls, pipeline.event_provider),
@@ -282,6 +283,12 @@ void control_scene::switch_scene(controls_t::const_iterator new_scene)
     if(new_control == old_control)
         return;
 
+    // the components that are present in both scenes are reused by the activation,
+    // and their streams share the dispatchers of the component
+    using namespace std::chrono;
+    static metric& switch_time = metrics::get_gauge("scene_switch_us");
+    const steady_clock::time_point switch_start = steady_clock::now();
+
     // deselect old items
     this->pipeline.set_selected_control(nullptr, control_pipeline::CLEAR);
 
@@ -308,6 +315,8 @@ void control_scene::switch_scene(controls_t::const_iterator new_scene)
         this->active_controls = std::move(new_set);
 
     this->build_and_switch_topology();
+
+    switch_time.set(duration_cast<microseconds>(steady_clock::now() - switch_start).count());
 }
 
 void control_scene::switch_scene(const control_scene& new_scene)
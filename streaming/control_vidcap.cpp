@@ -98,6 +98,7 @@ void control_vidcap::activate(const control_set_t& last_set, control_set_t& new_
                 this->pipeline.d3d11dev,
                 this->pipeline.devctx,
                 this->params.symbolic_link);
+            this->pipeline.record_source(*vidcap_source);
 
             component = vidcap_source;
         }
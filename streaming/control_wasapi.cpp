@@ -92,6 +92,7 @@ void control_wasapi::activate(const control_set_t& last_set, control_set_t& new_
 
             wasapi_source->initialize(this->pipeline.shared_from_this<control_pipeline>(),
                 this->params.device_id, this->params.capture);
+            this->pipeline.record_source(*wasapi_source);
 
             component = wasapi_source;
         }
@@ -0,0 +1,276 @@
+#include "cpu_color_converter.h"
+#include "assert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CPU_COLOR_CONVERTER_SSE2
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+
+inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+inline int luma(const cpu_color_converter::coefficients_t& c, const uint8_t* px)
+{
+    return ((px[0] * c.y_b + px[1] * c.y_g + px[2] * c.y_r + (1 << 14)) >> 15) + c.y_offset;
+}
+
+// the sums are the horizontal sums of two vertically averaged samples
+inline void chroma(const cpu_color_converter::coefficients_t& c,
+    int sum_b, int sum_g, int sum_r, int& u, int& v)
+{
+    u = ((sum_b * c.u_b + sum_g * c.u_g + sum_r * c.u_r + (1 << 15)) >> 16) + 128;
+    v = ((sum_b * c.v_b + sum_g * c.v_g + sum_r * c.v_r + (1 << 15)) >> 16) + 128;
+}
+
+void convert_luma_row_scalar(const cpu_color_converter::coefficients_t& c,
+    const uint8_t* src, uint8_t* dst, int first, int width)
+{
+    for(int x = first; x < width; x++)
+        dst[x] = clamp_u8(luma(c, src + x * 4));
+}
+
+void convert_chroma_row_scalar(const cpu_color_converter::coefficients_t& c,
+    cpu_color_converter::format_t format,
+    const uint8_t* src0, const uint8_t* src1, uint8_t* u_dst, uint8_t* v_dst,
+    int first, int width)
+{
+    for(int x = first; x < width; x += 2)
+    {
+        int sum[3];
+        for(int i = 0; i < 3; i++)
+        {
+            // same rounding as in the simd average
+            const int left = (src0[x * 4 + i] + src1[x * 4 + i] + 1) >> 1;
+            const int right = (src0[x * 4 + 4 + i] + src1[x * 4 + 4 + i] + 1) >> 1;
+            sum[i] = left + right;
+        }
+
+        int u, v;
+        chroma(c, sum[0], sum[1], sum[2], u, v);
+
+        if(format == cpu_color_converter::FORMAT_NV12)
+        {
+            u_dst[x] = clamp_u8(u);
+            u_dst[x + 1] = clamp_u8(v);
+        }
+        else
+        {
+            u_dst[x / 2] = clamp_u8(u);
+            v_dst[x / 2] = clamp_u8(v);
+        }
+    }
+}
+
+#ifdef CPU_COLOR_CONVERTER_SSE2
+
+// sums the channel pairs produced by madd and gathers the per pixel sums of two registers
+inline __m128i fold_pixels(__m128i a, __m128i b)
+{
+    a = _mm_add_epi32(a, _mm_srli_epi64(a, 32));
+    b = _mm_add_epi32(b, _mm_srli_epi64(b, 32));
+    return _mm_castps_si128(_mm_shuffle_ps(
+        _mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+// converts 4 pixels to 4 int32 luma values
+inline __m128i luma4(__m128i px, __m128i coefs, __m128i round, __m128i offset)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coefs);
+    const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coefs);
+    const __m128i sum = _mm_add_epi32(fold_pixels(lo, hi), round);
+    return _mm_add_epi32(_mm_srai_epi32(sum, 15), offset);
+}
+
+// returns the channel sums of horizontal pixel pairs as 16 bit values;
+// the result holds two pixels
+inline __m128i pair_sums(__m128i px)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(px, zero), hi = _mm_unpackhi_epi8(px, zero);
+    const __m128i sum01 = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    const __m128i sum23 = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(sum01, sum23);
+}
+
+// converts pair sums of 8 pixels to 4 int32 chroma values
+inline __m128i chroma4(__m128i sums0, __m128i sums1, __m128i coefs, __m128i round, __m128i offset)
+{
+    const __m128i sum = _mm_add_epi32(
+        fold_pixels(_mm_madd_epi16(sums0, coefs), _mm_madd_epi16(sums1, coefs)), round);
+    return _mm_add_epi32(_mm_srai_epi32(sum, 16), offset);
+}
+
+void convert_luma_row_sse2(const cpu_color_converter::coefficients_t& c,
+    const uint8_t* src, uint8_t* dst, int width)
+{
+    const __m128i coefs = _mm_setr_epi16(c.y_b, c.y_g, c.y_r, 0, c.y_b, c.y_g, c.y_r, 0);
+    const __m128i round = _mm_set1_epi32(1 << 14), offset = _mm_set1_epi32(c.y_offset);
+
+    int x = 0;
+    for(; x + 16 <= width; x += 16)
+    {
+        const __m128i* p = (const __m128i*)(src + x * 4);
+        const __m128i y0 = luma4(_mm_loadu_si128(p + 0), coefs, round, offset);
+        const __m128i y1 = luma4(_mm_loadu_si128(p + 1), coefs, round, offset);
+        const __m128i y2 = luma4(_mm_loadu_si128(p + 2), coefs, round, offset);
+        const __m128i y3 = luma4(_mm_loadu_si128(p + 3), coefs, round, offset);
+
+        const __m128i y = _mm_packus_epi16(_mm_packs_epi32(y0, y1), _mm_packs_epi32(y2, y3));
+        _mm_storeu_si128((__m128i*)(dst + x), y);
+    }
+
+    convert_luma_row_scalar(c, src, dst, x, width);
+}
+
+void convert_chroma_row_sse2(const cpu_color_converter::coefficients_t& c,
+    cpu_color_converter::format_t format,
+    const uint8_t* src0, const uint8_t* src1, uint8_t* u_dst, uint8_t* v_dst, int width)
+{
+    const __m128i u_coefs = _mm_setr_epi16(c.u_b, c.u_g, c.u_r, 0, c.u_b, c.u_g, c.u_r, 0);
+    const __m128i v_coefs = _mm_setr_epi16(c.v_b, c.v_g, c.v_r, 0, c.v_b, c.v_g, c.v_r, 0);
+    const __m128i round = _mm_set1_epi32(1 << 15), offset = _mm_set1_epi32(128);
+
+    int x = 0;
+    for(; x + 8 <= width; x += 8)
+    {
+        const __m128i* p0 = (const __m128i*)(src0 + x * 4);
+        const __m128i* p1 = (const __m128i*)(src1 + x * 4);
+
+        // vertical average followed by horizontal sum
+        const __m128i sums0 = pair_sums(
+            _mm_avg_epu8(_mm_loadu_si128(p0 + 0), _mm_loadu_si128(p1 + 0)));
+        const __m128i sums1 = pair_sums(
+            _mm_avg_epu8(_mm_loadu_si128(p0 + 1), _mm_loadu_si128(p1 + 1)));
+
+        const __m128i u = chroma4(sums0, sums1, u_coefs, round, offset);
+        const __m128i v = chroma4(sums0, sums1, v_coefs, round, offset);
+
+        if(format == cpu_color_converter::FORMAT_NV12)
+        {
+            // u0 u1 u2 u3 v0 v1 v2 v3 -> u0 v0 u1 v1 u2 v2 u3 v3
+            const __m128i uv = _mm_packs_epi32(u, v);
+            const __m128i interleaved = _mm_unpacklo_epi16(uv, _mm_srli_si128(uv, 8));
+            _mm_storel_epi64((__m128i*)(u_dst + x), _mm_packus_epi16(interleaved, interleaved));
+        }
+        else
+        {
+            const __m128i uv = _mm_packus_epi16(_mm_packs_epi32(u, v), _mm_setzero_si128());
+            const int u4 = _mm_cvtsi128_si32(uv), v4 = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+            std::memcpy(u_dst + x / 2, &u4, sizeof(u4));
+            std::memcpy(v_dst + x / 2, &v4, sizeof(v4));
+        }
+    }
+
+    convert_chroma_row_scalar(c, format, src0, src1, u_dst, v_dst, x, width);
+}
+
+#endif
+
+}
+
+cpu_color_converter::cpu_color_converter(
+    matrix_t matrix, range_t range, format_t format, unsigned int thread_count) :
+    coefficients(make_coefficients(matrix, range)),
+    format(format),
+    workers(thread_count)
+{
+}
+
+cpu_color_converter::coefficients_t cpu_color_converter::make_coefficients(
+    matrix_t matrix, range_t range)
+{
+    const double kr = (matrix == MATRIX_BT601) ? 0.299 : 0.2126;
+    const double kb = (matrix == MATRIX_BT601) ? 0.114 : 0.0722;
+    const double y_scale = (range == RANGE_LIMITED) ? (219.0 / 255.0) : 1.0;
+    const double c_scale = (range == RANGE_LIMITED) ? (224.0 / 255.0) : 1.0;
+
+    auto fixed = [](double v, int bits) { return (int16_t)std::lround(v * (1 << bits)); };
+
+    // the coefficients are adjusted so that their sums are exact;
+    // white maps to the maximum luma and grays map to the neutral chroma
+    coefficients_t c;
+    c.y_r = fixed(kr * y_scale, 15);
+    c.y_b = fixed(kb * y_scale, 15);
+    c.y_g = (int16_t)(fixed(y_scale, 15) - c.y_r - c.y_b);
+
+    // chroma coefficients are halved, because they're applied to sums of two samples
+    c.u_r = fixed(-kr / (2.0 * (1.0 - kb)) * c_scale / 2.0, 16);
+    c.u_b = fixed(0.5 * c_scale / 2.0, 16);
+    c.u_g = (int16_t)(-c.u_r - c.u_b);
+    c.v_b = fixed(-kb / (2.0 * (1.0 - kr)) * c_scale / 2.0, 16);
+    c.v_r = fixed(0.5 * c_scale / 2.0, 16);
+    c.v_g = (int16_t)(-c.v_r - c.v_b);
+
+    c.y_offset = (range == RANGE_LIMITED) ? 16 : 0;
+
+    return c;
+}
+
+void cpu_color_converter::convert_rows(const coefficients_t& c, format_t format,
+    const uint8_t* bgra, int bgra_pitch, int width,
+    const planes_t& planes, int top, int bottom, bool simd)
+{
+    assert_(top % 2 == 0 && bottom % 2 == 0);
+
+    for(int y = top; y < bottom; y += 2)
+    {
+        const uint8_t* src0 = bgra + (size_t)y * bgra_pitch;
+        const uint8_t* src1 = src0 + bgra_pitch;
+        uint8_t* y_dst0 = planes.y + (size_t)y * planes.y_pitch;
+        uint8_t* y_dst1 = y_dst0 + planes.y_pitch;
+        uint8_t* u_dst = planes.u + (size_t)(y / 2) * planes.u_pitch;
+        uint8_t* v_dst = (format == FORMAT_I420) ? planes.v + (size_t)(y / 2) * planes.v_pitch : NULL;
+
+#ifdef CPU_COLOR_CONVERTER_SSE2
+        if(simd)
+        {
+            convert_luma_row_sse2(c, src0, y_dst0, width);
+            convert_luma_row_sse2(c, src1, y_dst1, width);
+            convert_chroma_row_sse2(c, format, src0, src1, u_dst, v_dst, width);
+            continue;
+        }
+#else
+        (void)simd;
+#endif
+
+        convert_luma_row_scalar(c, src0, y_dst0, 0, width);
+        convert_luma_row_scalar(c, src1, y_dst1, 0, width);
+        convert_chroma_row_scalar(c, format, src0, src1, u_dst, v_dst, 0, width);
+    }
+}
+
+void cpu_color_converter::convert(
+    const uint8_t* bgra, int bgra_pitch, int width, int height, const planes_t& planes)
+{
+    assert_(width % 2 == 0 && height % 2 == 0);
+
+    const int part_count = (height + rows_per_part - 1) / rows_per_part;
+    this->workers.run(part_count, [&](int part)
+        {
+            const int top = part * rows_per_part;
+            const int bottom = std::min(top + rows_per_part, height);
+            convert_rows(this->coefficients, this->format,
+                bgra, bgra_pitch, width, planes, top, bottom, true);
+        });
+}
+
+void cpu_color_converter::convert_reference(
+    const uint8_t* bgra, int bgra_pitch, int width, int height, const planes_t& planes) const
+{
+    assert_(width % 2 == 0 && height % 2 == 0);
+
+    convert_rows(this->coefficients, this->format,
+        bgra, bgra_pitch, width, planes, 0, height, false);
+}
\ No newline at end of file
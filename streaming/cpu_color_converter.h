@@ -0,0 +1,64 @@
+#pragma once
+
+#include "worker_pool.h"
+#include <stdint.h>
+
+// converts bgra to nv12 or i420 on the cpu;
+// it is the system memory counterpart of the video processor in transform_color_converter;
+// the chroma is sited at the center of each 2x2 block;
+// the frame is split into row bands that are converted in parallel
+
+class cpu_color_converter final
+{
+public:
+    enum matrix_t { MATRIX_BT601, MATRIX_BT709 };
+    enum range_t { RANGE_LIMITED, RANGE_FULL };
+    enum format_t { FORMAT_NV12, FORMAT_I420 };
+
+    // the pitches are in bytes;
+    // nv12 stores the interleaved chroma in the u plane and the v plane is unused
+    struct planes_t
+    {
+        uint8_t* y;
+        int y_pitch;
+        uint8_t* u;
+        int u_pitch;
+        uint8_t* v;
+        int v_pitch;
+    };
+
+    // fixed point coefficients;
+    // luma coefficients have 15 fractional bits and chroma coefficients have 16,
+    // because the chroma is computed from the sum of two horizontal samples
+    struct coefficients_t
+    {
+        int16_t y_r, y_g, y_b;
+        int16_t u_r, u_g, u_b;
+        int16_t v_r, v_g, v_b;
+        int y_offset;
+    };
+private:
+    // must be even
+    static constexpr int rows_per_part = 16;
+
+    coefficients_t coefficients;
+    format_t format;
+    worker_pool workers;
+
+    static void convert_rows(const coefficients_t&, format_t,
+        const uint8_t* bgra, int bgra_pitch, int width,
+        const planes_t&, int top, int bottom, bool simd);
+public:
+    // thread count of 0 uses the hardware concurrency
+    cpu_color_converter(matrix_t, range_t, format_t, unsigned int thread_count = 0);
+
+    static coefficients_t make_coefficients(matrix_t, range_t);
+    format_t get_format() const { return this->format; }
+
+    // width and height must be even
+    void convert(const uint8_t* bgra, int bgra_pitch, int width, int height, const planes_t&);
+    // single threaded scalar conversion;
+    // used as the reference for verifying the simd kernels
+    void convert_reference(
+        const uint8_t* bgra, int bgra_pitch, int width, int height, const planes_t&) const;
+};
\ No newline at end of file
@@ -0,0 +1,291 @@
+#include "cpu_compositor.h"
+#include "assert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CPU_COMPOSITOR_SSE2
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+
+inline uint32_t load_u32(const uint8_t* p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void store_u32(uint8_t* p, uint32_t v)
+{
+    std::memcpy(p, &v, sizeof(v));
+}
+
+#ifdef CPU_COMPOSITOR_SSE2
+
+inline __m128 unpack_texel(uint32_t texel)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v = _mm_cvtsi32_si128((int)texel);
+    v = _mm_unpacklo_epi8(v, zero);
+    v = _mm_unpacklo_epi16(v, zero);
+    return _mm_cvtepi32_ps(v);
+}
+
+// samples the bitmap bilinearly and blends the premultiplied result over the destination;
+// the bitmap edges are clamped
+inline void sample_and_blend(uint8_t* dst, const uint8_t* src, int pitch,
+    int x0, int y0, int x1, int y1, float fx, float fy)
+{
+    const uint8_t* row0 = src + (size_t)y0 * pitch;
+    const uint8_t* row1 = src + (size_t)y1 * pitch;
+
+    const __m128 t00 = unpack_texel(load_u32(row0 + x0 * 4));
+    const __m128 t10 = unpack_texel(load_u32(row0 + x1 * 4));
+    const __m128 t01 = unpack_texel(load_u32(row1 + x0 * 4));
+    const __m128 t11 = unpack_texel(load_u32(row1 + x1 * 4));
+
+    const __m128 vfx = _mm_set1_ps(fx), vfy = _mm_set1_ps(fy);
+    const __m128 top = _mm_add_ps(t00, _mm_mul_ps(_mm_sub_ps(t10, t00), vfx));
+    const __m128 bottom = _mm_add_ps(t01, _mm_mul_ps(_mm_sub_ps(t11, t01), vfx));
+    const __m128 c = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), vfy));
+
+    // src over dst: c + dst * (1 - c.a)
+    const __m128 alpha = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3));
+    const __m128 inv_alpha = _mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(alpha, _mm_set1_ps(1.f / 255.f)));
+    const __m128 d = _mm_add_ps(c, _mm_mul_ps(unpack_texel(load_u32(dst)), inv_alpha));
+
+    __m128i r = _mm_cvtps_epi32(d);
+    r = _mm_packs_epi32(r, r);
+    r = _mm_packus_epi16(r, r);
+    store_u32(dst, (uint32_t)_mm_cvtsi128_si32(r));
+}
+
+#else
+
+inline void sample_and_blend(uint8_t* dst, const uint8_t* src, int pitch,
+    int x0, int y0, int x1, int y1, float fx, float fy)
+{
+    const uint8_t* t00 = src + (size_t)y0 * pitch + x0 * 4;
+    const uint8_t* t10 = src + (size_t)y0 * pitch + x1 * 4;
+    const uint8_t* t01 = src + (size_t)y1 * pitch + x0 * 4;
+    const uint8_t* t11 = src + (size_t)y1 * pitch + x1 * 4;
+
+    float c[4];
+    for(int i = 0; i < 4; i++)
+    {
+        const float top = t00[i] + (t10[i] - t00[i]) * fx;
+        const float bottom = t01[i] + (t11[i] - t01[i]) * fx;
+        c[i] = top + (bottom - top) * fy;
+    }
+
+    const float inv_alpha = 1.f - c[3] * (1.f / 255.f);
+    for(int i = 0; i < 4; i++)
+    {
+        const int v = (int)std::lround(c[i] + dst[i] * inv_alpha);
+        dst[i] = (uint8_t)std::min(std::max(v, 0), 255);
+    }
+}
+
+#endif
+
+}
+
+cpu_compositor::matrix_t cpu_compositor::matrix_t::operator*(const matrix_t& b) const
+{
+    const matrix_t& a = *this;
+    matrix_t r;
+    r.m11 = a.m11 * b.m11 + a.m12 * b.m21;
+    r.m12 = a.m11 * b.m12 + a.m12 * b.m22;
+    r.m21 = a.m21 * b.m11 + a.m22 * b.m21;
+    r.m22 = a.m21 * b.m12 + a.m22 * b.m22;
+    r.dx = a.dx * b.m11 + a.dy * b.m21 + b.dx;
+    r.dy = a.dx * b.m12 + a.dy * b.m22 + b.dy;
+    return r;
+}
+
+bool cpu_compositor::matrix_t::invert()
+{
+    const float det = this->m11 * this->m22 - this->m12 * this->m21;
+    if(det == 0.f || !std::isfinite(det))
+        return false;
+
+    const float inv_det = 1.f / det;
+    matrix_t r;
+    r.m11 = this->m22 * inv_det;
+    r.m12 = -this->m12 * inv_det;
+    r.m21 = -this->m21 * inv_det;
+    r.m22 = this->m11 * inv_det;
+    r.dx = -(this->dx * r.m11 + this->dy * r.m21);
+    r.dy = -(this->dx * r.m12 + this->dy * r.m22);
+
+    *this = r;
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+cpu_compositor::cpu_compositor(unsigned int thread_count) : workers(thread_count)
+{
+}
+
+bool cpu_compositor::prepare_layer(
+    const surface_t& canvas, const layer_t& layer, prepared_layer_t& prepared)
+{
+    if(!layer.data || layer.width <= 0 || layer.height <= 0)
+        return false;
+
+    prepared.layer = &layer;
+    prepared.local_inv = layer.world;
+    prepared.bitmap_inv = layer.brush * layer.world;
+    prepared.clip_inv = layer.clip_m;
+    if(!prepared.local_inv.invert() || !prepared.bitmap_inv.invert() ||
+        !prepared.clip_inv.invert())
+        return false;
+
+    auto bounds = [](const rect_t& rect, const matrix_t& m, rect_t& out)
+    {
+        const float xs[] = {rect.left, rect.right, rect.left, rect.right};
+        const float ys[] = {rect.top, rect.top, rect.bottom, rect.bottom};
+        out = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+            std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+        for(int i = 0; i < 4; i++)
+        {
+            float x, y;
+            m.transform_point(xs[i], ys[i], x, y);
+            out.left = std::min(out.left, x);
+            out.top = std::min(out.top, y);
+            out.right = std::max(out.right, x);
+            out.bottom = std::max(out.bottom, y);
+        }
+    };
+
+    rect_t fill_bounds, clip_bounds;
+    bounds(layer.fill_rect, layer.world, fill_bounds);
+    bounds(layer.clip_rect, layer.clip_m, clip_bounds);
+
+    prepared.left = (int)std::floor(std::max({fill_bounds.left, clip_bounds.left, 0.f}));
+    prepared.top = (int)std::floor(std::max({fill_bounds.top, clip_bounds.top, 0.f}));
+    prepared.right = (int)std::ceil(
+        std::min({fill_bounds.right, clip_bounds.right, (float)canvas.width}));
+    prepared.bottom = (int)std::ceil(
+        std::min({fill_bounds.bottom, clip_bounds.bottom, (float)canvas.height}));
+
+    return (prepared.left < prepared.right && prepared.top < prepared.bottom);
+}
+
+void cpu_compositor::clear_rows(surface_t& canvas, uint32_t color, int top, int bottom)
+{
+    for(int y = top; y < bottom; y++)
+    {
+        uint8_t* row = canvas.data + (size_t)y * canvas.pitch;
+        for(int x = 0; x < canvas.width; x++)
+            store_u32(row + x * 4, color);
+    }
+}
+
+void cpu_compositor::draw_rows(surface_t& canvas, const prepared_layer_t& prepared,
+    int top, int bottom)
+{
+    const layer_t& layer = *prepared.layer;
+    const matrix_t& local_inv = prepared.local_inv;
+    const matrix_t& bitmap_inv = prepared.bitmap_inv;
+    const matrix_t& clip_inv = prepared.clip_inv;
+    const rect_t& fill = layer.fill_rect;
+    const rect_t& clip = layer.clip_rect;
+    const int max_x = layer.width - 1, max_y = layer.height - 1;
+
+    top = std::max(top, prepared.top);
+    bottom = std::min(bottom, prepared.bottom);
+
+    for(int y = top; y < bottom; y++)
+    {
+        uint8_t* row = canvas.data + (size_t)y * canvas.pitch;
+
+        // the pixel centers are sampled; the coordinates are stepped along the row
+        const float px = prepared.left + 0.5f, py = y + 0.5f;
+        float lx, ly, bx, by, cx, cy;
+        local_inv.transform_point(px, py, lx, ly);
+        bitmap_inv.transform_point(px, py, bx, by);
+        clip_inv.transform_point(px, py, cx, cy);
+
+        for(int x = prepared.left; x < prepared.right; x++,
+            lx += local_inv.m11, ly += local_inv.m12,
+            bx += bitmap_inv.m11, by += bitmap_inv.m12,
+            cx += clip_inv.m11, cy += clip_inv.m12)
+        {
+            if(lx < fill.left || lx >= fill.right || ly < fill.top || ly >= fill.bottom)
+                continue;
+            if(!layer.axis_aligned_clip &&
+                (cx < clip.left || cx >= clip.right || cy < clip.top || cy >= clip.bottom))
+                continue;
+
+            const float u = bx - 0.5f, v = by - 0.5f;
+            const float fu = std::floor(u), fv = std::floor(v);
+            const int x0 = (int)fu, y0 = (int)fv;
+
+            sample_and_blend(row + x * 4, layer.data, layer.pitch,
+                std::min(std::max(x0, 0), max_x), std::min(std::max(y0, 0), max_y),
+                std::min(std::max(x0 + 1, 0), max_x), std::min(std::max(y0 + 1, 0), max_y),
+                u - fu, v - fv);
+        }
+    }
+}
+
+void cpu_compositor::compose(surface_t& canvas, const layer_t* layers, size_t layer_count,
+    uint32_t clear_color)
+{
+    frame_t frame = {canvas, layers, layer_count};
+    this->compose(&frame, 1, clear_color);
+}
+
+void cpu_compositor::compose(frame_t* frames, size_t frame_count, uint32_t clear_color)
+{
+    // prepared layers of each frame and the index of the first band of each frame
+    std::vector<std::vector<prepared_layer_t>> prepared_layers(frame_count);
+    std::vector<int> first_bands(frame_count + 1, 0);
+    for(size_t i = 0; i < frame_count; i++)
+    {
+        const surface_t& canvas = frames[i].canvas;
+        assert_(canvas.data);
+        assert_(canvas.pitch >= canvas.width * 4);
+
+        prepared_layers[i].reserve(frames[i].layer_count);
+        for(size_t j = 0; j < frames[i].layer_count; j++)
+        {
+            prepared_layer_t prepared;
+            if(prepare_layer(canvas, frames[i].layers[j], prepared))
+                prepared_layers[i].push_back(prepared);
+        }
+
+        first_bands[i + 1] = first_bands[i] + (canvas.height + band_height - 1) / band_height;
+    }
+
+    // each band is cleared and composited by a single thread, so that
+    // the band stays in the cache
+    const worker_pool::job_t job = [&](int part)
+    {
+        const size_t frame =
+            std::upper_bound(first_bands.begin(), first_bands.end(), part) - first_bands.begin() - 1;
+        surface_t& canvas = frames[frame].canvas;
+        const int top = (part - first_bands[frame]) * band_height;
+        const int bottom = std::min(top + band_height, canvas.height);
+
+        clear_rows(canvas, clear_color, top, bottom);
+        for(const auto& prepared : prepared_layers[frame])
+            draw_rows(canvas, prepared, top, bottom);
+    };
+
+    this->workers.run(first_bands.back(), job);
+}
\ No newline at end of file
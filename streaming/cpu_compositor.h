@@ -0,0 +1,102 @@
+#pragma once
+
+#include "worker_pool.h"
+#include <stdint.h>
+#include <vector>
+
+// software compositor for premultiplied bgra surfaces;
+// it is an alternative to the d2d path of the videomixer for machines without a usable gpu;
+// the transforms follow the d2d row vector convention(p' = p * M),
+// so that the videomixer params can be used as is;
+// the canvas is split into scanline bands that are composited in parallel;
+// multiple frames can be composited in the same run
+
+class cpu_compositor final
+{
+public:
+    struct matrix_t
+    {
+        float m11, m12, m21, m22, dx, dy;
+
+        static matrix_t identity() { return {1.f, 0.f, 0.f, 1.f, 0.f, 0.f}; }
+        static matrix_t scale(float x, float y) { return {x, 0.f, 0.f, y, 0.f, 0.f}; }
+        static matrix_t translation(float x, float y) { return {1.f, 0.f, 0.f, 1.f, x, y}; }
+
+        matrix_t operator*(const matrix_t&) const;
+        // returns false if the matrix is not invertible; the matrix is left untouched then
+        bool invert();
+        void transform_point(float x, float y, float& x_out, float& y_out) const
+        {
+            x_out = x * this->m11 + y * this->m21 + this->dx;
+            y_out = x * this->m12 + y * this->m22 + this->dy;
+        }
+    };
+
+    struct rect_t { float left, top, right, bottom; };
+
+    // the pitch is in bytes
+    struct surface_t
+    {
+        uint8_t* data;
+        int width, height, pitch;
+    };
+
+    struct layer_t
+    {
+        // premultiplied bgra
+        const uint8_t* data;
+        int width, height, pitch;
+
+        // the rectangle that is filled in local space
+        rect_t fill_rect;
+        // local space to canvas space
+        matrix_t world;
+        // bitmap space to local space
+        matrix_t brush;
+        // the clip rect is transformed to canvas space by clip_m;
+        // an axis aligned clip is clipped to the bounds of the transformed rect
+        rect_t clip_rect;
+        matrix_t clip_m;
+        bool axis_aligned_clip;
+    };
+
+    struct frame_t
+    {
+        surface_t canvas;
+        const layer_t* layers;
+        size_t layer_count;
+    };
+private:
+    // layer with the precomputed inverse transforms
+    struct prepared_layer_t
+    {
+        const layer_t* layer;
+        // canvas space to local space and canvas space to bitmap space
+        matrix_t local_inv, bitmap_inv;
+        matrix_t clip_inv;
+        // bounds of the layer in canvas space
+        int left, top, right, bottom;
+    };
+
+    static constexpr int band_height = 32;
+
+    worker_pool workers;
+
+    static bool prepare_layer(const surface_t&, const layer_t&, prepared_layer_t&);
+    static void clear_rows(surface_t&, uint32_t color, int top, int bottom);
+    static void draw_rows(surface_t&, const prepared_layer_t&, int top, int bottom);
+public:
+    // thread count of 0 uses the hardware concurrency;
+    // thread count of 1 composites in the calling thread only
+    explicit cpu_compositor(unsigned int thread_count = 0);
+
+    // clears the canvas and draws the layers in order;
+    // the canvas alpha is ignored
+    void compose(surface_t& canvas, const layer_t* layers, size_t layer_count,
+        uint32_t clear_color = 0xFF000000);
+    // composes independent frames concurrently;
+    // the bands of all frames are distributed to the workers in a single run,
+    // so that short frames and frames with few bands also keep the workers busy;
+    // the canvases must not overlap
+    void compose(frame_t* frames, size_t frame_count, uint32_t clear_color = 0xFF000000);
+};
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "cpu_scaler.h"
+#include "assert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CPU_SCALER_SSE2
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+
+constexpr int weight_bits = 14;
+// the horizontal pass keeps 6 extra bits in the intermediate values
+constexpr int horizontal_shift = 8;
+constexpr int vertical_shift = 20;
+
+const double pi = 3.14159265358979323846;
+
+double filter_support(cpu_scaler::filter_t filter)
+{
+    switch(filter)
+    {
+    case cpu_scaler::FILTER_BILINEAR:
+        return 1.0;
+    case cpu_scaler::FILTER_BICUBIC:
+        return 2.0;
+    default:
+        return 3.0;
+    }
+}
+
+double sinc(double x)
+{
+    if(x == 0.0)
+        return 1.0;
+    x *= pi;
+    return std::sin(x) / x;
+}
+
+double filter_kernel(cpu_scaler::filter_t filter, double x)
+{
+    x = std::abs(x);
+    switch(filter)
+    {
+    case cpu_scaler::FILTER_BILINEAR:
+        return std::max(1.0 - x, 0.0);
+    case cpu_scaler::FILTER_BICUBIC:
+    {
+        // catmull-rom
+        const double a = -0.5;
+        if(x < 1.0)
+            return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        if(x < 2.0)
+            return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+        return 0.0;
+    }
+    default:
+        return (x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+}
+
+inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)std::min(std::max(v, 0), 255);
+}
+
+void filter_row_horizontal_scalar(const cpu_scaler::filter_table& table,
+    const uint8_t* src, int16_t* dst, int first, int dst_width, int channels)
+{
+    for(int x = first; x < dst_width; x++)
+    {
+        const uint8_t* p = src + table.offsets[x] * channels;
+        const int16_t* w = &table.weights[(size_t)x * table.taps];
+        for(int c = 0; c < channels; c++)
+        {
+            int sum = 0;
+            for(int k = 0; k < table.taps; k++)
+                sum += p[k * channels + c] * w[k];
+            dst[x * channels + c] = (int16_t)((sum + (1 << (horizontal_shift - 1))) >> horizontal_shift);
+        }
+    }
+}
+
+void filter_row_vertical_scalar(const cpu_scaler::filter_table& table, int y,
+    const int16_t* intermediate, uint8_t* dst, int first, int row_len)
+{
+    const int16_t* rows = intermediate + (size_t)table.offsets[y] * row_len;
+    const int16_t* w = &table.weights[(size_t)y * table.taps];
+    for(int i = first; i < row_len; i++)
+    {
+        int sum = 0;
+        for(int k = 0; k < table.taps; k++)
+            sum += rows[(size_t)k * row_len + i] * w[k];
+        dst[i] = clamp_u8((sum + (1 << (vertical_shift - 1))) >> vertical_shift);
+    }
+}
+
+#ifdef CPU_SCALER_SSE2
+
+inline __m128i weight_pair(int16_t w0, int16_t w1)
+{
+    return _mm_set1_epi32((int)(((uint32_t)(uint16_t)w1 << 16) | (uint16_t)w0));
+}
+
+// bgra only; each output pixel accumulates two taps at a time
+void filter_row_horizontal_sse2(const cpu_scaler::filter_table& table,
+    const uint8_t* src, int16_t* dst, int dst_width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (horizontal_shift - 1));
+
+    for(int x = 0; x < dst_width; x++)
+    {
+        const uint8_t* p = src + table.offsets[x] * 4;
+        const int16_t* w = &table.weights[(size_t)x * table.taps];
+        __m128i sum = zero;
+
+        int k = 0;
+        for(; k + 2 <= table.taps; k += 2)
+        {
+            // b0 g0 r0 a0 b1 g1 r1 a1 -> b0 b1 g0 g1 r0 r1 a0 a1
+            const __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(p + k * 4)), zero);
+            const __m128i pairs = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, weight_pair(w[k], w[k + 1])));
+        }
+        if(k < table.taps)
+        {
+            int texel;
+            std::memcpy(&texel, p + k * 4, sizeof(texel));
+            const __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero);
+            const __m128i pairs = _mm_unpacklo_epi16(px, zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(pairs, weight_pair(w[k], 0)));
+        }
+
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, round), horizontal_shift);
+        _mm_storel_epi64((__m128i*)(dst + x * 4), _mm_packs_epi32(sum, sum));
+    }
+}
+
+// filters 8 intermediate values at a time; two source rows are interleaved per madd
+void filter_row_vertical_sse2(const cpu_scaler::filter_table& table, int y,
+    const int16_t* intermediate, uint8_t* dst, int row_len)
+{
+    const int16_t* rows = intermediate + (size_t)table.offsets[y] * row_len;
+    const int16_t* w = &table.weights[(size_t)y * table.taps];
+    const __m128i round = _mm_set1_epi32(1 << (vertical_shift - 1));
+
+    int i = 0;
+    for(; i + 8 <= row_len; i += 8)
+    {
+        __m128i sum_lo = _mm_setzero_si128(), sum_hi = _mm_setzero_si128();
+
+        int k = 0;
+        for(; k < table.taps; k += 2)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i*)(rows + (size_t)k * row_len + i));
+            const __m128i b = (k + 1 < table.taps) ?
+                _mm_loadu_si128((const __m128i*)(rows + (size_t)(k + 1) * row_len + i)) :
+                _mm_setzero_si128();
+            const __m128i weights = weight_pair(w[k], (k + 1 < table.taps) ? w[k + 1] : 0);
+
+            sum_lo = _mm_add_epi32(sum_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+            sum_hi = _mm_add_epi32(sum_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+        }
+
+        sum_lo = _mm_srai_epi32(_mm_add_epi32(sum_lo, round), vertical_shift);
+        sum_hi = _mm_srai_epi32(_mm_add_epi32(sum_hi, round), vertical_shift);
+        const __m128i out = _mm_packs_epi32(sum_lo, sum_hi);
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(out, out));
+    }
+
+    filter_row_vertical_scalar(table, y, intermediate, dst, i, row_len);
+}
+
+#endif
+
+}
+
+cpu_scaler::cpu_scaler(filter_t filter, unsigned int thread_count) :
+    filter(filter),
+    workers(thread_count)
+{
+}
+
+cpu_scaler::filter_table_t cpu_scaler::build_filter_table(
+    filter_t filter, int src_size, int dst_size)
+{
+    assert_(src_size > 0 && dst_size > 0);
+
+    // the filter is stretched when downscaling so that it covers all the source samples
+    const double scale = (double)src_size / dst_size;
+    const double filter_scale = std::max(scale, 1.0);
+    const double support = filter_support(filter) * filter_scale;
+
+    std::shared_ptr<filter_table> table(new filter_table);
+    // the window [center - support, center + support] spans at most ceil(2 * support) samples
+    table->taps = std::min((int)std::ceil(2.0 * support), src_size);
+    table->offsets.resize(dst_size);
+    table->weights.resize((size_t)dst_size * table->taps);
+
+    std::vector<double> weights(table->taps);
+    for(int i = 0; i < dst_size; i++)
+    {
+        const double center = (i + 0.5) * scale - 0.5;
+        const int left = (int)std::floor(center - support) + 1;
+        const int right = (int)std::floor(center + support);
+        // the window is moved inside the source, and the samples outside of the source
+        // are folded to the edges
+        const int start = std::min(std::max(left, 0), src_size - table->taps);
+
+        std::fill(weights.begin(), weights.end(), 0.0);
+        double sum = 0.0;
+        for(int j = left; j <= right; j++)
+        {
+            const int index = std::min(std::max(j, 0), src_size - 1) - start;
+            assert_(index >= 0 && index < table->taps);
+
+            const double weight = filter_kernel(filter, (j - center) / filter_scale);
+            weights[index] += weight;
+            sum += weight;
+        }
+
+        table->offsets[i] = start;
+        int16_t* fixed = &table->weights[(size_t)i * table->taps];
+        if(sum == 0.0)
+        {
+            // nearest sample
+            std::fill(fixed, fixed + table->taps, (int16_t)0);
+            const int nearest = std::min(std::max((int)std::lround(center), 0), src_size - 1);
+            fixed[nearest - start] = 1 << weight_bits;
+            continue;
+        }
+
+        // the rounding error is added to the largest weight so that the weights sum to 1
+        int total = 0, largest = 0;
+        for(int k = 0; k < table->taps; k++)
+        {
+            fixed[k] = (int16_t)std::lround(weights[k] / sum * (1 << weight_bits));
+            total += fixed[k];
+            if(std::abs(fixed[k]) > std::abs(fixed[largest]))
+                largest = k;
+        }
+        fixed[largest] += (int16_t)((1 << weight_bits) - total);
+    }
+
+    return table;
+}
+
+cpu_scaler::filter_table_t cpu_scaler::get_filter_table(int src_size, int dst_size)
+{
+    filter_table_t& table = this->filter_tables[std::make_pair(src_size, dst_size)];
+    if(!table)
+        table = build_filter_table(this->filter, src_size, dst_size);
+    return table;
+}
+
+void cpu_scaler::scale(const uint8_t* src, int src_pitch, int src_width, int src_height,
+    uint8_t* dst, int dst_pitch, int dst_width, int dst_height, int channels)
+{
+    assert_(channels == 1 || channels == 2 || channels == 4);
+    assert_(src_width > 0 && src_height > 0 && dst_width > 0 && dst_height > 0);
+
+    scoped_lock lock(this->mutex);
+
+    const filter_table_t horizontal = this->get_filter_table(src_width, dst_width);
+    const filter_table_t vertical = this->get_filter_table(src_height, dst_height);
+    const int row_len = dst_width * channels;
+    this->intermediate.resize((size_t)row_len * src_height);
+    int16_t* intermediate = this->intermediate.data();
+
+    // horizontal pass for every source row
+    this->workers.run((src_height + rows_per_part - 1) / rows_per_part, [&](int part)
+        {
+            const int top = part * rows_per_part;
+            const int bottom = std::min(top + rows_per_part, src_height);
+            for(int y = top; y < bottom; y++)
+            {
+                const uint8_t* src_row = src + (size_t)y * src_pitch;
+                int16_t* dst_row = intermediate + (size_t)y * row_len;
+#ifdef CPU_SCALER_SSE2
+                if(channels == 4)
+                {
+                    filter_row_horizontal_sse2(*horizontal, src_row, dst_row, dst_width);
+                    continue;
+                }
+#endif
+                filter_row_horizontal_scalar(*horizontal, src_row, dst_row, 0, dst_width, channels);
+            }
+        });
+
+    // vertical pass for every destination row
+    this->workers.run((dst_height + rows_per_part - 1) / rows_per_part, [&](int part)
+        {
+            const int top = part * rows_per_part;
+            const int bottom = std::min(top + rows_per_part, dst_height);
+            for(int y = top; y < bottom; y++)
+            {
+                uint8_t* dst_row = dst + (size_t)y * dst_pitch;
+#ifdef CPU_SCALER_SSE2
+                filter_row_vertical_sse2(*vertical, y, intermediate, dst_row, row_len);
+#else
+                filter_row_vertical_scalar(*vertical, y, intermediate, dst_row, 0, row_len);
+#endif
+            }
+        });
+}
+
+void cpu_scaler::scale_nv12(
+    const uint8_t* src_y, int src_y_pitch, const uint8_t* src_uv, int src_uv_pitch,
+    int src_width, int src_height,
+    uint8_t* dst_y, int dst_y_pitch, uint8_t* dst_uv, int dst_uv_pitch,
+    int dst_width, int dst_height)
+{
+    assert_(src_width % 2 == 0 && src_height % 2 == 0);
+    assert_(dst_width % 2 == 0 && dst_height % 2 == 0);
+
+    this->scale(src_y, src_y_pitch, src_width, src_height,
+        dst_y, dst_y_pitch, dst_width, dst_height, 1);
+    this->scale(src_uv, src_uv_pitch, src_width / 2, src_height / 2,
+        dst_uv, dst_uv_pitch, dst_width / 2, dst_height / 2, 2);
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "worker_pool.h"
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// separable resampler for 8 bit surfaces on the cpu;
+// the image is filtered horizontally into an intermediate buffer with 6 extra bits of precision,
+// which is then filtered vertically;
+// both passes are split into row bands that are processed in parallel;
+// the filter tables are built once per source and destination size and cached
+
+class cpu_scaler final
+{
+public:
+    typedef std::lock_guard<std::mutex> scoped_lock;
+
+    enum filter_t { FILTER_BILINEAR, FILTER_BICUBIC, FILTER_LANCZOS3 };
+
+    // weights have 14 fractional bits and sum to 1;
+    // the taps of an output sample are contiguous and within the source
+    struct filter_table
+    {
+        int taps;
+        std::vector<int> offsets;
+        std::vector<int16_t> weights;
+    };
+    typedef std::shared_ptr<const filter_table> filter_table_t;
+private:
+    static constexpr int rows_per_part = 16;
+
+    const filter_t filter;
+    worker_pool workers;
+
+    std::mutex mutex;
+    std::map<std::pair<int, int>, filter_table_t> filter_tables;
+    std::vector<int16_t> intermediate;
+
+    filter_table_t get_filter_table(int src_size, int dst_size);
+public:
+    // thread count of 0 uses the hardware concurrency
+    explicit cpu_scaler(filter_t, unsigned int thread_count = 0);
+
+    filter_t get_filter() const { return this->filter; }
+
+    static filter_table_t build_filter_table(filter_t, int src_size, int dst_size);
+
+    // scales an interleaved surface with 1, 2 or 4 channels;
+    // the pitches are in bytes;
+    // calls are serialized
+    void scale(const uint8_t* src, int src_pitch, int src_width, int src_height,
+        uint8_t* dst, int dst_pitch, int dst_width, int dst_height, int channels);
+    // scales the luma and the interleaved chroma planes of a nv12 surface;
+    // the dimensions are the luma dimensions and must be even
+    void scale_nv12(
+        const uint8_t* src_y, int src_y_pitch, const uint8_t* src_uv, int src_uv_pitch,
+        int src_width, int src_height,
+        uint8_t* dst_y, int dst_y_pitch, uint8_t* dst_uv, int dst_uv_pitch,
+        int dst_width, int dst_height);
+};
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "dirty_region.h"
+#include <algorithm>
+#include <limits>
+
+#undef min
+#undef max
+
+bool dirty_region::rect_t::contains(const rect_t& other) const
+{
+    return other.left >= this->left && other.top >= this->top &&
+        other.right <= this->right && other.bottom <= this->bottom;
+}
+
+dirty_region::rect_t dirty_region::rect_t::intersect(const rect_t& other) const
+{
+    return {std::max(this->left, other.left), std::max(this->top, other.top),
+        std::min(this->right, other.right), std::min(this->bottom, other.bottom)};
+}
+
+dirty_region::rect_t dirty_region::rect_t::unite(const rect_t& other) const
+{
+    return {std::min(this->left, other.left), std::min(this->top, other.top),
+        std::max(this->right, other.right), std::max(this->bottom, other.bottom)};
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+dirty_region::dirty_region(int32_t width, int32_t height) :
+    bounds{0, 0, std::max(width, 0), std::max(height, 0)}
+{
+}
+
+int64_t dirty_region::merge_cost(const rect_t& a, const rect_t& b)
+{
+    const int64_t covered = a.area() + b.area() - a.intersect(b).area();
+    return a.unite(b).area() - covered;
+}
+
+void dirty_region::merge_closest_pair()
+{
+    size_t first = 0, second = 1;
+    int64_t min_cost = std::numeric_limits<int64_t>::max();
+    for(size_t i = 0; i < this->rects.size(); i++)
+        for(size_t j = i + 1; j < this->rects.size(); j++)
+        {
+            const int64_t cost = merge_cost(this->rects[i], this->rects[j]);
+            if(cost < min_cost)
+            {
+                min_cost = cost;
+                first = i;
+                second = j;
+            }
+        }
+
+    this->rects[first] = this->rects[first].unite(this->rects[second]);
+    this->rects.erase(this->rects.begin() + second);
+}
+
+void dirty_region::add(rect_t rect)
+{
+    rect = rect.intersect(this->bounds);
+    if(rect.empty())
+        return;
+
+    // the rectangle absorbs the rectangles that are cheap to merge with it;
+    // merging grows the rectangle, so the list is scanned again after a merge
+    for(bool merged = true; merged;)
+    {
+        merged = false;
+        for(auto it = this->rects.begin(); it != this->rects.end(); it++)
+        {
+            if(it->contains(rect))
+                return;
+
+            const int64_t covered = rect.area() + it->area() - rect.intersect(*it).area();
+            if(rect.contains(*it) || merge_cost(rect, *it) * waste_divisor <= covered)
+            {
+                rect = rect.unite(*it);
+                this->rects.erase(it);
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    this->rects.push_back(rect);
+    while(this->rects.size() > max_rect_count)
+        this->merge_closest_pair();
+
+    if(this->get_area() * full_denominator >= this->bounds.area() * full_numerator)
+        this->set_full();
+}
+
+void dirty_region::add(const dirty_region& other)
+{
+    if(other.is_full() && other.bounds.contains(this->bounds))
+    {
+        this->set_full();
+        return;
+    }
+
+    for(const auto& rect : other.rects)
+        this->add(rect);
+}
+
+void dirty_region::set_full()
+{
+    this->rects.clear();
+    if(!this->bounds.empty())
+        this->rects.push_back(this->bounds);
+}
+
+bool dirty_region::is_full() const
+{
+    return this->rects.size() == 1 && this->rects[0].contains(this->bounds);
+}
+
+int64_t dirty_region::get_area() const
+{
+    int64_t area = 0;
+    for(const auto& rect : this->rects)
+        area += rect.area();
+    return area;
+}
\ No newline at end of file
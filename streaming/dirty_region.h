@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// the changed area of a surface as a short list of rectangles;
+// the rectangles are merged when the merged rectangle wastes little area, so that
+// the list stays short for the copies; the region may cover more than the changed area,
+// but never less;
+// has no platform dependencies
+
+class dirty_region
+{
+public:
+    struct rect_t
+    {
+        // right and bottom are exclusive
+        int32_t left, top, right, bottom;
+
+        bool empty() const {return this->left >= this->right || this->top >= this->bottom;}
+        int64_t area() const
+        {
+            return this->empty() ? 0 : (int64_t)(this->right - this->left) * (this->bottom - this->top);
+        }
+        bool contains(const rect_t&) const;
+        rect_t intersect(const rect_t&) const;
+        rect_t unite(const rect_t&) const;
+    };
+
+    // the rectangles are merged further if the list grows longer than this
+    static constexpr size_t max_rect_count = 16;
+    // rectangles are merged if the merged rectangle wastes at most 1 / waste_divisor
+    // of the area covered by them
+    static constexpr int64_t waste_divisor = 4;
+    // the region becomes the whole surface if the rectangles cover at least
+    // full_numerator / full_denominator of it
+    static constexpr int64_t full_numerator = 3, full_denominator = 4;
+private:
+    rect_t bounds;
+    std::vector<rect_t> rects;
+
+    // the area that merging the rectangles would waste
+    static int64_t merge_cost(const rect_t&, const rect_t&);
+    void merge_closest_pair();
+public:
+    dirty_region(int32_t width, int32_t height);
+
+    // the rectangle is clipped to the surface
+    void add(rect_t);
+    void add(const dirty_region&);
+    void set_full();
+    void clear() {this->rects.clear();}
+
+    bool empty() const {return this->rects.empty();}
+    bool is_full() const;
+    // the sum of the areas of the rectangles
+    int64_t get_area() const;
+    const rect_t& get_bounds() const {return this->bounds;}
+    const std::vector<rect_t>& get_rects() const {return this->rects;}
+};
+
+typedef std::shared_ptr<const dirty_region> dirty_region_t;
\ No newline at end of file
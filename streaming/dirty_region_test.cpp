@@ -0,0 +1,181 @@
+#include "dirty_region_test.h"
+#include "dirty_region.h"
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <iostream>
+
+#undef min
+#undef max
+
+namespace
+{
+
+typedef dirty_region::rect_t rect_t;
+
+bool check(bool condition, const char* description)
+{
+    if(!condition)
+        std::cout << "dirty region test failed: " << description << std::endl;
+    return condition;
+}
+
+bool equal_rects(const dirty_region& region, const std::vector<rect_t>& rects)
+{
+    if(region.get_rects().size() != rects.size())
+        return false;
+    for(size_t i = 0; i < rects.size(); i++)
+    {
+        const rect_t& a = region.get_rects()[i];
+        const rect_t& b = rects[i];
+        if(a.left != b.left || a.top != b.top || a.right != b.right || a.bottom != b.bottom)
+            return false;
+    }
+    return true;
+}
+
+bool check_clip()
+{
+    bool passed = true;
+    dirty_region region(100, 50);
+
+    region.add(rect_t{-10, -10, 20, 20});
+    passed &= check(equal_rects(region, {{0, 0, 20, 20}}), "clip to the top left corner");
+
+    region.add(rect_t{90, 40, 200, 200});
+    passed &= check(equal_rects(region, {{0, 0, 20, 20}, {90, 40, 100, 50}}),
+        "clip to the bottom right corner");
+
+    region.add(rect_t{100, 0, 120, 10});
+    region.add(rect_t{-20, 0, 0, 10});
+    region.add(rect_t{30, 30, 30, 40});
+    passed &= check(region.get_rects().size() == 2, "add a rect outside the surface or empty");
+
+    dirty_region empty_region(0, 0);
+    empty_region.add(rect_t{0, 0, 10, 10});
+    empty_region.set_full();
+    passed &= check(empty_region.empty(), "add to an empty surface");
+
+    dirty_region negative_region(-5, 10);
+    passed &= check(negative_region.get_bounds().empty(), "clamp a negative surface size");
+
+    return passed;
+}
+
+bool check_union()
+{
+    bool passed = true;
+    dirty_region region(100, 50);
+
+    // adjacent rects waste no area when merged
+    region.add(rect_t{0, 0, 10, 10});
+    region.add(rect_t{10, 0, 20, 10});
+    passed &= check(equal_rects(region, {{0, 0, 20, 10}}), "merge adjacent rects");
+
+    region.add(rect_t{2, 2, 5, 5});
+    passed &= check(equal_rects(region, {{0, 0, 20, 10}}), "add a contained rect");
+
+    region.add(rect_t{80, 40, 90, 50});
+    passed &= check(equal_rects(region, {{0, 0, 20, 10}, {80, 40, 90, 50}}),
+        "keep distant rects apart");
+    passed &= check(region.get_area() == 300, "area of the rects");
+
+    // the covering rect absorbs the rects inside it
+    region.add(rect_t{0, 0, 30, 10});
+    passed &= check(equal_rects(region, {{80, 40, 90, 50}, {0, 0, 30, 10}}),
+        "absorb the rects inside the added rect");
+
+    dirty_region other(100, 50);
+    other.add(rect_t{50, 20, 60, 30});
+    region.add(other);
+    passed &= check(region.get_rects().size() == 3, "add the rects of another region");
+
+    dirty_region full_region(100, 50);
+    full_region.set_full();
+    region.add(full_region);
+    passed &= check(region.is_full(), "add a full region");
+
+    return passed;
+}
+
+bool check_full()
+{
+    bool passed = true;
+    dirty_region region(100, 50);
+
+    region.add(rect_t{0, 0, 100, 37});
+    passed &= check(!region.is_full(), "stay partial below the full coverage");
+
+    region.add(rect_t{0, 37, 100, 38});
+    passed &= check(region.is_full() && equal_rects(region, {{0, 0, 100, 50}}),
+        "become full at the full coverage");
+
+    region.clear();
+    passed &= check(region.empty() && !region.is_full(), "clear the region");
+
+    return passed;
+}
+
+// the region must cover every added pixel with rects that are inside the surface
+bool check_coverage()
+{
+    constexpr int32_t width = 64, height = 48;
+    std::minstd_rand random_generator(1);
+    std::uniform_int_distribution<int32_t> x_distribution(-8, width + 8),
+        y_distribution(-8, height + 8);
+
+    for(int trial = 0; trial < 100; trial++)
+    {
+        dirty_region region(width, height);
+        std::vector<bool> added(width * height, false);
+
+        for(int i = 0; i < 40; i++)
+        {
+            const int32_t x = x_distribution(random_generator),
+                y = y_distribution(random_generator);
+            const rect_t rect = {x, y, x + x_distribution(random_generator) / 4,
+                y + y_distribution(random_generator) / 4};
+            region.add(rect);
+
+            for(int32_t py = std::max(rect.top, 0); py < std::min(rect.bottom, height); py++)
+                for(int32_t px = std::max(rect.left, 0); px < std::min(rect.right, width); px++)
+                    added[py * width + px] = true;
+
+            if(!check(region.get_rects().size() <= dirty_region::max_rect_count,
+                "limit the rect count"))
+                return false;
+            for(const auto& region_rect : region.get_rects())
+                if(!check(!region_rect.empty() && region.get_bounds().contains(region_rect),
+                    "keep the rects inside the surface"))
+                    return false;
+
+            for(int32_t py = 0; py < height; py++)
+                for(int32_t px = 0; px < width; px++)
+                {
+                    if(!added[py * width + px])
+                        continue;
+                    bool covered = false;
+                    for(const auto& region_rect : region.get_rects())
+                        covered = covered || region_rect.contains(rect_t{px, py, px + 1, py + 1});
+                    if(!check(covered, "cover every added pixel"))
+                        return false;
+                }
+        }
+    }
+
+    return true;
+}
+
+}
+
+bool run_dirty_region_test()
+{
+    bool passed = true;
+    passed &= check_clip();
+    passed &= check_union();
+    passed &= check_full();
+    passed &= check_coverage();
+
+    std::cout << "dirty region test " << (passed ? "passed" : "failed") << std::endl;
+    return passed;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+
+// checks for the dirty region of the desktop capture;
+// the rectangles of a region are checked to stay clipped to the surface and to cover
+// every added pixel while they are merged, and the merging of regions and the promotion
+// to the full surface are checked against known results;
+// the test has no dependencies on the pipeline
+
+// returns false if a check failed; the failed checks are printed
+bool run_dirty_region_test();
\ No newline at end of file
@@ -27,8 +27,21 @@ void gui_configdlg::set_splitter(CStatic& wnd_static)
 /////////////////////////////////////////////////////////////////
 
 
+bool gui_configdlg_general::should_update_settings()
+{
+    this->cpu_videomixer = (this->wnd_cpu_videomixer.GetCheck() == BST_CHECKED);
+    return this->cpu_videomixer != this->ctrl_pipeline->get_current_config().cpu_videomixer;
+}
+
 LRESULT gui_configdlg_general::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPARAM /*lParam*/, BOOL& /*bHandled*/)
 {
+    this->wnd_cpu_videomixer.Attach(this->GetDlgItem(IDC_CHECK2));
+
+    // populate the fields
+    const control_pipeline_config& config = this->ctrl_pipeline->get_current_config();
+    this->cpu_videomixer = config.cpu_videomixer;
+    this->wnd_cpu_videomixer.SetCheck(config.cpu_videomixer);
+
     if(this->ctrl_pipeline->is_recording())
         EnumChildWindows(*this, [](HWND hwnd, LPARAM) -> BOOL
             {
@@ -91,6 +104,25 @@ bool gui_configdlg_video::should_update_settings()
             throw std::invalid_argument("");
     }
 
+    // canvas resolution; the first item uses the video resolution
+    if(this->wnd_canvas_resolution.GetCurSel() == 0)
+        this->width_canvas = this->height_canvas = 0;
+    else
+    {
+        CString str, str_width, str_height;
+        int start_index = 0;
+        this->wnd_canvas_resolution.GetWindowTextW(str);
+
+        str_width = str.Tokenize(L"x", start_index);
+        str_height = str.Mid(start_index);
+
+        this->width_canvas = std::stoi(str_width.GetString());
+        this->height_canvas = std::stoi(str_height.GetString());
+
+        if((int)this->width_canvas <= 0 || (int)this->height_canvas <= 0)
+            throw std::invalid_argument("");
+    }
+
     // video device
     if(this->wnd_adapter.GetCurSel() == 0)
     {
@@ -152,10 +184,13 @@ bool gui_configdlg_video::should_update_settings()
         throw std::invalid_argument("");
     }
 
+    const control_pipeline_config& config = this->ctrl_pipeline->get_current_config();
     return std::memcmp(
         &this->config_video, 
-        &this->ctrl_pipeline->get_current_config().config_video,
-        sizeof(control_video_config)) != 0;
+        &config.config_video,
+        sizeof(control_video_config)) != 0 ||
+        this->width_canvas != config.width_canvas ||
+        this->height_canvas != config.height_canvas;
 }
 
 void gui_configdlg_video::populate_encoders_vector_and_combobox(UINT32 flags)
@@ -227,6 +262,7 @@ LRESULT gui_configdlg_video::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPAR
     this->wnd_fps_num.Attach(this->GetDlgItem(IDC_EDIT3));
     this->wnd_fps_den.Attach(this->GetDlgItem(IDC_EDIT4));
     this->wnd_video_resolution.Attach(this->GetDlgItem(IDC_COMBO3));
+    this->wnd_canvas_resolution.Attach(this->GetDlgItem(IDC_COMBO6));
     this->wnd_mpeg2_profile.Attach(this->GetDlgItem(IDC_COMBO1));
     this->wnd_static_splitter.Attach(this->GetDlgItem(IDC_STATIC1));
     this->wnd_bitrate.Attach(this->GetDlgItem(IDC_EDIT2));
@@ -242,6 +278,12 @@ LRESULT gui_configdlg_video::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPAR
     this->wnd_video_resolution.AddString(L"2560x1440");
     this->wnd_video_resolution.AddString(L"3840x2160");
 
+    this->wnd_canvas_resolution.AddString(L"Same as video resolution");
+    this->wnd_canvas_resolution.AddString(L"1280x720");
+    this->wnd_canvas_resolution.AddString(L"1920x1080");
+    this->wnd_canvas_resolution.AddString(L"2560x1440");
+    this->wnd_canvas_resolution.AddString(L"3840x2160");
+
     this->wnd_adapter.SetDroppedWidth(this->wnd_adapter.GetDroppedWidth() + dropped_width_increase);
 
     this->wnd_encoder.SetDroppedWidth(this->wnd_encoder.GetDroppedWidth() + dropped_width_increase);
@@ -258,6 +300,11 @@ LRESULT gui_configdlg_video::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPAR
     this->wnd_fps_den.SetWindowTextW(std::to_wstring(config.config_video.fps_den).c_str());
     this->wnd_video_resolution.SetWindowTextW((std::to_wstring(config.config_video.width_frame) 
         + L"x" + std::to_wstring(config.config_video.height_frame)).c_str());
+    if(!config.width_canvas || !config.height_canvas)
+        this->wnd_canvas_resolution.SetCurSel(0);
+    else
+        this->wnd_canvas_resolution.SetWindowTextW((std::to_wstring(config.width_canvas)
+            + L"x" + std::to_wstring(config.height_canvas)).c_str());
 
     // populate video adapter vector
     this->wnd_adapter.AddString(L"System Default");
@@ -559,6 +606,7 @@ LRESULT gui_configdlg_output::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPA
     this->wnd_output_stream_key.Attach(this->GetDlgItem(IDC_EDIT1));
     this->wnd_overwrite_old_file.Attach(this->GetDlgItem(IDC_CHECK1));
     this->wnd_showkey.Attach(this->GetDlgItem(IDC_SHOWKEY));
+    this->wnd_record_while_streaming.Attach(this->GetDlgItem(IDC_CHECK3));
     this->wnd_static_splitter.Attach(this->GetDlgItem(IDC_STATIC1));
 
     this->password_char = this->wnd_output_stream_key.SendMessageW(EM_GETPASSWORDCHAR);
@@ -571,6 +619,8 @@ LRESULT gui_configdlg_output::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPA
     this->wnd_overwrite_old_file.SetCheck(config.config_output.overwrite_old_file);
     ::SetWindowTextA(this->wnd_output_ingest_server, config.config_output.ingest_server);
     ::SetWindowTextA(this->wnd_output_stream_key, config.config_output.stream_key);
+    this->record_while_streaming = config.record_while_streaming;
+    this->wnd_record_while_streaming.SetCheck(config.record_while_streaming);
 
     if(this->ctrl_pipeline->is_recording())
         EnumChildWindows(*this, [](HWND hwnd, LPARAM) -> BOOL
@@ -674,10 +724,16 @@ bool gui_configdlg_output::should_update_settings()
     memset(this->config_output.stream_key, 0, MAX_PATH * sizeof(CHAR));
     ::GetWindowTextA(this->wnd_output_stream_key, this->config_output.stream_key, MAX_PATH);
 
+    // record while streaming
+    this->record_while_streaming =
+        (this->wnd_record_while_streaming.GetCheck() == BST_CHECKED);
+
+    const control_pipeline_config& current = this->ctrl_pipeline->get_current_config();
     return std::memcmp(
         &this->config_output,
-        &this->ctrl_pipeline->get_current_config().config_output,
-        sizeof(control_output_config)) != 0;
+        &current.config_output,
+        sizeof(control_output_config)) != 0 ||
+        this->record_while_streaming != current.record_while_streaming;
 }
 
 void gui_configdlg_output::update_settings(control_pipeline_config& config)
@@ -687,4 +743,5 @@ void gui_configdlg_output::update_settings(control_pipeline_config& config)
         std::decay_t<decltype(this->config_output)>>);
 
     std::memcpy(&config.config_output, &this->config_output, sizeof(this->config_output));
+    config.record_while_streaming = this->record_while_streaming;
 }
\ No newline at end of file
@@ -36,6 +36,8 @@ class gui_configdlg_general final :
 {
 private:
     CStatic wnd_static_splitter;
+    CButton wnd_cpu_videomixer;
+    BOOL cpu_videomixer;
 public:
     enum { IDD = IDD_GENERAL_CONFIG };
 
@@ -43,8 +45,9 @@ public:
 
     void create(HWND parent) override { this->Create(parent); }
     CWindow& get_wnd() override { return *this; }
-    bool should_update_settings() override { return false; }
-    void update_settings(control_pipeline_config&) override {}
+    bool should_update_settings() override;
+    void update_settings(control_pipeline_config& config) override
+    { config.cpu_videomixer = this->cpu_videomixer; }
 
     BEGIN_MSG_MAP(gui_configdlgs)
         MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
@@ -59,9 +62,10 @@ class gui_configdlg_video final :
 {
 private:
     control_video_config config_video;
+    UINT32 width_canvas, height_canvas;
 
     CEdit wnd_fps_num, wnd_fps_den;
-    CComboBox wnd_video_resolution, wnd_mpeg2_profile;
+    CComboBox wnd_video_resolution, wnd_canvas_resolution, wnd_mpeg2_profile;
     CStatic wnd_static_splitter;
     CEdit wnd_bitrate, wnd_quality_vs_speed;
     CComboBox wnd_adapter, wnd_encoder;
@@ -79,7 +83,11 @@ public:
     CWindow& get_wnd() override { return *this; }
     bool should_update_settings() override;
     void update_settings(control_pipeline_config& config) override
-    { config.config_video = this->config_video; }
+    {
+        config.config_video = this->config_video;
+        config.width_canvas = this->width_canvas;
+        config.height_canvas = this->height_canvas;
+    }
 
     BEGIN_MSG_MAP(gui_configdlg_video)
         MESSAGE_HANDLER(WM_INITDIALOG, OnInitDialog)
@@ -125,8 +133,10 @@ private:
     CEdit wnd_output_folder, wnd_output_file_name;
     CEdit wnd_output_ingest_server, wnd_output_stream_key;
     CButton wnd_overwrite_old_file, wnd_showkey;
+    CButton wnd_record_while_streaming;
     CStatic wnd_static_splitter;
     LRESULT password_char;
+    BOOL record_while_streaming;
 public:
     enum { IDD = IDD_OUTPUT_CONFIG };
 
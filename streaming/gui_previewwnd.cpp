@@ -470,10 +470,7 @@ out:
     canvas_to_preview = canvas_to_preview * Matrix3x2F::Translation(
         preview_rect.left, preview_rect.top);
 
-    CComPtr<ID2D1Bitmap1> bitmap;
-    media_buffer_texture_t last_buffer = preview_window->get_last_buffer();
-    if(last_buffer)
-        bitmap = last_buffer->bitmap;
+    const CComPtr<ID2D1Bitmap1> bitmap = preview_window->get_last_bitmap();
 
     preview_window->d2d1devctx->BeginDraw();
     preview_window->d2d1devctx->Clear(ColorF(ColorF::DimGray));
@@ -599,7 +596,7 @@ out:
 
     // dxgi functions need to be synchronized with the context mutex
     {
-        scoped_lock lock(*this->ctrl_pipeline.context_mutex);
+        std::lock_guard<context_mutex_t::element_type> lock(*this->ctrl_pipeline.context_mutex);
         CHECK_HR(hr = preview_window->swapchain->Present(0, 0));
     }
 
@@ -642,7 +639,8 @@ void gui_previewwnd::update_size()
         return;
 
     std::lock(*this->ctrl_pipeline.context_mutex, preview_window->d2d1_context_mutex);
-    scoped_lock lock(*this->ctrl_pipeline.context_mutex, std::adopt_lock);
+    std::lock_guard<context_mutex_t::element_type> lock(
+        *this->ctrl_pipeline.context_mutex, std::adopt_lock);
     scoped_lock lock2(preview_window->d2d1_context_mutex, std::adopt_lock);
 
     RECT r;
@@ -0,0 +1,155 @@
+#include "jitter_buffer.h"
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
+
+jitter_buffer::params_t::params_t() :
+    initial_latency(5000000),
+    min_latency(200000), max_latency(10000000),
+    percentile(0.99),
+    margin(200000),
+    window_duration(100000000),
+    growth_rate(0.5), shrink_rate(0.05)
+{
+}
+
+jitter_buffer::source_statistics::source_statistics(size_t bucket_count) :
+    current(bucket_count), previous(bucket_count),
+    current_count(0), previous_count(0),
+    current_start(0)
+{
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+jitter_buffer::jitter_buffer(const params_t& params) :
+    params(params),
+    // the lateness above the maximum latency is counted in the last bucket
+    bucket_count((size_t)(params.max_latency / bucket_duration) + 1),
+    latency(std::min(std::max(params.initial_latency, params.min_latency), params.max_latency)),
+    target_latency(latency),
+    last_time(0), last_update_time(0),
+    time_set(false)
+{
+}
+
+jitter_buffer::source_statistics_t jitter_buffer::register_source()
+{
+    source_statistics_t statistics(new source_statistics(this->bucket_count));
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->sources.push_back(statistics);
+    return statistics;
+}
+
+void jitter_buffer::add_lateness(source_statistics& statistics, int64_t request_time, int64_t lateness)
+{
+    const size_t bucket = std::min((size_t)(std::max(lateness, (int64_t)0) / bucket_duration),
+        this->bucket_count - 1);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // the older half is discarded when the newer half of the window is full
+    if(request_time - statistics.current_start >= this->params.window_duration / 2 ||
+        request_time < statistics.current_start)
+    {
+        statistics.previous.swap(statistics.current);
+        std::fill(statistics.current.begin(), statistics.current.end(), 0);
+        statistics.previous_count = statistics.current_count;
+        statistics.current_count = 0;
+        statistics.current_start = request_time;
+    }
+
+    statistics.current[bucket]++;
+    statistics.current_count++;
+}
+
+bool jitter_buffer::get_percentile(const source_statistics& statistics, int64_t& lateness) const
+{
+    const uint64_t count = statistics.current_count + statistics.previous_count;
+    if(count < min_sample_count)
+        return false;
+
+    const uint64_t rank = (uint64_t)std::ceil(this->params.percentile * count);
+    uint64_t sum = 0;
+    for(size_t i = 0; i < this->bucket_count; i++)
+    {
+        sum += statistics.current[i] + statistics.previous[i];
+        if(sum >= rank)
+        {
+            // the upper bound of the bucket
+            lateness = (int64_t)(i + 1) * bucket_duration;
+            return true;
+        }
+    }
+
+    lateness = (int64_t)this->bucket_count * bucket_duration;
+    return true;
+}
+
+void jitter_buffer::update_target_latency()
+{
+    bool measured = false;
+    int64_t max_lateness = 0;
+
+    for(auto it = this->sources.begin(); it != this->sources.end();)
+    {
+        source_statistics_t statistics = it->lock();
+        if(!statistics)
+        {
+            it = this->sources.erase(it);
+            continue;
+        }
+
+        int64_t lateness;
+        if(this->get_percentile(*statistics, lateness))
+        {
+            measured = true;
+            max_lateness = std::max(max_lateness, lateness);
+        }
+        it++;
+    }
+
+    // the target is held until some source has been measured
+    if(measured)
+        this->target_latency = std::min(std::max(max_lateness + this->params.margin,
+            this->params.min_latency), this->params.max_latency);
+}
+
+int64_t jitter_buffer::get_latency(int64_t now)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if(!this->time_set)
+    {
+        this->time_set = true;
+        this->last_time = this->last_update_time = now;
+        return this->latency;
+    }
+    if(now <= this->last_time)
+        return this->latency;
+
+    if(now - this->last_update_time >= update_interval)
+    {
+        this->last_update_time = now;
+        this->update_target_latency();
+    }
+
+    // the latency moves towards the target at a limited rate
+    const int64_t elapsed = now - this->last_time;
+    this->last_time = now;
+    if(this->target_latency > this->latency)
+        this->latency = std::min(this->target_latency,
+            this->latency + (int64_t)(elapsed * this->params.growth_rate));
+    else
+        this->latency = std::max(this->target_latency,
+            this->latency - (int64_t)(elapsed * this->params.shrink_rate));
+
+    return this->latency;
+}
\ No newline at end of file
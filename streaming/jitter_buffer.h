@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// adapts the latency of the buffering sources to the measured lateness of the sources;
+// the lateness of a source is how far behind the request time the end of its samples is;
+// the target latency is the largest configured percentile of the lateness of a source plus
+// a margin, so that the buffering latency covers the jitter of the worst source;
+// the latency grows quickly on bursts and shrinks slowly when the sources are steady;
+// the growth is kept slower than the clock so that the served end never moves backwards;
+// a single instance is shared between the audio and video buffering sources, so that
+// both are buffered by the same latency and stay in sync;
+// the times are in time units(100 nanoseconds)
+
+class jitter_buffer final
+{
+public:
+    struct params_t
+    {
+        // the latency that is used until the sources have been measured
+        int64_t initial_latency;
+        int64_t min_latency, max_latency;
+        // the percentile of the lateness that the latency covers, in range [0, 1]
+        double percentile;
+        int64_t margin;
+        // the lateness is measured over a window of this duration
+        int64_t window_duration;
+        // the change of the latency per clock time
+        double growth_rate, shrink_rate;
+
+        params_t();
+    };
+
+    // the lateness histogram of a single source
+    class source_statistics
+    {
+        friend class jitter_buffer;
+    private:
+        // the window is split in two halves; the older half is discarded when the newer
+        // one is full
+        std::vector<uint32_t> current, previous;
+        uint64_t current_count, previous_count;
+        int64_t current_start;
+    public:
+        explicit source_statistics(size_t bucket_count);
+    };
+    typedef std::shared_ptr<source_statistics> source_statistics_t;
+
+    // the lateness is bucketed with a resolution of 1 ms
+    static constexpr int64_t bucket_duration = 10000;
+    // a source is ignored until it has been measured this many times in the window
+    static constexpr uint64_t min_sample_count = 30;
+    // the target latency is recalculated every 100 ms
+    static constexpr int64_t update_interval = 1000000;
+private:
+    const params_t params;
+    const size_t bucket_count;
+
+    std::mutex mutex;
+    std::vector<std::weak_ptr<source_statistics>> sources;
+    int64_t latency, target_latency;
+    int64_t last_time, last_update_time;
+    bool time_set;
+
+    // returns false if the source doesn't have enough samples
+    bool get_percentile(const source_statistics&, int64_t& lateness) const;
+    void update_target_latency();
+public:
+    explicit jitter_buffer(const params_t& = params_t());
+
+    // the returned statistics are measured as long as the source keeps the reference
+    source_statistics_t register_source();
+    // multithread safe
+    void add_lateness(source_statistics&, int64_t request_time, int64_t lateness);
+    // returns the latency at the time; a time earlier than the previous one
+    // doesn't change the latency;
+    // multithread safe
+    int64_t get_latency(int64_t now);
+};
+
+typedef std::shared_ptr<jitter_buffer> jitter_buffer_t;
\ No newline at end of file
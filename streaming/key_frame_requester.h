@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+
+// channel from the outputs back to the video encoder;
+// an output that needs to start cleanly(a reconnected destination, a destination that has
+// dropped frames) requests a key frame instead of waiting for the next gop
+
+class key_frame_requester
+{
+public:
+    virtual ~key_frame_requester() = default;
+
+    // the key frame is forced on the next input frame of the encoder;
+    // concurrent requests are coalesced and rate limited by the encoder;
+    // multithread safe
+    virtual void request_key_frame() = 0;
+};
+
+// the outputs don't keep the encoder alive
+using key_frame_requester_t = std::weak_ptr<key_frame_requester>;
\ No newline at end of file
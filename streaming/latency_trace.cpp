@@ -0,0 +1,233 @@
+#include "latency_trace.h"
+#include <initguid.h>
+#include <mfapi.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+#undef min
+#undef max
+
+DEFINE_GUID(latency_trace_guid,
+    0x5b7e3d61, 0x2c8a, 0x4f0e, 0x9a, 0x41, 0x6d, 0x13, 0xe8, 0x27, 0xb0, 0x5c);
+
+std::atomic_bool latency_tracer::enabled = {false};
+
+latency_trace::latency_trace(int track, int packet_number) :
+    track(track), packet_number(packet_number)
+{
+    for(auto&& item : this->stamps)
+        item = 0;
+    this->stamp(STAGE_REQUEST);
+}
+
+void latency_trace::release_this()
+{
+    latency_tracer::get().submit(*this);
+    delete this;
+}
+
+void latency_trace::stamp(stage_t stage)
+{
+    using namespace std::chrono;
+    const int64_t now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    int64_t expected = 0;
+    this->stamps[stage].compare_exchange_strong(expected, now, std::memory_order_relaxed);
+}
+
+HRESULT latency_trace::QueryInterface(REFIID riid, void** ppv)
+{
+    if(!ppv)
+        return E_POINTER;
+    if(riid == __uuidof(IUnknown))
+        *ppv = static_cast<IUnknown*>(this);
+    else
+    {
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    this->AddRef();
+    return S_OK;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+latency_tracer& latency_tracer::get()
+{
+    static latency_tracer tracer;
+    return tracer;
+}
+
+void latency_tracer::set_enabled(bool enable)
+{
+    enabled = enable;
+}
+
+const char* latency_tracer::get_stage_name(latency_trace::stage_t stage)
+{
+    switch(stage)
+    {
+    case latency_trace::STAGE_REQUEST:
+        return "request";
+    case latency_trace::STAGE_MIX:
+        return "mix";
+    case latency_trace::STAGE_ENCODE:
+        return "encode";
+    case latency_trace::STAGE_OUTPUT:
+        return "output";
+    case latency_trace::STAGE_SEND:
+        return "send";
+    default:
+        return "total";
+    }
+}
+
+void latency_tracer::stamp_attached(IMFSample* sample, latency_trace::stage_t stage)
+{
+    CComPtr<IUnknown> obj;
+    if(sample && SUCCEEDED(sample->GetUnknown(latency_trace_guid, __uuidof(IUnknown), (LPVOID*)&obj)))
+        static_cast<latency_trace*>(obj.p)->stamp(stage);
+}
+
+void latency_tracer::attach_trace(IMFSample* sample, latency_trace* trace)
+{
+    if(sample)
+        sample->SetUnknown(latency_trace_guid, static_cast<IUnknown*>(trace));
+}
+
+void latency_tracer::submit(const latency_trace& trace)
+{
+    completed_trace_t completed;
+    completed.track = trace.track;
+    completed.packet_number = trace.packet_number;
+    for(int i = 0; i < latency_trace::STAGE_COUNT; i++)
+        completed.stamps[i] = trace.stamps[i].load(std::memory_order_relaxed);
+
+    auto add = [](histogram_t& histogram, int64_t ns)
+    {
+        const uint64_t us = (uint64_t)std::max(ns, (int64_t)0) / 1000;
+        int bucket = 0;
+        while(bucket < bucket_count - 1 && (us >> bucket) > 1)
+            bucket++;
+
+        histogram.count++;
+        histogram.sum_us += us;
+        histogram.max_us = std::max(histogram.max_us, us);
+        histogram.buckets[bucket]++;
+    };
+
+    scoped_lock lock(this->mutex);
+
+    // the intervals are measured between the successive stamped stages
+    auto it = this->histograms.find(completed.track);
+    if(it == this->histograms.end())
+    {
+        track_histograms_t histograms;
+        std::memset(&histograms, 0, sizeof(histograms));
+        it = this->histograms.insert(std::make_pair(completed.track, histograms)).first;
+    }
+
+    int prev = -1;
+    for(int i = 0; i < latency_trace::STAGE_COUNT; i++)
+    {
+        if(!completed.stamps[i])
+            continue;
+        if(prev >= 0)
+            add(it->second[prev], completed.stamps[i] - completed.stamps[prev]);
+        prev = i;
+    }
+    if(prev > 0)
+        add(it->second[latency_trace::STAGE_COUNT],
+            completed.stamps[prev] - completed.stamps[latency_trace::STAGE_REQUEST]);
+
+    this->completed_traces.push_back(completed);
+    if(this->completed_traces.size() > max_completed_traces)
+        this->completed_traces.pop_front();
+}
+
+void latency_tracer::reset()
+{
+    scoped_lock lock(this->mutex);
+    this->histograms.clear();
+    this->completed_traces.clear();
+}
+
+void latency_tracer::print_histograms(std::ostream& out)
+{
+    scoped_lock lock(this->mutex);
+
+    for(const auto& track : this->histograms)
+    {
+        out << "latency trace, track " << track.first << ":" << std::endl;
+        for(int i = 0; i <= latency_trace::STAGE_COUNT; i++)
+        {
+            const histogram_t& histogram = track.second[i];
+            if(!histogram.count)
+                continue;
+
+            out << "  " << get_stage_name((latency_trace::stage_t)i)
+                << ": count " << histogram.count
+                << ", avg " << (histogram.sum_us / histogram.count) << "us"
+                << ", max " << histogram.max_us << "us" << std::endl;
+
+            // buckets are printed as upper bounds
+            out << "   ";
+            for(int j = 0; j < bucket_count; j++)
+                if(histogram.buckets[j])
+                    out << " <" << (2ull << j) << "us:" << histogram.buckets[j];
+            out << std::endl;
+        }
+    }
+}
+
+bool latency_tracer::write_chrome_trace(const std::wstring& path)
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if(!out)
+        return false;
+
+    scoped_lock lock(this->mutex);
+
+    // each stage is an async slice that lasts until the next stamped stage;
+    // the slices of a request share the same id
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    for(const auto& trace : this->completed_traces)
+    {
+        const uint64_t id = ((uint64_t)(uint32_t)trace.track << 32) | (uint32_t)trace.packet_number;
+
+        int prev = -1;
+        for(int i = 0; i < latency_trace::STAGE_COUNT; i++)
+        {
+            if(!trace.stamps[i])
+                continue;
+            if(prev >= 0)
+            {
+                const char* name = get_stage_name((latency_trace::stage_t)prev);
+                for(int j = 0; j < 2; j++)
+                {
+                    out << (first ? "" : ",") << std::endl
+                        << "{\"name\":\"" << name << "\",\"cat\":\"latency\""
+                        << ",\"ph\":\"" << (j == 0 ? "b" : "e") << "\""
+                        << ",\"id\":" << id
+                        << ",\"pid\":1,\"tid\":" << trace.track
+                        << ",\"ts\":" << (double)trace.stamps[j == 0 ? prev : i] / 1000.0
+                        << ",\"args\":{\"packet\":" << trace.packet_number << "}}";
+                    first = false;
+                }
+            }
+            prev = i;
+        }
+    }
+    out << std::endl << "]}" << std::endl;
+
+    return (bool)out;
+}
\ No newline at end of file
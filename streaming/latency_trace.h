@@ -0,0 +1,134 @@
+#pragma once
+
+#include "IUnknownImpl.h"
+#include <atlbase.h>
+#include <mfidl.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <string>
+#include <ostream>
+
+// optional per request trace that the components stamp with monotonic timestamps;
+// a trace is created for each request packet while tracing is enabled, and it is
+// submitted to the latency tracer when the last reference to it is released;
+// the trace is also attached to the encoded samples so that the outputs can stamp it;
+// a disabled tracer doesn't create traces, which reduces the stamping to a null check
+
+// attribute for the trace in the imfsample
+EXTERN_C const GUID latency_trace_guid;
+
+class latency_trace final : public IUnknown, IUnknownImpl
+{
+    friend class latency_tracer;
+public:
+    enum stage_t
+    {
+        // the sink begins the request
+        STAGE_REQUEST,
+        // the mixer processes the request
+        STAGE_MIX,
+        // the encoder serves the request
+        STAGE_ENCODE,
+        // the encoded samples are given to the output
+        STAGE_OUTPUT,
+        // the output has sent the sample
+        STAGE_SEND,
+        STAGE_COUNT
+    };
+private:
+    const int track;
+    const int packet_number;
+    // nanoseconds of the steady clock; 0 if the stage hasn't been stamped
+    std::atomic<int64_t> stamps[STAGE_COUNT];
+
+    void release_this() override;
+public:
+    latency_trace(int track, int packet_number);
+
+    // only the first stamp of a stage is stored
+    void stamp(stage_t);
+
+    ULONG STDMETHODCALLTYPE AddRef() {return IUnknownImpl::AddRef();}
+    ULONG STDMETHODCALLTYPE Release() {return IUnknownImpl::Release();}
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv);
+};
+
+typedef CComPtr<latency_trace> latency_trace_t;
+
+class latency_tracer final
+{
+public:
+    typedef std::lock_guard<std::mutex> scoped_lock;
+
+    // log2 buckets in microseconds
+    static constexpr int bucket_count = 32;
+    // the amount of completed traces that are kept for the chrome trace
+    static constexpr size_t max_completed_traces = 1 << 16;
+private:
+    struct completed_trace_t
+    {
+        int track, packet_number;
+        int64_t stamps[latency_trace::STAGE_COUNT];
+    };
+    struct histogram_t
+    {
+        uint64_t count, sum_us, max_us;
+        uint64_t buckets[bucket_count];
+    };
+    // the histograms of a track are indexed by the stage where the measured interval begins;
+    // the last one measures the whole request
+    typedef std::array<histogram_t, latency_trace::STAGE_COUNT + 1> track_histograms_t;
+
+    static std::atomic_bool enabled;
+
+    std::mutex mutex;
+    std::map<int, track_histograms_t> histograms;
+    std::deque<completed_trace_t> completed_traces;
+
+    latency_tracer() = default;
+
+    void submit(const latency_trace&);
+    static void stamp_attached(IMFSample*, latency_trace::stage_t);
+    static void attach_trace(IMFSample*, latency_trace*);
+public:
+    static latency_tracer& get();
+    static bool is_enabled() {return enabled.load(std::memory_order_relaxed);}
+    static void set_enabled(bool);
+    static const char* get_stage_name(latency_trace::stage_t);
+
+    // returns null if tracing is disabled
+    static latency_trace_t create_trace(int track, int packet_number)
+    {
+        if(!is_enabled())
+            return NULL;
+        latency_trace_t trace;
+        trace.Attach(new latency_trace(track, packet_number));
+        return trace;
+    }
+    static void stamp(const latency_trace_t& trace, latency_trace::stage_t stage)
+    {
+        if(trace)
+            trace->stamp(stage);
+    }
+    // stamps the trace that is attached to the sample
+    static void stamp_sample(IMFSample* sample, latency_trace::stage_t stage)
+    {
+        if(is_enabled())
+            stamp_attached(sample, stage);
+    }
+    // attaches the trace to the sample
+    static void attach(IMFSample* sample, const latency_trace_t& trace)
+    {
+        if(trace)
+            attach_trace(sample, trace);
+    }
+
+    void reset();
+    void print_histograms(std::ostream&);
+    // writes the completed traces in the chrome trace event format
+    bool write_chrome_trace(const std::wstring& path);
+};
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "lock_profiler.h"
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+
+#undef min
+#undef max
+
+namespace
+{
+
+struct registry_t
+{
+    std::mutex mutex;
+    // deque keeps the references to the elements valid
+    std::deque<lock_statistics> statistics;
+};
+
+registry_t& get_registry()
+{
+    static registry_t registry;
+    return registry;
+}
+
+}
+
+lock_statistics::lock_statistics(const char* name) :
+    name(name),
+    acquisitions(0), contentions(0),
+    wait_ns(0), max_wait_ns(0),
+    hold_ns(0), max_hold_ns(0)
+{
+}
+
+void lock_statistics::update_max(std::atomic_uint64_t& max, uint64_t val)
+{
+    uint64_t old_max = max.load(std::memory_order_relaxed);
+    while(old_max < val && !max.compare_exchange_weak(old_max, val, std::memory_order_relaxed));
+}
+
+void lock_statistics::record_acquisition(bool contended, uint64_t wait_ns)
+{
+    this->acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if(!contended)
+        return;
+
+    this->contentions.fetch_add(1, std::memory_order_relaxed);
+    this->wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+    update_max(this->max_wait_ns, wait_ns);
+}
+
+void lock_statistics::record_hold(uint64_t hold_ns)
+{
+    this->hold_ns.fetch_add(hold_ns, std::memory_order_relaxed);
+    update_max(this->max_hold_ns, hold_ns);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+lock_statistics& lock_profiler::get_statistics(const char* name)
+{
+    registry_t& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for(auto&& item : registry.statistics)
+        if(std::strcmp(item.name, name) == 0)
+            return item;
+
+    registry.statistics.emplace_back(name);
+    return registry.statistics.back();
+}
+
+uint64_t lock_profiler::now()
+{
+    using namespace std::chrono;
+    return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void lock_profiler::print_report(std::ostream& out)
+{
+    struct row_t
+    {
+        const char* name;
+        uint64_t acquisitions, contentions, wait_ns, max_wait_ns, hold_ns, max_hold_ns;
+    };
+
+    std::vector<row_t> rows;
+    {
+        registry_t& registry = get_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for(const auto& item : registry.statistics)
+            rows.push_back({item.name,
+                item.acquisitions.load(), item.contentions.load(),
+                item.wait_ns.load(), item.max_wait_ns.load(),
+                item.hold_ns.load(), item.max_hold_ns.load()});
+    }
+
+    std::sort(rows.begin(), rows.end(),
+        [](const row_t& a, const row_t& b) { return a.wait_ns > b.wait_ns; });
+
+    out << "lock contention report (ranked by total wait time):" << std::endl;
+    for(const auto& row : rows)
+    {
+        const double contention_pct = row.acquisitions ?
+            100.0 * row.contentions / row.acquisitions : 0.0;
+        out << "  " << row.name
+            << ": acquisitions " << row.acquisitions
+            << ", contended " << row.contentions
+            << " (" << std::fixed << std::setprecision(1) << contention_pct << "%)"
+            << ", wait " << row.wait_ns / 1000 << "us (max " << row.max_wait_ns / 1000 << "us)"
+            << ", hold " << row.hold_ns / 1000 << "us (max " << row.max_hold_ns / 1000 << "us)"
+            << std::endl;
+    }
+}
+
+void lock_profiler::reset()
+{
+    registry_t& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for(auto&& item : registry.statistics)
+    {
+        item.acquisitions = 0;
+        item.contentions = 0;
+        item.wait_ns = 0;
+        item.max_wait_ns = 0;
+        item.hold_ns = 0;
+        item.max_hold_ns = 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+
+// contention profiler for the pipeline mutexes;
+// the instrumentation is compiled in only if STREAMING_LOCK_PROFILING is defined
+// in the project settings;
+// otherwise profiled_mutex is the plain mutex type and the names are discarded;
+// mutexes with the same name share the statistics;
+// a condition variable waits on a profiled_unique_lock of a profiled_mutex<std::mutex>,
+// which is std::condition_variable on a std::mutex lock without the profiling
+
+class lock_statistics final
+{
+    friend class lock_profiler;
+private:
+    const char* name;
+    std::atomic_uint64_t acquisitions, contentions;
+    std::atomic_uint64_t wait_ns, max_wait_ns;
+    std::atomic_uint64_t hold_ns, max_hold_ns;
+
+    static void update_max(std::atomic_uint64_t& max, uint64_t val);
+public:
+    explicit lock_statistics(const char* name);
+
+    void record_acquisition(bool contended, uint64_t wait_ns);
+    void record_hold(uint64_t hold_ns);
+};
+
+class lock_profiler final
+{
+public:
+    // the returned statistics stay valid for the lifetime of the process
+    static lock_statistics& get_statistics(const char* name);
+    static uint64_t now();
+
+    // prints the locks ranked by the total wait time
+    static void print_report(std::ostream&);
+    static void reset();
+};
+
+#ifdef STREAMING_LOCK_PROFILING
+
+// lockable wrapper that records the wait and hold times of the mutex;
+// the hold time of a recursive mutex is measured from the outermost lock
+template<class Mutex>
+class profiled_mutex final
+{
+private:
+    Mutex mutex;
+    lock_statistics& statistics;
+    // accessed by the owning thread only
+    uint64_t hold_start;
+    int recursion;
+
+    void on_locked(bool contended, uint64_t wait_ns)
+    {
+        if(this->recursion++ == 0)
+            this->hold_start = lock_profiler::now();
+        this->statistics.record_acquisition(contended, wait_ns);
+    }
+public:
+    explicit profiled_mutex(const char* name) :
+        statistics(lock_profiler::get_statistics(name)), hold_start(0), recursion(0) {}
+    profiled_mutex(const profiled_mutex&) = delete;
+    profiled_mutex& operator=(const profiled_mutex&) = delete;
+
+    void lock()
+    {
+        if(this->mutex.try_lock())
+        {
+            this->on_locked(false, 0);
+            return;
+        }
+
+        const uint64_t wait_start = lock_profiler::now();
+        this->mutex.lock();
+        this->on_locked(true, lock_profiler::now() - wait_start);
+    }
+    bool try_lock()
+    {
+        if(!this->mutex.try_lock())
+            return false;
+        this->on_locked(false, 0);
+        return true;
+    }
+    void unlock()
+    {
+        if(--this->recursion == 0)
+            this->statistics.record_hold(lock_profiler::now() - this->hold_start);
+        this->mutex.unlock();
+    }
+};
+
+template<class Mutex>
+using profiled_unique_lock = std::unique_lock<profiled_mutex<Mutex>>;
+typedef std::condition_variable_any profiled_condition_variable;
+
+#else
+
+template<class Mutex>
+class profiled_mutex final : public Mutex
+{
+public:
+    explicit profiled_mutex(const char* /*name*/) {}
+};
+
+// the lock refers to the plain mutex so that std::condition_variable can wait on it
+template<class Mutex>
+using profiled_unique_lock = std::unique_lock<Mutex>;
+typedef std::condition_variable profiled_condition_variable;
+
+#endif
\ No newline at end of file
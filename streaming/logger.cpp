@@ -0,0 +1,270 @@
+#include "logger.h"
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+
+#undef min
+#undef max
+
+#ifdef _DEBUG
+std::atomic_int logger::min_level = {logger::LEVEL_DEBUG};
+#else
+std::atomic_int logger::min_level = {logger::LEVEL_INFO};
+#endif
+
+logger::ring_buffer::ring_buffer(int thread_index) :
+    head(0), tail(0),
+    thread_index(thread_index),
+    orphaned(false),
+    dropped(0),
+    reported_dropped(0)
+{
+}
+
+logger::record_t* logger::ring_buffer::begin_write()
+{
+    const size_t head = this->head.load(std::memory_order_relaxed);
+    if(head - this->tail.load(std::memory_order_acquire) >= capacity)
+    {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    return &this->records[head % capacity];
+}
+
+void logger::ring_buffer::end_write()
+{
+    this->head.store(this->head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void logger::ring_buffer::read(std::vector<record_t>& out)
+{
+    const size_t tail = this->tail.load(std::memory_order_relaxed);
+    const size_t head = this->head.load(std::memory_order_acquire);
+    for(size_t i = tail; i != head; i++)
+        out.push_back(this->records[i % capacity]);
+    this->tail.store(head, std::memory_order_release);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+logger::logger() :
+    next_thread_index(0),
+    stopping(false),
+    start_time(now())
+{
+    this->flush_thread = std::thread(&logger::flush_thread_proc, this);
+}
+
+logger::~logger()
+{
+    this->stop();
+}
+
+logger& logger::get()
+{
+    static logger log;
+    return log;
+}
+
+int64_t logger::now()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void logger::set_level(level_t level)
+{
+    min_level = level;
+}
+
+const char* logger::get_level_name(level_t level)
+{
+    switch(level)
+    {
+    case LEVEL_DEBUG:
+        return "debug";
+    case LEVEL_INFO:
+        return "info";
+    case LEVEL_WARNING:
+        return "warning";
+    default:
+        return "error";
+    }
+}
+
+logger::ring_buffer& logger::get_ring_buffer()
+{
+    // the ring buffer is shared with the logger so that the records of an exited thread
+    // can still be printed
+    struct thread_ring_buffer_t
+    {
+        ring_buffer_t ring;
+        ~thread_ring_buffer_t() {if(this->ring) this->ring->orphaned = true;}
+    };
+    thread_local thread_ring_buffer_t thread_ring;
+
+    if(!thread_ring.ring)
+    {
+        std::lock_guard<std::mutex> lock(this->rings_mutex);
+        thread_ring.ring.reset(new ring_buffer(this->next_thread_index++));
+        this->rings.push_back(thread_ring.ring);
+    }
+
+    return *thread_ring.ring;
+}
+
+logger::record_t* logger::begin_record(log_site& site)
+{
+    const int64_t timestamp = now();
+
+    // the first thread that observes an expired window starts a new one
+    int suppressed = 0;
+    int64_t window_start = site.window_start.load(std::memory_order_relaxed);
+    if(timestamp - window_start >= rate_limit_window_ns &&
+        site.window_start.compare_exchange_strong(window_start, timestamp, std::memory_order_relaxed))
+    {
+        suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if(site.count.fetch_add(1, std::memory_order_relaxed) >= rate_limit_count)
+    {
+        site.suppressed.fetch_add(1 + suppressed, std::memory_order_relaxed);
+        return NULL;
+    }
+
+    ring_buffer& ring = this->get_ring_buffer();
+    record_t* record = ring.begin_write();
+    if(!record)
+        return NULL;
+
+    record->timestamp = timestamp;
+    record->site = &site;
+    record->thread_index = ring.thread_index;
+    record->suppressed = suppressed;
+    record->arg_count = 0;
+    record->text[0] = 0;
+    return record;
+}
+
+void logger::log_text(log_site& site, const char* text)
+{
+    record_t* record = this->begin_record(site);
+    if(!record)
+        return;
+
+    strncpy_s(record->text, text, _TRUNCATE);
+    this->get_ring_buffer().end_write();
+}
+
+void logger::flush_thread_proc()
+{
+    std::unique_lock<std::mutex> lock(this->flush_mutex);
+    while(!this->stopping)
+    {
+        this->flush_cv.wait_for(lock, std::chrono::milliseconds(flush_interval_ms));
+        this->flush(std::cout);
+    }
+}
+
+void logger::flush(std::ostream& out)
+{
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(this->rings_mutex);
+        for(auto it = this->rings.begin(); it != this->rings.end();)
+        {
+            // the orphaned flag is read before the records so that no record is lost
+            const bool orphaned = (*it)->orphaned;
+            (*it)->read(this->pending);
+
+            const uint64_t ring_dropped = (*it)->dropped.load(std::memory_order_relaxed);
+            dropped += ring_dropped - (*it)->reported_dropped;
+            (*it)->reported_dropped = ring_dropped;
+
+            if(orphaned)
+                it = this->rings.erase(it);
+            else
+                it++;
+        }
+    }
+
+    if(this->pending.empty() && !dropped)
+        return;
+
+    std::stable_sort(this->pending.begin(), this->pending.end(),
+        [](const record_t& a, const record_t& b) {return a.timestamp < b.timestamp;});
+    for(const auto& record : this->pending)
+        this->print_record(out, record);
+    if(dropped)
+        out << "logger: " << dropped << " records dropped because of a full buffer\n";
+
+    out.flush();
+    this->pending.clear();
+}
+
+void logger::print_record(std::ostream& out, const record_t& record) const
+{
+    const int64_t time_us = (record.timestamp - this->start_time) / 1000;
+    out << "[" << time_us / 1000000 << "." << std::setfill('0') << std::setw(6)
+        << time_us % 1000000 << std::setfill(' ') << "] "
+        << "thread " << record.thread_index << ", "
+        << get_level_name(record.site->level) << ": ";
+
+    int arg = 0;
+    for(const char* c = record.site->message; *c; c++)
+    {
+        if(c[0] != '{' || c[1] != '}' || arg >= record.arg_count)
+        {
+            out << *c;
+            continue;
+        }
+
+        const log_arg& val = record.args[arg++];
+        switch(val.type)
+        {
+        case log_arg::TYPE_INT:
+            out << val.i;
+            break;
+        case log_arg::TYPE_UINT:
+            out << val.u;
+            break;
+        case log_arg::TYPE_HEX:
+            out << "0x" << std::hex << val.u << std::dec;
+            break;
+        case log_arg::TYPE_DOUBLE:
+            out << val.d;
+            break;
+        case log_arg::TYPE_STRING:
+            out << val.str;
+            break;
+        }
+        c++;
+    }
+
+    if(record.text[0])
+        out << record.text;
+    if(record.suppressed)
+        out << " (" << record.suppressed << " similar messages suppressed)";
+    out << '\n';
+}
+
+void logger::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->flush_mutex);
+        if(this->stopping)
+            return;
+        this->stopping = true;
+    }
+
+    this->flush_cv.notify_one();
+    this->flush_thread.join();
+    this->flush(std::cout);
+}
\ No newline at end of file
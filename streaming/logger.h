@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <ostream>
+#include <type_traits>
+
+// structured logger for the pipeline;
+// each thread writes binary records to its own lock free ring buffer and
+// a background thread formats and prints the records periodically;
+// records are dropped instead of blocking if the ring buffer of a thread is full;
+// the messages are rate limited per call site;
+// the message and the string arguments must be string literals because
+// the formatting is deferred; {} in the message is replaced with the next argument
+
+#define LOG_(level_, message_, ...) do { \
+    static log_site log_site_(level_, message_); \
+    if(logger::is_enabled(level_)) \
+        logger::get().log(log_site_, ##__VA_ARGS__); \
+} while(0)
+#define LOG_DEBUG(message_, ...) LOG_(logger::LEVEL_DEBUG, message_, ##__VA_ARGS__)
+#define LOG_INFO(message_, ...) LOG_(logger::LEVEL_INFO, message_, ##__VA_ARGS__)
+#define LOG_WARNING(message_, ...) LOG_(logger::LEVEL_WARNING, message_, ##__VA_ARGS__)
+#define LOG_ERROR(message_, ...) LOG_(logger::LEVEL_ERROR, message_, ##__VA_ARGS__)
+// the text is copied and printed after the message
+#define LOG_TEXT(level_, message_, text_) do { \
+    static log_site log_site_(level_, message_); \
+    if(logger::is_enabled(level_)) \
+        logger::get().log_text(log_site_, text_); \
+} while(0)
+
+struct log_site;
+
+// wrapper for integers that are printed in hexadecimal
+struct log_hex
+{
+    uint64_t value;
+    template<typename T>
+    explicit log_hex(T value) : value((uint64_t)(std::make_unsigned_t<T>)value) {}
+};
+
+struct log_arg
+{
+    enum type_t {TYPE_INT, TYPE_UINT, TYPE_HEX, TYPE_DOUBLE, TYPE_STRING};
+    type_t type;
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const char* str;
+    };
+
+    log_arg() : type(TYPE_INT), i(0) {}
+    template<typename T, typename std::enable_if_t<
+        std::is_integral_v<T> && std::is_signed_v<T>, int> = 0>
+    log_arg(T val) : type(TYPE_INT), i((int64_t)val) {}
+    template<typename T, typename std::enable_if_t<
+        std::is_integral_v<T> && !std::is_signed_v<T>, int> = 0>
+    log_arg(T val) : type(TYPE_UINT), u((uint64_t)val) {}
+    log_arg(log_hex val) : type(TYPE_HEX), u(val.value) {}
+    log_arg(double val) : type(TYPE_DOUBLE), d(val) {}
+    // the string must outlive the logger
+    log_arg(const char* val) : type(TYPE_STRING), str(val) {}
+};
+
+class logger final
+{
+public:
+    enum level_t {LEVEL_DEBUG, LEVEL_INFO, LEVEL_WARNING, LEVEL_ERROR};
+
+    static constexpr int max_args = 4;
+    // length of the text that is copied to the record by log_text
+    static constexpr int max_text_length = 120;
+    // the messages of a call site that exceed the limit within the window are suppressed
+    static constexpr int rate_limit_count = 10;
+    static constexpr int64_t rate_limit_window_ns = 1000000000;
+    // interval at which the background thread prints the records
+    static constexpr int flush_interval_ms = 100;
+
+    struct record_t
+    {
+        int64_t timestamp;
+        const log_site* site;
+        int thread_index;
+        // the amount of messages of the site that were suppressed before this one
+        int suppressed;
+        int arg_count;
+        log_arg args[max_args];
+        // copied text that is printed after the message; empty if not set
+        char text[max_text_length];
+    };
+
+    // single producer single consumer ring buffer
+    class ring_buffer
+    {
+    public:
+        static constexpr size_t capacity = 512;
+    private:
+        record_t records[capacity];
+        std::atomic<size_t> head, tail;
+    public:
+        const int thread_index;
+        // set when the thread has exited
+        std::atomic_bool orphaned;
+        std::atomic<uint64_t> dropped;
+        // accessed by the consumer only
+        uint64_t reported_dropped;
+
+        explicit ring_buffer(int thread_index);
+
+        // producer; returns NULL if the buffer is full
+        record_t* begin_write();
+        void end_write();
+        // consumer
+        void read(std::vector<record_t>&);
+    };
+    typedef std::shared_ptr<ring_buffer> ring_buffer_t;
+private:
+    static std::atomic_int min_level;
+
+    std::mutex rings_mutex;
+    std::vector<ring_buffer_t> rings;
+    int next_thread_index;
+
+    std::mutex flush_mutex;
+    std::condition_variable flush_cv;
+    bool stopping;
+    std::thread flush_thread;
+    const int64_t start_time;
+
+    std::vector<record_t> pending;
+
+    logger();
+
+    ring_buffer& get_ring_buffer();
+    // returns NULL if the message is suppressed or the ring buffer is full
+    record_t* begin_record(log_site&);
+    void flush_thread_proc();
+    void flush(std::ostream&);
+    void print_record(std::ostream&, const record_t&) const;
+public:
+    ~logger();
+
+    static logger& get();
+    static int64_t now();
+    static bool is_enabled(level_t level) {return level >= min_level.load(std::memory_order_relaxed);}
+    static void set_level(level_t);
+    static const char* get_level_name(level_t);
+
+    template<typename... Args>
+    void log(log_site& site, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= max_args, "too many log arguments");
+        record_t* record = this->begin_record(site);
+        if(!record)
+            return;
+
+        const log_arg args_[] = {log_arg(), log_arg(args)...};
+        record->arg_count = (int)sizeof...(Args);
+        for(int i = 0; i < record->arg_count; i++)
+            record->args[i] = args_[i + 1];
+        this->get_ring_buffer().end_write();
+    }
+    // copies the text to the record; used for the messages that are formatted
+    // by third party libraries
+    void log_text(log_site&, const char* text);
+
+    // prints the remaining records and stops the background thread;
+    // the records that are logged after stopping are discarded
+    void stop();
+};
+
+// per call site data; declared as a static in the log macros
+struct log_site
+{
+    const logger::level_t level;
+    const char* message;
+    // rate limiting
+    std::atomic<int64_t> window_start;
+    std::atomic_int count, suppressed;
+
+    constexpr log_site(logger::level_t level, const char* message) :
+        level(level), message(message), window_start(0), count(0), suppressed(0) {}
+    log_site(const log_site&) = delete;
+    log_site& operator=(const log_site&) = delete;
+};
\ No newline at end of file
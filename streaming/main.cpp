@@ -4,6 +4,14 @@
 #include <mfapi.h>
 #include <d3d11.h>
 #include "gui_mainwnd.h"
+#include "control_pipeline.h"
+#include "latency_trace.h"
+#include "lock_profiler.h"
+#include "logger.h"
+#include "metrics.h"
+#include "session_stress_test.h"
+#include "dirty_region_test.h"
+#include "staging_ring_test.h"
 #include <mutex>
 
 #pragma comment(lib, "Mfplat.lib")
@@ -84,10 +92,45 @@ int YourReportHook( int reportType, char *message, int *returnValue )
 
 int main()
 {
+    int exit_code = 0;
+
     try
     {
         HRESULT hr = S_OK;
         WSADATA wsa_data = {0};
+        // latency tracing is enabled if the path for the chrome trace file is set
+        WCHAR latency_trace_path[MAX_PATH] = {0};
+        if(GetEnvironmentVariableW(L"STREAMING_LATENCY_TRACE", latency_trace_path, MAX_PATH))
+            latency_tracer::set_enabled(true);
+        // the health metrics are written to the file every second if the path is set
+        WCHAR metrics_path[MAX_PATH] = {0};
+        if(GetEnvironmentVariableW(L"STREAMING_METRICS_FILE", metrics_path, MAX_PATH))
+            metrics::start_dump(metrics_path, 1000);
+        // synthetic sources are added to every scene if the counts are set;
+        // the format is <video source count>[,<audio source count>]
+        control_pipeline_load_params load_params;
+        WCHAR synthetic_sources[64] = {0};
+        if(GetEnvironmentVariableW(L"STREAMING_SYNTHETIC_SOURCES", synthetic_sources,
+            ARRAYSIZE(synthetic_sources)))
+            swscanf_s(synthetic_sources, L"%d,%d",
+                &load_params.synthetic_video_count, &load_params.synthetic_audio_count);
+        // the sources record the served samples to traces in the directory if the path is set;
+        // the recorded traces can be replayed next to the scene sources
+        WCHAR trace_path[MAX_PATH] = {0};
+        if(GetEnvironmentVariableW(L"STREAMING_SOURCE_TRACE_DIR", trace_path, MAX_PATH))
+            load_params.trace_directory = trace_path;
+        if(GetEnvironmentVariableW(L"STREAMING_REPLAY_VIDEO_TRACE", trace_path, MAX_PATH))
+            load_params.replay_video_trace = trace_path;
+        if(GetEnvironmentVariableW(L"STREAMING_REPLAY_AUDIO_TRACE", trace_path, MAX_PATH))
+            load_params.replay_audio_trace = trace_path;
+        control_pipeline::set_load_params(load_params);
+        // the media session stress test runs in place of the gui if the thread count is set
+        WCHAR stress_test_threads[16] = {0};
+        const bool stress_test = !!GetEnvironmentVariableW(L"STREAMING_SESSION_STRESS_TEST",
+            stress_test_threads, ARRAYSIZE(stress_test_threads));
+        // the checks of the components that don't depend on the pipeline run in place of
+        // the gui if the variable is set
+        const bool self_test = !!GetEnvironmentVariableW(L"STREAMING_SELF_TEST", NULL, 0);
 
         // apartment threading is needed for com gui features;
         // even though most of the com objects are initialized in this apartment, com does
@@ -120,6 +163,19 @@ int main()
         _CrtSetReportHook(YourReportHook);
 #endif
 
+        if(self_test)
+        {
+            if(!run_dirty_region_test())
+                exit_code = 1;
+            if(!run_staging_ring_test())
+                exit_code = 1;
+        }
+        else if(stress_test)
+        {
+            if(!run_session_stress_test(_wtoi(stress_test_threads), 1000))
+                exit_code = 1;
+        }
+        else
         {
             CMessageLoop msgloop;
             module_.AddMessageLoop(&msgloop);
@@ -138,6 +194,23 @@ int main()
             }
         }
 
+        if(latency_tracer::is_enabled())
+        {
+            latency_tracer::set_enabled(false);
+            latency_tracer::get().print_histograms(std::cout);
+            if(!latency_tracer::get().write_chrome_trace(latency_trace_path))
+                std::cout << "could not write the latency trace" << std::endl;
+        }
+
+#ifdef STREAMING_LOCK_PROFILING
+        lock_profiler::print_report(std::cout);
+#endif
+
+        metrics::stop_dump();
+
+        // print the remaining log records
+        logger::get().stop();
+
 done:
         if(FAILED(hr))
             throw HR_EXCEPTION(hr);
@@ -160,5 +233,5 @@ done:
     }
 
 
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
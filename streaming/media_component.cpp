@@ -1,6 +1,7 @@
 #include "media_component.h"
 #include "control_class.h"
 #include "assert.h"
+#include "logger.h"
 #include <iostream>
 
 media_component::media_component(const media_session_t& session, instance_t instance_type) :
@@ -13,7 +14,7 @@ void media_component::request_reinitialization(const control_class_t& pipeline)
     bool not_reset = false;
     if(this->reset.compare_exchange_strong(not_reset, true))
     {
-        std::cout << "component failed, restarting..." << std::endl;
+        LOG_ERROR("component failed, restarting...");
 
         // the control_class_t shared ptr typedef should be only used for the root class
         // that won't have a parent class
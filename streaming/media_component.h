@@ -3,11 +3,12 @@
 #include "media_sample.h"
 #include "media_clock.h"
 #include "enable_shared_from_this.h"
+#include "lock_profiler.h"
 #include <memory>
 #include <mutex>
 #include <atomic>
 
-typedef std::shared_ptr<std::recursive_mutex> context_mutex_t;
+typedef std::shared_ptr<profiled_mutex<std::recursive_mutex>> context_mutex_t;
 
 class control_class;
 typedef std::shared_ptr<control_class> control_class_t;
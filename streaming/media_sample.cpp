@@ -1,6 +1,7 @@
 #include "media_sample.h"
 #include "assert.h"
 #include "IUnknownImpl.h"
+#include "logger.h"
 #include <mfapi.h>
 #include <Mferror.h>
 #include <initguid.h>
@@ -175,7 +176,7 @@ void media_buffer_texture::initialize(const CComPtr<ID3D11Device>& dev,
             (desc.Usage == old_desc.Usage) &&
             (desc.BindFlags == old_desc.BindFlags)))
         {
-            std::cout << "texture desc mismatch, reinitializing" << std::endl;
+            LOG_DEBUG("texture desc mismatch, reinitializing");
             this->initialize(dev, desc, subrsrc, true);
         }
     }
@@ -206,6 +207,32 @@ void media_buffer_texture::initialize(const CComPtr<ID3D11Texture2D>& texture)
 /////////////////////////////////////////////////////////////////
 
 
+void media_buffer_memory_texture::initialize(UINT32 width, UINT32 height)
+{
+    assert_(!this->texture);
+
+    this->buffer_poolable::initialize();
+
+    // pitch is a multiple of 16 bytes for the simd paths
+    const UINT32 pitch = (width * 4 + 15) & ~15u;
+    const DWORD len = pitch * height;
+    if(!this->texture_buffer || this->texture_buffer_length < len)
+    {
+        this->texture_buffer.reset(new BYTE[len]);
+        this->texture_buffer_length = len;
+    }
+
+    this->width = width;
+    this->height = height;
+    this->pitch = pitch;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
 //bool media_sample_audio_frames::move_or_share_consecutive_frames_to(
 //    media_sample_audio_frames* to, frame_unit end, UINT32 block_align, 
 //    media_sample_audio_consecutive_frames& elem, bool share)
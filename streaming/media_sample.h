@@ -22,6 +22,7 @@
 #include "assert.h"
 #include "enable_shared_from_this.h"
 #include "buffer_pool.h"
+#include "dirty_region.h"
 
 #pragma comment(lib, "Dxgi.lib")
 
@@ -93,6 +94,29 @@ typedef std::shared_ptr<media_buffer_texture> media_buffer_texture_t;
 typedef buffer_pooled<media_buffer_texture> media_buffer_pooled_texture;
 typedef std::shared_ptr<media_buffer_pooled_texture> media_buffer_pooled_texture_t;
 
+// system memory bgra surface for the cpu paths;
+// the data is stored in the texture_buffer and the texture is null
+class media_buffer_memory_texture : public media_buffer_texture
+{
+    friend class buffer_pooled<media_buffer_memory_texture>;
+protected:
+    void uninitialize() override {this->media_buffer_texture::uninitialize();}
+public:
+    // pitch is in bytes
+    UINT32 width, height, pitch;
+
+    media_buffer_memory_texture() : width(0), height(0), pitch(0) {this->texture_buffer_length = 0;}
+    virtual ~media_buffer_memory_texture() {}
+
+    // the old memory is reused if it is large enough;
+    // the contents are undefined after initialization
+    void initialize(UINT32 width, UINT32 height);
+};
+
+typedef std::shared_ptr<media_buffer_memory_texture> media_buffer_memory_texture_t;
+typedef buffer_pooled<media_buffer_memory_texture> media_buffer_memory_texture_pooled;
+typedef std::shared_ptr<media_buffer_memory_texture_pooled> media_buffer_memory_texture_pooled_t;
+
 // set to imfsample to ensure that the sample isn't recycled before imfsample has been released;
 // the tracker must be manually removed from the sample
 //CComPtr<IUnknown> create_lifetime_tracker(const media_buffer_t&);
@@ -198,10 +222,17 @@ public:
     frame_unit pos, dur;
     // null buffer indicates a silent frame
     media_buffer_texture_t buffer;
-
-    media_sample_video_frame() : dur(0) {}
+    // the frame has the same contents as the previous frame of the stream;
+    // components use this to skip reprocessing
+    bool unchanged;
+    // the region of the buffer that changed since the previous frame of the source;
+    // null if unknown, in which case the whole frame has changed;
+    // ignored if the frame is unchanged; components that produce new buffers don't pass it on
+    dirty_region_t changed_region;
+
+    media_sample_video_frame() : dur(0), unchanged(false) {}
     // TODO: remove this
-    explicit media_sample_video_frame(frame_unit pos) : pos(pos), dur(1) {}
+    explicit media_sample_video_frame(frame_unit pos) : pos(pos), dur(1), unchanged(false) {}
 
     frame_unit end() const {assert_(this->dur > 0); return this->pos + this->dur;}
 };
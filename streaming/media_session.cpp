@@ -4,15 +4,22 @@
 #include <Mferror.h>
 #include <iostream>
 #include "assert.h"
+#include "logger.h"
 
 #pragma warning(push)
 #pragma warning(disable: 4706) // assignment within conditional expression
 
+static std::atomic_int next_trace_track = {0};
+
 media_session::media_session(const media_clock_t& time_source,
-    frame_unit frame_rate_num, frame_unit frame_rate_den) :
+    frame_unit frame_rate_num, frame_unit frame_rate_den,
+    const jitter_buffer_t& jitter_buffer) :
     time_source(time_source),
+    request_chain_mutex("media_session::request_chain_mutex"),
     request_chain_lock(request_chain_mutex, std::defer_lock),
-    frame_rate_num(frame_rate_num), frame_rate_den(frame_rate_den)
+    frame_rate_num(frame_rate_num), frame_rate_den(frame_rate_den),
+    trace_track(next_trace_track++),
+    jitter_buffer(jitter_buffer)
 {
     if(this->frame_rate_num <= 0 || this->frame_rate_den <= 0)
         throw HR_EXCEPTION(E_UNEXPECTED);
@@ -28,6 +35,7 @@ media_topology_t media_session::get_current_topology() const
 
 void media_session::switch_topology(const media_topology_t& topology)
 {
+    topology->compile();
     std::atomic_store(&this->new_topology, topology);
 }
 
@@ -39,7 +47,10 @@ void media_session::switch_topology_immediate(
     // increment the topology number if the old topology exists
     media_topology_t old_topology = this->current_topology;
     if(old_topology)
+    {
         new_topology->topology_number = old_topology->topology_number + 1;
+        new_topology->previous_request_chains = old_topology->request_chains;
+    }
 
     // acquire old message generator
     media_message_generator_t message_generator;
@@ -60,6 +71,8 @@ void media_session::switch_topology_immediate(
 
 void media_session::start_playback(const media_topology_t& topology, time_unit time_point)
 {
+    topology->compile();
+
     // the request chain lock here really isn't necessary, but it is assumed by the
     // called function
     this->request_chain_lock.lock();
@@ -69,24 +82,17 @@ void media_session::start_playback(const media_topology_t& topology, time_unit t
 
 bool media_session::request_sample(const media_stream* stream, const request_packet& rp)
 {
-    assert_(this->request_chain_lock.owns_lock());
-
-    media_topology_t topology(rp.topology);
-    assert_(topology);
+    // the request packet keeps the topology alive
+    assert_(rp.topology);
+    const media_topology& topology = *rp.topology;
 
-    media_topology::topology_t::iterator it = topology->topology_reverse.find(stream);
-    assert_(it != rp.topology->topology_reverse.end());
-
-    for(auto jt = it->second.next.begin(); jt != it->second.next.end(); jt++)
-    {
-        // request sample calls for sources are made after all component calls for making sure that
-        // no process_sample calls begin before request_sample calls
-        if((*jt)->is_source_stream())
-            continue;
+    const media_topology::node_t* node = topology.get_node(stream);
+    assert_(node);
 
-        if((*jt)->request_sample(rp, stream) == media_stream::FATAL_ERROR)
+    // the source streams are excluded from the request edges
+    for(int i = node->request_begin; i < node->request_end; i++)
+        if(topology.request_streams[i]->request_sample(rp, stream) == media_stream::FATAL_ERROR)
             return false;
-    }
 
     return true;
 }
@@ -96,16 +102,15 @@ bool media_session::give_sample(
     const media_component_args* args,
     const request_packet& rp)
 {
-    // TODO: media topology should be defined as const
-
-    media_topology_t topology(rp.topology);
-    assert_(topology);
+    // the request packet keeps the topology alive
+    assert_(rp.topology);
+    const media_topology& topology = *rp.topology;
 
-    media_topology::topology_t::iterator it = topology->topology.find(stream);
-    assert_(it != topology->topology.end());
+    const media_topology::node_t* node = topology.get_node(stream);
+    assert_(node);
 
-    for(auto jt = it->second.next.begin(); jt != it->second.next.end(); jt++)
-        if((*jt)->process_sample(args, rp, stream) == media_stream::FATAL_ERROR)
+    for(int i = node->next_begin; i < node->next_end; i++)
+        if(topology.next_streams[i]->process_sample(args, rp, stream) == media_stream::FATAL_ERROR)
             return false;
 
     return true;
@@ -118,16 +123,21 @@ bool media_session::begin_request_sample(media_stream* stream, const request_pac
 
     request_packet rp = incomplete_rp;
 
-    // TODO: it must be ensured that the topology switching functionality is restricted to
-    // single thread
-
     assert_(!rp.topology);
 
-    // this mutex ensures that the begin request sample call chain is atomic
+    // the compiled topology is immutable, so the lookup doesn't need the lock
+    rp.topology = topology;
+    const media_topology::node_t* node = rp.topology->get_node(stream);
+    if(!node || !node->requestable)
+        return false;
+
+    // only the packet numbering, topology switching and the last packet flagging are serialized;
+    // they must be atomic so that the last packet of a topology has the last packet number
     this->request_chain_lock.lock();
 
-    rp.topology = topology;
-    if(rp.topology->topology_reverse.find(stream) == rp.topology->topology_reverse.end())
+    // the stopped topology doesn't begin new request chains after its last packet,
+    // because the shared components have already moved on to the next topology
+    if(rp.topology->last_packet_numbered)
     {
         this->request_chain_lock.unlock();
         return false;
@@ -136,6 +146,11 @@ bool media_session::begin_request_sample(media_stream* stream, const request_pac
     rp.packet_number = rp.topology->next_packet_number++;
     /*std::cout << rp.packet_number << std::endl;*/
 
+    // only the request chains that are begun before the switch is published are waited for
+    // by the next topology; the chains of the stopped topology are ordered after them
+    // by the packet numbers
+    const bool counted = (topology == this->current_topology);
+
     // check if there's a topology switch and switch the session to it;
     // topology switch can only be triggered by the current topology
     if(topology == this->current_topology)
@@ -144,7 +159,7 @@ bool media_session::begin_request_sample(media_stream* stream, const request_pac
         if(new_topology)
         {
             this->switch_topology_immediate(new_topology, rp.request_time);
-            std::cout << "topology switched" << std::endl;
+            LOG_DEBUG("topology switched");
         }
     }
 
@@ -153,10 +168,41 @@ bool media_session::begin_request_sample(media_stream* stream, const request_pac
     {
         if(rp.topology->drained || 
             (rp.topology->drained = rp.topology->get_message_generator()->is_drainable(rp.request_time)))
+        {
             // this is the final request
             rp.flags |= FLAG_LAST_PACKET;
+            rp.topology->last_packet_numbered = true;
+        }
+    }
+
+    // the chain is counted before unlocking so that a topology switch sees it
+    if(counted)
+    {
+        media_topology::request_chains_t& request_chains = *rp.topology->request_chains;
+        std::lock_guard<std::mutex> lock(request_chains.mutex);
+        request_chains.count++;
     }
 
+    this->request_chain_lock.unlock();
+
+    rp.trace = latency_tracer::create_trace(this->trace_track, rp.packet_number);
+
+    // the request queues of the components that are shared with the previous topology
+    // are initialized by the first request that reaches them, so the requests of this topology
+    // are blocked until the previous request chains that were in progress at the switch
+    // have finished;
+    // the wait only happens right after a topology switch
+    if(rp.topology->previous_request_chains &&
+        !rp.topology->previous_request_chains_finished.load(std::memory_order_acquire))
+    {
+        media_topology::request_chains_t& previous = *rp.topology->previous_request_chains;
+        std::unique_lock<std::mutex> lock(previous.mutex);
+        previous.finished.wait(lock, [&previous] {return previous.count == 0;});
+        rp.topology->previous_request_chains_finished.store(true, std::memory_order_release);
+    }
+
+    // the request call chains of different requests can run concurrently;
+    // the request queues of the components order the requests by the packet number
     bool ret = (stream->request_sample(rp, NULL) != media_stream::FATAL_ERROR);
 
     // call request_sample for sources
@@ -167,7 +213,14 @@ bool media_session::begin_request_sample(media_stream* stream, const request_pac
             break;
         }
 
-    this->request_chain_lock.unlock();
+    // the last counted chain releases the requests of the next topology
+    if(counted)
+    {
+        media_topology::request_chains_t& request_chains = *rp.topology->request_chains;
+        std::lock_guard<std::mutex> lock(request_chains.mutex);
+        if(--request_chains.count == 0)
+            request_chains.finished.notify_all();
+    }
 
     return ret;
 }
@@ -5,6 +5,7 @@
 #include "async_callback.h"
 #include "enable_shared_from_this.h"
 #include "request_packet.h"
+#include "jitter_buffer.h"
 #include <memory>
 #include <mutex>
 
@@ -19,8 +20,8 @@ public:
 private:
     media_clock_t time_source;
 
-    std::mutex request_chain_mutex;
-    std::unique_lock<std::mutex> request_chain_lock;
+    profiled_mutex<std::mutex> request_chain_mutex;
+    std::unique_lock<profiled_mutex<std::mutex>> request_chain_lock;
 
     media_topology_t current_topology;
     media_topology_t new_topology;
@@ -30,11 +31,17 @@ private:
     void switch_topology_immediate(const media_topology_t& new_topology, time_unit time_point);
 public:
     const frame_unit frame_rate_num, frame_rate_den;
+    // identifies the session in the latency traces
+    const int trace_track;
+    // measures the lateness of the sources for the buffering sources;
+    // the sessions that are mixed together share the jitter buffer; can be null
+    const jitter_buffer_t jitter_buffer;
 
-    media_session(const media_clock_t&, frame_unit frame_rate_num, frame_unit frame_rate_den);
+    media_session(const media_clock_t&, frame_unit frame_rate_num, frame_unit frame_rate_den,
+        const jitter_buffer_t& = nullptr);
     
     // the function throws if it is called from other function than on_stream_start/on_stream_stop
-    // and the component counterparts or request_sample
+    // and the component counterparts
     // (throws if the request_chain_lock is not held)
     media_topology_t get_current_topology() const;
     const media_clock_t& get_clock() const {return this->time_source;}
@@ -67,10 +74,12 @@ public:
         const request_packet&);
 
     // begins and completes the request_sample call chain and handles topology switching;
-    // the request call chain is atomic;
+    // only the packet numbering and topology switching are serialized, and the request call
+    // chains of concurrent requests can interleave;
     // begin_request_sample calls the sink_stream request_sample;
     // only the current topology triggers a topology switch;
-    // returns false if the stream is not found in the topology or the stream returns fatal_error
+    // returns false if the stream is not found in the topology, the stopped topology has already
+    // numbered its last packet or the stream returns fatal_error
     bool begin_request_sample(media_stream* sink_stream, const request_packet&, 
         const media_topology_t& topology);
 };
@@ -3,7 +3,8 @@
 #include "media_clock.h"
 #include "assert.h"
 
-media_stream::media_stream(stream_t stream_type) : locked(false), stream_type(stream_type)
+media_stream::media_stream(stream_t stream_type) :
+    stream_type(stream_type), topology_index(-1), locked(false), mutex("media_stream::mutex")
 {
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 #include "media_sample.h"
 #include "enable_shared_from_this.h"
+#include "lock_profiler.h"
 #include <memory>
 #include <condition_variable>
 
@@ -15,8 +16,9 @@ struct request_packet;
 
 class media_stream : public enable_shared_from_this
 {
+    friend class media_topology;
 public:
-    typedef std::unique_lock<std::mutex> scoped_lock;
+    typedef profiled_unique_lock<std::mutex> scoped_lock;
     enum result_t
     {
         OK,
@@ -31,9 +33,11 @@ public:
     };
 private:
     const stream_t stream_type;
+    // the index of the node in the compiled topology
+    int topology_index;
     volatile bool locked;
-    std::mutex mutex;
-    std::condition_variable cv;
+    profiled_mutex<std::mutex> mutex;
+    profiled_condition_variable cv;
 
     std::weak_ptr<media_topology> topology;
 protected:
@@ -3,14 +3,30 @@
 #include <algorithm>
 
 media_topology::media_topology(const media_message_generator_t& message_generator) :
+    compiled(false),
     message_generator(message_generator), next_packet_number(0), topology_number(0),
+    request_chains(new request_chains_t),
+    previous_request_chains_finished(false),
+    last_packet_numbered(false),
     drained(false)
 {
 }
 
+void media_topology::add_stream(const media_stream_t& stream)
+{
+    // the streams of fan-out connections don't have a reverse entry,
+    // so the adjacency maps don't tell whether the stream has been added
+    if(this->added_streams.insert(stream.get()).second)
+        this->streams.push_back(stream);
+}
+
 void media_topology::connect_streams(const media_stream_t& stream, const media_stream_t& stream2)
 {
     assert_(stream && stream2);
+    assert_(!this->compiled);
+
+    this->add_stream(stream);
+    this->add_stream(stream2);
 
     // to make sure that request_sample calls are finished before process_sample calls for a request,
     // source streams are separated from the topology by listing them in an additional container
@@ -35,4 +51,59 @@ void media_topology::connect_streams(const media_stream_t& stream, const media_s
         if(stream->is_source_stream())
             this->source_streams.push_back(stream);
     }
+}
+
+void media_topology::compile()
+{
+    if(this->compiled)
+        return;
+
+    this->nodes.reserve(this->streams.size());
+    for(size_t i = 0; i < this->streams.size(); i++)
+    {
+        media_stream* stream = this->streams[i].get();
+        node_t node;
+
+        // a stream can only be part of one topology
+        assert_(stream->topology_index < 0);
+        stream->topology_index = (int)i;
+        node.stream = stream;
+
+        node.next_begin = (int)this->next_streams.size();
+        topology_t::const_iterator it = this->topology.find(stream);
+        if(it != this->topology.end())
+            for(auto&& item : it->second.next)
+                this->next_streams.push_back(item.get());
+        node.next_end = (int)this->next_streams.size();
+
+        // request sample calls for sources are made after all component calls for making sure
+        // that no process_sample calls begin before request_sample calls
+        node.request_begin = (int)this->request_streams.size();
+        it = this->topology_reverse.find(stream);
+        node.requestable = (it != this->topology_reverse.end());
+        if(node.requestable)
+            for(auto&& item : it->second.next)
+                if(!item->is_source_stream())
+                    this->request_streams.push_back(item.get());
+        node.request_end = (int)this->request_streams.size();
+
+        this->nodes.push_back(node);
+    }
+
+    // the streams are owned by the streams vector
+    this->topology.clear();
+    this->topology_reverse.clear();
+    this->added_streams.clear();
+
+    this->compiled = true;
+}
+
+const media_topology::node_t* media_topology::get_node(const media_stream* stream) const
+{
+    assert_(this->compiled);
+
+    const int index = stream->topology_index;
+    if(index < 0 || index >= (int)this->nodes.size() || this->nodes[index].stream != stream)
+        return NULL;
+    return &this->nodes[index];
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 #include "media_clock.h"
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 /*
@@ -18,7 +22,10 @@ which also means that components need to be reinitialized
 class media_stream;
 typedef std::shared_ptr<media_stream> media_stream_t;
 
-// TODO: improve topology traverse speed
+// the topology is built by connecting the streams and compiled by the media session
+// before it is used;
+// compiling flattens the adjacency into an array of nodes with contiguous edge lists,
+// and the node index is stored on each stream so that traversing doesn't need lookups
 
 // singlethreaded
 
@@ -29,17 +36,58 @@ class media_topology
 public:
     struct topology_node {std::vector<media_stream_t> next;};
     typedef std::unordered_map<const media_stream*, topology_node> topology_t;
+    // the ranges are indices to the edge lists
+    struct node_t
+    {
+        const media_stream* stream;
+        // downstream streams
+        int next_begin, next_end;
+        // upstream streams that are requested by the session; source streams are excluded
+        int request_begin, request_end;
+        // the stream has upstream streams, which means it can begin a request
+        bool requestable;
+    };
 private:
     std::vector<media_stream_t> source_streams;
+    // the streams in the order they were connected; owns the streams
+    std::vector<media_stream_t> streams;
+    // the adjacency maps are only used while building the topology
     topology_t topology, topology_reverse;
+    // the streams that have been added to the streams vector
+    std::unordered_set<const media_stream*> added_streams;
+    std::vector<node_t> nodes;
+    std::vector<media_stream*> next_streams, request_streams;
+    bool compiled;
     media_message_generator_t message_generator;
     volatile int next_packet_number;
     int topology_number;
 
+    // the request call chains of a topology that were begun while it was the current topology
+    struct request_chains_t
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        int count = 0;
+    };
+    std::shared_ptr<request_chains_t> request_chains;
+    // the request chains of the previous topology;
+    // the requests of this topology wait for the previous request chains to finish
+    // so that the shared components receive the requests in the topology order
+    std::shared_ptr<request_chains_t> previous_request_chains;
+    std::atomic_bool previous_request_chains_finished;
+    // the topology doesn't begin new request chains after the last packet
+    bool last_packet_numbered;
+
     // only one request stream connection is added for a node;
     // subsequent connections are discarded;
     // called by media_stream only
     void connect_streams(const media_stream_t& stream, const media_stream_t& stream2);
+    void add_stream(const media_stream_t&);
+    // flattens the adjacency maps; subsequent calls are ignored;
+    // called by media_session before the topology is published
+    void compile();
+    // returns NULL if the stream isn't part of the compiled topology
+    const node_t* get_node(const media_stream*) const;
 public:
     // media session uses this value to determine whether the drain operation for the topology
     // has completed
@@ -49,6 +97,7 @@ public:
 
     media_message_generator_t get_message_generator() const {return this->message_generator;}
     int get_topology_number() const {return this->topology_number;}
+    size_t get_stream_count() const {return this->streams.size();}
 };
 
 typedef std::shared_ptr<media_topology> media_topology_t;
\ No newline at end of file
@@ -0,0 +1,133 @@
+#include "metrics.h"
+#include <Windows.h>
+#include <deque>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+
+#undef min
+#undef max
+
+namespace
+{
+
+struct registry_t
+{
+    std::mutex mutex;
+    // deque keeps the references to the elements valid
+    std::deque<metric> metrics;
+};
+
+registry_t& get_registry()
+{
+    static registry_t registry;
+    return registry;
+}
+
+}
+
+std::mutex metrics::dump_mutex;
+std::condition_variable metrics::dump_cv;
+bool metrics::dump_stopping = false;
+std::thread metrics::dump_thread;
+
+metric::metric(const std::string& name, type_t type) :
+    value(0), peak(0),
+    name(name), type(type)
+{
+}
+
+void metric::update_peak(int64_t val)
+{
+    int64_t old_peak = this->peak.load(std::memory_order_relaxed);
+    while(old_peak < val && !this->peak.compare_exchange_weak(old_peak, val, std::memory_order_relaxed));
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+metric& metrics::get_metric(const std::string& name, metric::type_t type)
+{
+    registry_t& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for(auto&& item : registry.metrics)
+        if(item.name == name)
+            return item;
+
+    registry.metrics.emplace_back(name, type);
+    return registry.metrics.back();
+}
+
+void metrics::write(std::ostream& out)
+{
+    registry_t& registry = get_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for(auto&& item : registry.metrics)
+    {
+        const int64_t value = item.get();
+        if(item.type == metric::TYPE_COUNTER)
+        {
+            out << "# TYPE streaming_" << item.name << " counter" << std::endl;
+            out << "streaming_" << item.name << " " << value << std::endl;
+        }
+        else
+        {
+            // the peak is reset to the current value so that the next dump shows
+            // the peak of the next interval
+            const int64_t peak = std::max(item.peak.exchange(value, std::memory_order_relaxed), value);
+            out << "# TYPE streaming_" << item.name << " gauge" << std::endl;
+            out << "streaming_" << item.name << " " << value << std::endl;
+            out << "# TYPE streaming_" << item.name << "_peak gauge" << std::endl;
+            out << "streaming_" << item.name << "_peak " << peak << std::endl;
+        }
+    }
+}
+
+void metrics::dump_thread_proc(std::wstring path, int interval_ms)
+{
+    const std::wstring temp_path = path + L".tmp";
+
+    std::unique_lock<std::mutex> lock(dump_mutex);
+    while(!dump_stopping)
+    {
+        dump_cv.wait_for(lock, std::chrono::milliseconds(interval_ms));
+
+        {
+            std::ofstream out(temp_path, std::ios::out | std::ios::trunc);
+            if(!out)
+                continue;
+            write(out);
+        }
+
+        // readers never see a partially written file
+        MoveFileExW(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+    }
+}
+
+void metrics::start_dump(const std::wstring& path, int interval_ms)
+{
+    std::lock_guard<std::mutex> lock(dump_mutex);
+    if(dump_thread.joinable())
+        return;
+
+    dump_stopping = false;
+    dump_thread = std::thread(&metrics::dump_thread_proc, path, interval_ms);
+}
+
+void metrics::stop_dump()
+{
+    {
+        std::lock_guard<std::mutex> lock(dump_mutex);
+        if(!dump_thread.joinable())
+            return;
+        dump_stopping = true;
+    }
+
+    dump_cv.notify_one();
+    dump_thread.join();
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <ostream>
+
+// registry of the pipeline health metrics;
+// the metrics are registered once and updated lock free;
+// the registry can be written periodically to a file in the prometheus text format,
+// which can be read by the node exporter textfile collector, for example;
+// metrics with the same name share the value
+
+class metric final
+{
+    friend class metrics;
+public:
+    enum type_t {TYPE_COUNTER, TYPE_GAUGE};
+private:
+    std::atomic<int64_t> value;
+    // the highest value of a gauge since the last dump
+    std::atomic<int64_t> peak;
+
+    void update_peak(int64_t val);
+public:
+    const std::string name;
+    const type_t type;
+
+    metric(const std::string& name, type_t type);
+
+    // counters are only incremented;
+    // gauges that are shared between instances are updated with deltas
+    void add(int64_t val = 1)
+    {
+        const int64_t new_val = this->value.fetch_add(val, std::memory_order_relaxed) + val;
+        if(this->type == TYPE_GAUGE)
+            this->update_peak(new_val);
+    }
+    void set(int64_t val)
+    {
+        this->value.store(val, std::memory_order_relaxed);
+        this->update_peak(val);
+    }
+    int64_t get() const {return this->value.load(std::memory_order_relaxed);}
+};
+
+class metrics final
+{
+private:
+    static std::mutex dump_mutex;
+    static std::condition_variable dump_cv;
+    static bool dump_stopping;
+    static std::thread dump_thread;
+
+    static metric& get_metric(const std::string& name, metric::type_t);
+    static void dump_thread_proc(std::wstring path, int interval_ms);
+public:
+    // the returned metric stays valid for the lifetime of the process;
+    // the names are prefixed with streaming_ in the output
+    static metric& get_counter(const std::string& name) {return get_metric(name, metric::TYPE_COUNTER);}
+    static metric& get_gauge(const std::string& name) {return get_metric(name, metric::TYPE_GAUGE);}
+
+    // writes the metrics in the prometheus text format;
+    // the peaks of the gauges are reset
+    static void write(std::ostream&);
+
+    // writes the metrics to the file at the interval;
+    // the file is replaced atomically
+    static void start_dump(const std::wstring& path, int interval_ms);
+    static void stop_dump();
+};
\ No newline at end of file
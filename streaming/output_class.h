@@ -1,6 +1,7 @@
 #pragma once
 
 #include "media_sample.h"
+#include "key_frame_requester.h"
 #include <atlbase.h>
 #include <mfapi.h>
 #include <memory>
@@ -8,9 +9,23 @@
 class output_class
 {
 private:
+    key_frame_requester_t requester;
+protected:
+    // requests a key frame from the encoder if a requester is set
+    void request_key_frame() const
+    {
+        if(auto requester = this->requester.lock())
+            requester->request_key_frame();
+    }
 public:
     virtual ~output_class() = default;
     virtual void write_sample(bool video, const CComPtr<IMFSample>&) = 0;
+
+    // must be set before the output is started
+    virtual void set_key_frame_requester(const key_frame_requester_t& requester)
+    {
+        this->requester = requester;
+    }
 };
 
 using output_class_t = std::shared_ptr<output_class>;
\ No newline at end of file
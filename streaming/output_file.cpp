@@ -1,4 +1,5 @@
 #include "output_file.h"
+#include "latency_trace.h"
 #include "assert.h"
 #include <iostream>
 #include <Mferror.h>
@@ -86,6 +87,7 @@ void output_file::write_sample(bool video, const CComPtr<IMFSample>& sample)
 
     HRESULT hr = S_OK;
     CHECK_HR(hr = this->writer->WriteSample(video ? 0 : 1, sample));
+    latency_tracer::stamp_sample(sample, latency_trace::STAGE_SEND);
 
 done:
     if(!this->stopped && FAILED(hr))
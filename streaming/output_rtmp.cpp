@@ -1,8 +1,12 @@
+#include <WinSock2.h>
 #include <librtmp/rtmp.h>
 #include <librtmp/log.h>
 #include <librtmp/amf.h>
 
 #include "output_rtmp.h"
+#include "latency_trace.h"
+#include "logger.h"
+#include "metrics.h"
 #include <codecapi.h>
 #include <intrin.h>
 #include <iostream>
@@ -12,6 +16,12 @@
 #undef min
 #undef max
 
+// the chunk size that is negotiated with the server;
+// large chunks reduce the amount of chunk headers and buffers per write
+#define OUT_CHUNK_SIZE 65536
+// chunk stream id that RTMP_Write uses for the media
+#define MEDIA_CHUNK_STREAM_ID 0x04
+
 #pragma pack(push, 1)
 struct flv_tag
 {
@@ -25,12 +35,30 @@ struct flv_tag
 
 output_rtmp::output_rtmp() : 
     rtmp(nullptr),
-    video_headers_sent(false), audio_headers_sent(false)
+    video_headers_sent(false), audio_headers_sent(false),
+    state(STATE_CONNECTED),
+    key_frame_pending(false),
+    direct_send(false),
+    reported_video_samples(0), reported_audio_samples(0)
 {
 }
 
 output_rtmp::~output_rtmp()
 {
+    // the reconnect thread finishes its current connect attempt before exiting
+    {
+        scoped_lock lock(this->write_lock);
+        this->state = STATE_STOPPED;
+    }
+    this->reconnect_cv.notify_one();
+    if(this->reconnect_thread.joinable())
+        this->reconnect_thread.join();
+
+    // the queued samples of this destination are removed from the gauges
+    this->video_samples.clear();
+    this->audio_samples.clear();
+    this->update_queued_samples_metrics();
+
     if(this->rtmp)
     {
         RTMP_Close(this->rtmp);
@@ -40,6 +68,17 @@ output_rtmp::~output_rtmp()
     this->recording_initiator.SendNotifyMessageW(RECORDING_STOPPED_MESSAGE, 0);
 }
 
+void output_rtmp::update_queued_samples_metrics()
+{
+    static metric& queued_video = metrics::get_gauge("rtmp_queued_video_samples");
+    static metric& queued_audio = metrics::get_gauge("rtmp_queued_audio_samples");
+
+    queued_video.add((int64_t)this->video_samples.size() - this->reported_video_samples);
+    queued_audio.add((int64_t)this->audio_samples.size() - this->reported_audio_samples);
+    this->reported_video_samples = (int64_t)this->video_samples.size();
+    this->reported_audio_samples = (int64_t)this->audio_samples.size();
+}
+
 void output_rtmp::send_flv_metadata()
 {
     // sends a scriptdata tag named onMetaData
@@ -74,6 +113,15 @@ void output_rtmp::send_flv_metadata()
     char* p = buffer;
     char* end = p + sizeof(buffer);
 
+    // RTMP_Write prepends @setDataFrame to info packets
+    if(this->direct_send)
+    {
+        constexpr std::string_view setDataFrame_str = "@setDataFrame";
+        constexpr AVal set_data_frame =
+            {const_cast<char*>(setDataFrame_str.data()), (int)setDataFrame_str.size()};
+        p = AMF_EncodeString(p, end, &set_data_frame);
+    }
+
     constexpr AVal name = {const_cast<char*>(onMetaData_str.data()), (int)onMetaData_str.size()};
     p = AMF_EncodeString(p, end, &name);
 
@@ -132,42 +180,138 @@ void output_rtmp::send_flv_metadata()
     *p++ = AMF_OBJECT_END;
 
     // write to stream
+    this->send_message(RTMP_PACKET_TYPE_INFO, 0, std::string_view(buffer, p - buffer));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+void output_rtmp::send_message(uint8_t type, uint32_t timestamp_ms, const std::string_view& body)
+{
+    static metric& bytes_sent = metrics::get_counter("rtmp_bytes_sent");
+    bytes_sent.add((int64_t)body.size());
+
+    if(this->direct_send)
     {
-        const uint32_t metadata_len = (uint32_t)(p - buffer);
-        const uint32_t rtmp_body_size = sizeof(flv_tag) + metadata_len;
-        const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-        std::string packet(rtmp_body_size + 4, '\0');
-
-        flv_tag* tag = (flv_tag*)packet.data();
-        tag->tag_type = RTMP_PACKET_TYPE_INFO;
-        tag->data_size[2] = (uint8_t)flv_data_size;
-        tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-        tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-        tag->timestamp[2] = 0;
-        tag->timestamp[1] = 0;
-        tag->timestamp[0] = 0;
-        tag->timestamp_extended = 0;
-        tag->stream_id[2] = 0;
-        tag->stream_id[1] = 0;
-        tag->stream_id[0] = 0;
-
-        assert_(sizeof(flv_tag) + metadata_len == rtmp_body_size);
-        memcpy(
-            packet.data() + sizeof(flv_tag),
-            buffer,
-            metadata_len);
+        this->send_message_direct(type, timestamp_ms, body);
+        return;
+    }
 
-        *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
+    // RTMP_Write takes a whole flv tag, including the previous tag size trailer
+    const uint32_t flv_data_size = (uint32_t)body.size();
+    const uint32_t rtmp_body_size = sizeof(flv_tag) + flv_data_size;
 
-        const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-        if(!res)
-            CHECK_HR(hr = E_UNEXPECTED);
+    this->flv_tag_buffer.resize(rtmp_body_size + 4);
+
+    flv_tag* tag = (flv_tag*)this->flv_tag_buffer.data();
+    tag->tag_type = type;
+    tag->data_size[2] = (uint8_t)flv_data_size;
+    tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
+    tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
+    tag->timestamp[2] = (uint8_t)timestamp_ms;
+    tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
+    tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
+    tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
+    tag->stream_id[2] = 0;
+    tag->stream_id[1] = 0;
+    tag->stream_id[0] = 0;
+
+    memcpy(this->flv_tag_buffer.data() + sizeof(flv_tag), body.data(), body.size());
+
+    *(uint32_t*)(this->flv_tag_buffer.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
+
+    const int res = RTMP_Write(this->rtmp,
+        this->flv_tag_buffer.data(), (int)this->flv_tag_buffer.size(), 0);
+    if(!res)
+        throw HR_EXCEPTION(E_UNEXPECTED);
+}
+
+void output_rtmp::send_message_direct(uint8_t type, uint32_t timestamp_ms,
+    const std::string_view& body)
+{
+    // https://rtmp.veriskope.com/docs/spec/#53chunking
+
+    // the chunks are sent in batches of this many buffers
+    constexpr int max_buffers = 64;
+    const bool extended_timestamp = (timestamp_ms >= 0xFFFFFF);
+    const uint32_t header_timestamp = extended_timestamp ? 0xFFFFFF : timestamp_ms;
+    const uint32_t body_size = (uint32_t)body.size();
+    // the id of the published stream; RTMP_Write uses the same stream index
+    const uint32_t stream_id = (uint32_t)this->rtmp->Link.streams[0].id;
+
+    if(body_size > 0xFFFFFF)
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    // type 0 chunk header that carries the whole message header, so that
+    // no header compression state needs to be shared with librtmp
+    uint8_t header[1 + 11 + 4];
+    uint8_t* h = header;
+    *h++ = (0 << 6) | MEDIA_CHUNK_STREAM_ID;
+    *h++ = (uint8_t)(header_timestamp >> 16);
+    *h++ = (uint8_t)(header_timestamp >> 8);
+    *h++ = (uint8_t)header_timestamp;
+    *h++ = (uint8_t)(body_size >> 16);
+    *h++ = (uint8_t)(body_size >> 8);
+    *h++ = (uint8_t)body_size;
+    *h++ = type;
+    // the message stream id is little endian
+    *h++ = (uint8_t)stream_id;
+    *h++ = (uint8_t)(stream_id >> 8);
+    *h++ = (uint8_t)(stream_id >> 16);
+    *h++ = (uint8_t)(stream_id >> 24);
+    if(extended_timestamp)
+    {
+        *(uint32_t*)h = _byteswap_ulong(timestamp_ms);
+        h += sizeof(uint32_t);
     }
 
-done:
-    if(FAILED(hr))
-        throw HR_EXCEPTION(hr);
+    // type 3 chunk header for the continuation chunks;
+    // the extended timestamp is repeated in them like librtmp does
+    uint8_t continuation_header[1 + 4];
+    uint8_t* c = continuation_header;
+    *c++ = (3 << 6) | MEDIA_CHUNK_STREAM_ID;
+    if(extended_timestamp)
+    {
+        *(uint32_t*)c = _byteswap_ulong(timestamp_ms);
+        c += sizeof(uint32_t);
+    }
+
+    // the buffers point to the headers and to the body, so that the body isn't copied
+    WSABUF buffers[max_buffers];
+    int buffer_count = 0;
+    auto flush = [&]()
+    {
+        DWORD bytes_sent = 0, expected_bytes = 0;
+        for(int i = 0; i < buffer_count; i++)
+            expected_bytes += buffers[i].len;
+
+        const int res = WSASend(
+            this->rtmp->m_sb.sb_socket, buffers, buffer_count, &bytes_sent, 0, NULL, NULL);
+        if(res == SOCKET_ERROR || bytes_sent != expected_bytes)
+        {
+            LOG_ERROR("rtmp socket write failed, error {}", (int)WSAGetLastError());
+            throw HR_EXCEPTION(E_UNEXPECTED);
+        }
+        buffer_count = 0;
+    };
+
+    buffers[buffer_count++] = {(ULONG)(h - header), (CHAR*)header};
+    for(uint32_t offset = 0;;)
+    {
+        const uint32_t chunk_size = std::min(body_size - offset, (uint32_t)OUT_CHUNK_SIZE);
+        buffers[buffer_count++] = {chunk_size, const_cast<CHAR*>(body.data() + offset)};
+        offset += chunk_size;
+
+        if(offset >= body_size)
+            break;
+
+        if(buffer_count + 2 > max_buffers)
+            flush();
+        buffers[buffer_count++] = {(ULONG)(c - continuation_header), (CHAR*)continuation_header};
+    }
+
+    flush();
 }
 
 void output_rtmp::initialize(
@@ -175,7 +319,8 @@ void output_rtmp::initialize(
     const std::string_view& streaming_key,
     CWindow recording_initiator,
     const CComPtr<IMFMediaType>& video_type,
-    const CComPtr<IMFMediaType>& audio_type)
+    const CComPtr<IMFMediaType>& audio_type,
+    bool reconnect_on_failure)
 {
     assert_(!this->rtmp);
     assert_(video_type);
@@ -185,59 +330,272 @@ void output_rtmp::initialize(
     this->video_type = video_type;
     this->audio_type = audio_type;
     this->recording_initiator = recording_initiator;
-    this->rtmp = RTMP_Alloc();
-    if(!this->rtmp)
-        CHECK_HR(hr = E_UNEXPECTED);
+    this->url = url;
+    this->streaming_key = streaming_key;
 
     // The stream should contain raw_data_block elements only
     UINT32 aac_payload_type = MFGetAttributeUINT32(this->audio_type, MF_MT_AAC_PAYLOAD_TYPE, 0);
     if(aac_payload_type != 0)
         CHECK_HR(hr = E_UNEXPECTED);
 
-    RTMP_Init(this->rtmp);
-
     RTMP_LogSetLevel(RTMP_LOGALL);
     RTMP_LogSetCallback(
         [](int level, const char* fmt, va_list args) 
         {
             if(level == RTMP_LOGCRIT || level == RTMP_LOGERROR || level == RTMP_LOGWARNING)
             {
-                vprintf(fmt, args); 
-                printf("\n");
+                // librtmp formats the message, so it is copied to the log record
+                char text[logger::max_text_length];
+                vsnprintf(text, sizeof(text), fmt, args);
+                if(level == RTMP_LOGWARNING)
+                    LOG_TEXT(logger::LEVEL_WARNING, "librtmp: ", text);
+                else
+                    LOG_TEXT(logger::LEVEL_ERROR, "librtmp: ", text);
             }
             /*vprintf(fmt, args); printf("\n");*/ 
         });
 
+    try
+    {
+        this->rtmp = this->connect(this->url_buffer, 0);
+    }
+    catch(streaming::exception err)
+    {
+        if(!reconnect_on_failure)
+            throw;
+
+        // the samples are buffered until the reconnect thread has connected
+        LOG_ERROR("rtmp connection failed, hr {}; reconnecting", log_hex(err.get_hresult()));
+        this->state = STATE_RECONNECTING;
+        this->disconnect_time = std::chrono::steady_clock::now();
+        this->key_frame_pending = true;
+    }
+
+    if(this->rtmp)
+    {
+        // the http tunneling of librtmp doesn't use the socket directly
+        this->direct_send = !(this->rtmp->Link.protocol & RTMP_FEATURE_HTTP);
+
+        this->send_flv_metadata();
+    }
+
+    this->reconnect_thread = std::thread(&output_rtmp::reconnect_thread_proc, this);
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+RTMP* output_rtmp::connect(std::string& url_buffer, int timeout) const
+{
+    HRESULT hr = S_OK;
+    RTMP* rtmp = RTMP_Alloc();
+    if(!rtmp)
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    RTMP_Init(rtmp);
+
     // Additional options may be specified by appending space-separated key=value pairs to the URL.
     /*str += " live=1";*/
 
-    if(!RTMP_SetupURL(this->rtmp, const_cast<char*>(url.data())))
+    // RTMP_SetupURL modifies the url, so each connection parses a copy of it
+    url_buffer = this->url;
+    if(!RTMP_SetupURL(rtmp, url_buffer.data()))
         CHECK_HR(hr = E_UNEXPECTED);
-    RTMP_EnableWrite(this->rtmp);
+    RTMP_EnableWrite(rtmp);
 
     {
         static constexpr std::string_view str = "FMLE/3.0 (compatible; FMSc/1.0)";
         AVal val = {const_cast<char*>(str.data()), (int)str.size()};
-        this->rtmp->Link.flashVer = val;
+        rtmp->Link.flashVer = val;
     }
-    this->rtmp->Link.swfUrl = this->rtmp->Link.tcUrl;
+    rtmp->Link.swfUrl = rtmp->Link.tcUrl;
+    if(timeout > 0)
+        rtmp->Link.timeout = timeout;
 
-    RTMP_AddStream(this->rtmp, streaming_key.data());
+    RTMP_AddStream(rtmp, this->streaming_key.c_str());
     
-    this->rtmp->m_outChunkSize = 4096;
-    this->rtmp->m_bSendChunkSizeInfo = true;
-    this->rtmp->m_bUseNagle = true;
+    rtmp->m_outChunkSize = OUT_CHUNK_SIZE;
+    rtmp->m_bSendChunkSizeInfo = true;
+    rtmp->m_bUseNagle = true;
 
-    if(!RTMP_Connect(this->rtmp, nullptr))
+    if(!RTMP_Connect(rtmp, nullptr))
         CHECK_HR(hr = E_UNEXPECTED);
-    if(!RTMP_ConnectStream(this->rtmp, 0))
+    if(!RTMP_ConnectStream(rtmp, 0))
         CHECK_HR(hr = E_UNEXPECTED);
 
-    this->send_flv_metadata();
-
 done:
     if(FAILED(hr))
+    {
+        RTMP_Close(rtmp);
+        RTMP_Free(rtmp);
         throw HR_EXCEPTION(hr);
+    }
+
+    return rtmp;
+}
+
+void output_rtmp::disconnect()
+{
+    static metric& disconnects = metrics::get_counter("rtmp_disconnects");
+
+    // the reconnect time is measured from the first failure
+    if(this->state == STATE_CONNECTED)
+    {
+        disconnects.add();
+        this->disconnect_time = std::chrono::steady_clock::now();
+    }
+
+    RTMP_Close(this->rtmp);
+    this->state = STATE_RECONNECTING;
+
+    // the new connection needs the sequence headers before the key frame
+    this->video_headers_sent = false;
+    this->audio_headers_sent = false;
+    this->key_frame_pending = true;
+    this->trim_buffered_samples();
+
+    this->reconnect_cv.notify_one();
+}
+
+void output_rtmp::resume()
+{
+    this->send_flv_metadata();
+
+    // the buffered video starts from a key frame, unless no key frame has been buffered yet,
+    // in which case a key frame is forced so that the stream doesn't wait for the next gop;
+    // the sequence headers are replayed from the cached sps and pps and the audio
+    // specific config before the first resumed samples
+    if(!this->video_samples.empty())
+        this->key_frame_pending = false;
+    else
+        this->request_key_frame();
+    this->send_rtmp_packets();
+
+    this->state = STATE_CONNECTED;
+}
+
+void output_rtmp::trim_buffered_samples()
+{
+    static metric& lost_samples = metrics::get_counter("rtmp_reconnect_lost_samples");
+
+    auto sample_time = [](const CComPtr<IMFSample>& sample)
+    {
+        LONGLONG ts = 0;
+        sample->GetSampleTime(&ts);
+        return ts;
+    };
+    auto is_key_frame = [](const CComPtr<IMFSample>& sample)
+    {
+        return !!MFGetAttributeUINT32(sample, MFSampleExtension_CleanPoint, FALSE);
+    };
+
+    for(;;)
+    {
+        // the video resumes from a key frame
+        while(!this->video_samples.empty() && !is_key_frame(this->video_samples.front()))
+        {
+            this->video_samples.pop_front();
+            lost_samples.add();
+        }
+
+        // the oldest key frame is dropped if the buffered window is exceeded
+        if(this->state == STATE_CONNECTED || this->video_samples.empty() ||
+            sample_time(this->video_samples.back()) - sample_time(this->video_samples.front()) <=
+            reconnect_buffer_duration)
+            break;
+
+        this->video_samples.pop_front();
+        lost_samples.add();
+    }
+
+    // the audio that precedes the key frame is dropped;
+    // the audio is bounded by the window while no key frame is buffered
+    while(!this->audio_samples.empty() &&
+        ((!this->video_samples.empty() &&
+        sample_time(this->audio_samples.front()) < sample_time(this->video_samples.front())) ||
+        sample_time(this->audio_samples.back()) - sample_time(this->audio_samples.front()) >
+        reconnect_buffer_duration))
+    {
+        this->audio_samples.pop_front();
+        lost_samples.add();
+    }
+
+    if(this->state == STATE_CONNECTED && !this->video_samples.empty())
+        this->key_frame_pending = false;
+}
+
+void output_rtmp::reconnect_thread_proc()
+{
+    static metric& reconnects = metrics::get_counter("rtmp_reconnects");
+    static metric& reconnect_time = metrics::get_gauge("rtmp_reconnect_time_ms");
+
+    std::unique_lock<std::mutex> lock(this->write_lock);
+    for(;;)
+    {
+        this->reconnect_cv.wait(lock, [this] {return this->state != STATE_CONNECTED;});
+
+        // the first attempt is made immediately
+        int delay_ms = reconnect_initial_delay_ms;
+        while(this->state == STATE_RECONNECTING)
+        {
+            // the handshake is done without holding the lock so that the samples
+            // are buffered meanwhile
+            std::string url_buffer;
+            RTMP* rtmp = nullptr;
+            lock.unlock();
+            try
+            {
+                rtmp = this->connect(url_buffer, reconnect_timeout);
+            }
+            catch(streaming::exception err)
+            {
+                LOG_WARNING("rtmp reconnect attempt failed, hr {}", log_hex(err.get_hresult()));
+            }
+            lock.lock();
+
+            if(rtmp && this->state == STATE_STOPPED)
+            {
+                RTMP_Close(rtmp);
+                RTMP_Free(rtmp);
+            }
+            else if(rtmp)
+            {
+                // the context is null if the initial connection failed
+                if(this->rtmp)
+                    RTMP_Free(this->rtmp);
+                this->rtmp = rtmp;
+                this->url_buffer = std::move(url_buffer);
+                this->direct_send = !(this->rtmp->Link.protocol & RTMP_FEATURE_HTTP);
+
+                try
+                {
+                    this->resume();
+
+                    using namespace std::chrono;
+                    const int64_t elapsed_ms = duration_cast<milliseconds>(
+                        steady_clock::now() - this->disconnect_time).count();
+                    reconnects.add();
+                    reconnect_time.set(elapsed_ms);
+                    LOG_INFO("rtmp reconnected in {} ms", elapsed_ms);
+                    break;
+                }
+                catch(streaming::exception err)
+                {
+                    LOG_WARNING("rtmp connection lost while resuming, hr {}",
+                        log_hex(err.get_hresult()));
+                    this->disconnect();
+                }
+            }
+
+            this->reconnect_cv.wait_for(lock, std::chrono::milliseconds(delay_ms),
+                [this] {return this->state == STATE_STOPPED;});
+            delay_ms = std::min(delay_ms * 2, reconnect_max_delay_ms);
+        }
+
+        if(this->state == STATE_STOPPED)
+            return;
+    }
 }
 
 // potentially uninitialized local variable (samplingFrequencyIndex, channelConfiguration)
@@ -325,83 +683,38 @@ void output_rtmp::send_rtmp_audio_packets(const std::string_view& data, LONGLONG
         this->audio_headers_sent = true;
 
         std::string audio_specific_config = this->create_audio_specific_config();
-        const uint32_t rtmp_body_size = 
-            sizeof(flv_tag) + sizeof(flv_audio_tag) + (uint32_t)audio_specific_config.size();
-        const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-        std::string packet(rtmp_body_size + 4, '\0');
-
-        flv_tag* tag = (flv_tag*)packet.data();
-        tag->tag_type = RTMP_PACKET_TYPE_AUDIO;
-        tag->data_size[2] = (uint8_t)flv_data_size;
-        tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-        tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-        tag->timestamp[2] = (uint8_t)timestamp_ms;
-        tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
-        tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
-        tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
-        tag->stream_id[2] = 0;
-        tag->stream_id[1] = 0;
-        tag->stream_id[0] = 0;
-
-        flv_audio_tag* audio_tag = (flv_audio_tag*)(packet.data() + sizeof(flv_tag));
+        std::string body(sizeof(flv_audio_tag) + audio_specific_config.size(), '\0');
+
+        flv_audio_tag* audio_tag = (flv_audio_tag*)body.data();
         audio_tag->sound_format = 10; // aac
         audio_tag->sound_rate = 3; // for aac always 3
         audio_tag->sound_size = 1; // only pertains to uncompressed formats
         audio_tag->sound_type = 1; // for aac always 1
         audio_tag->aac_audio_data.aac_packet_type = 0; // aac sequence header
 
-        assert_(
-            sizeof(flv_tag) + sizeof(flv_audio_tag) + audio_specific_config.size() == rtmp_body_size);
         memcpy(
-            packet.data() + sizeof(flv_tag) + sizeof(flv_audio_tag),
+            body.data() + sizeof(flv_audio_tag),
             audio_specific_config.data(),
             audio_specific_config.size());
 
-        *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
-
-        const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-        if(!res)
-            throw HR_EXCEPTION(E_UNEXPECTED);
+        this->send_message(RTMP_PACKET_TYPE_AUDIO, timestamp_ms, body);
     }
 
-    const uint32_t rtmp_body_size = 
-        sizeof(flv_tag) + sizeof(flv_audio_tag) + (uint32_t)data.size();
-    const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-    std::string packet(rtmp_body_size + 4, '\0');
+    this->message_body.resize(sizeof(flv_audio_tag) + data.size());
 
-    flv_tag* tag = (flv_tag*)packet.data();
-    tag->tag_type = RTMP_PACKET_TYPE_AUDIO;
-    tag->data_size[2] = (uint8_t)flv_data_size;
-    tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-    tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-    tag->timestamp[2] = (uint8_t)timestamp_ms;
-    tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
-    tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
-    tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
-    tag->stream_id[2] = 0;
-    tag->stream_id[1] = 0;
-    tag->stream_id[0] = 0;
-
-    flv_audio_tag* audio_tag = (flv_audio_tag*)(packet.data() + sizeof(flv_tag));
+    flv_audio_tag* audio_tag = (flv_audio_tag*)this->message_body.data();
     audio_tag->sound_format = 10;
     audio_tag->sound_rate = 3;
     audio_tag->sound_size = 0;
     audio_tag->sound_type = 1;
     audio_tag->aac_audio_data.aac_packet_type = 1; // raw aac frame data
 
-    assert_(sizeof(flv_tag) + sizeof(flv_audio_tag) + data.size() == rtmp_body_size);
     memcpy(
-        packet.data() + sizeof(flv_tag) + sizeof(flv_audio_tag),
+        this->message_body.data() + sizeof(flv_audio_tag),
         data.data(),
         data.size());
 
-    *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
-
-    const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-    if(!res)
-        throw HR_EXCEPTION(E_UNEXPECTED);
+    this->send_message(RTMP_PACKET_TYPE_AUDIO, timestamp_ms, this->message_body);
 }
 
 std::string output_rtmp::create_avc_decoder_configuration_record(
@@ -628,7 +941,9 @@ void output_rtmp::send_rtmp_video_packets(
     // TODO: padding nalus could be used to stabilize the output bitrate
     // TODO: currently a 4 byte start code prefix is assumed
 
-    std::string payload;
+    // the payload is appended to the message body after the video tag
+    std::string& payload = this->message_body;
+    payload.resize(sizeof(flv_video_tag));
 
     std::string_view data_chunk = data;
     while(nalu_start != std::string_view::npos)
@@ -670,45 +985,21 @@ void output_rtmp::send_rtmp_video_packets(
             std::string avc_decoder_configuration_record =
                 this->create_avc_decoder_configuration_record(
                     this->sps_nalu, this->pps_nalu, start_code_prefix_len);
-            const uint32_t rtmp_body_size = sizeof(flv_tag) + sizeof(flv_video_tag) +
-                (uint32_t)avc_decoder_configuration_record.size();
-            const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-            std::string packet(rtmp_body_size + 4, '\0');
-
-            flv_tag* tag = (flv_tag*)packet.data();
-            tag->tag_type = RTMP_PACKET_TYPE_VIDEO;
-            tag->data_size[2] = (uint8_t)flv_data_size;
-            tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-            tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-            tag->timestamp[2] = (uint8_t)timestamp_ms;
-            tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
-            tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
-            tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
-            tag->stream_id[2] = 0;
-            tag->stream_id[1] = 0;
-            tag->stream_id[0] = 0;
-
-            flv_video_tag* video_tag = (flv_video_tag*)(packet.data() + sizeof(flv_tag));
+            std::string body(sizeof(flv_video_tag) + avc_decoder_configuration_record.size(), '\0');
+
+            flv_video_tag* video_tag = (flv_video_tag*)body.data();
             video_tag->frame_type = key_frame ? 1 : 2;
             video_tag->codec_id = 7;
 
             video_tag->avc_video_packet.avc_packet_type = 0;
             video_tag->avc_video_packet.composition_time = 0;
 
-            assert_(
-                sizeof(flv_tag) + sizeof(flv_video_tag) + avc_decoder_configuration_record.size() ==
-                rtmp_body_size);
             memcpy(
-                packet.data() + sizeof(flv_tag) + sizeof(flv_video_tag),
+                body.data() + sizeof(flv_video_tag),
                 avc_decoder_configuration_record.data(),
                 avc_decoder_configuration_record.size());
 
-            *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
-
-            const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-            if(!res)
-                throw HR_EXCEPTION(E_UNEXPECTED);
+            this->send_message(RTMP_PACKET_TYPE_VIDEO, timestamp_ms, body);
         }
 
         if(nalu_type <= 5 || nalu_type == 6)
@@ -722,26 +1013,7 @@ void output_rtmp::send_rtmp_video_packets(
     }
 
     // send the payload
-    const uint32_t rtmp_body_size =
-        sizeof(flv_tag) + sizeof(flv_video_tag) + (uint32_t)payload.size();
-    const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-    std::string packet(rtmp_body_size + 4, '\0');
-
-    flv_tag* tag = (flv_tag*)packet.data();
-    tag->tag_type = RTMP_PACKET_TYPE_VIDEO;
-    tag->data_size[2] = (uint8_t)flv_data_size;
-    tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-    tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-    tag->timestamp[2] = (uint8_t)timestamp_ms;
-    tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
-    tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
-    tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
-    tag->stream_id[2] = 0;
-    tag->stream_id[1] = 0;
-    tag->stream_id[0] = 0;
-
-    flv_video_tag* video_tag = (flv_video_tag*)(packet.data() + sizeof(flv_tag));
+    flv_video_tag* video_tag = (flv_video_tag*)payload.data();
     video_tag->frame_type = key_frame ? 1 : 2;
     video_tag->codec_id = 7;
 
@@ -749,17 +1021,7 @@ void output_rtmp::send_rtmp_video_packets(
     int32_t composition_time = (int32_t)((double)(pts - dts) / SECOND_IN_TIME_UNIT * 1000.0);
     video_tag->avc_video_packet.composition_time = _byteswap_ulong(composition_time) >> 8;
 
-    assert_(sizeof(flv_tag) + sizeof(flv_video_tag) + (uint32_t)payload.size() == rtmp_body_size);
-    memcpy(
-        packet.data() + sizeof(flv_tag) + sizeof(flv_video_tag),
-        payload.data(),
-        payload.size());
-
-    *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
-
-    const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-    if(!res)
-        throw HR_EXCEPTION(E_UNEXPECTED);
+    this->send_message(RTMP_PACKET_TYPE_VIDEO, timestamp_ms, payload);
 }
 
 void output_rtmp::send_rtmp_packets()
@@ -814,6 +1076,7 @@ void output_rtmp::send_rtmp_packets()
                 CHECK_HR(hr = E_UNEXPECTED);
             }
 
+            latency_tracer::stamp_sample(video_sample, latency_trace::STAGE_SEND);
             this->video_samples.pop_front();
         }
         else
@@ -833,6 +1096,7 @@ void output_rtmp::send_rtmp_packets()
                 CHECK_HR(hr = E_UNEXPECTED);
             }
 
+            latency_tracer::stamp_sample(audio_sample, latency_trace::STAGE_SEND);
             this->audio_samples.pop_front();
         }
 
@@ -862,5 +1126,25 @@ void output_rtmp::write_sample(bool video, const CComPtr<IMFSample>& sample)
     else
         this->audio_samples.push_back(sample);
 
-    this->send_rtmp_packets();
+    if(this->key_frame_pending)
+        this->trim_buffered_samples();
+
+    // the samples are buffered while reconnecting
+    if(this->state == STATE_CONNECTED)
+    {
+        try
+        {
+            this->send_rtmp_packets();
+        }
+        catch(streaming::exception err)
+        {
+            // the other outputs keep running
+            LOG_ERROR("rtmp connection lost, hr {}; reconnecting", log_hex(err.get_hresult()));
+            this->disconnect();
+        }
+    }
+
+    // the samples are queued until both audio and video are available;
+    // the gauges are the sums of the queued samples of all destinations
+    this->update_queued_samples_metrics();
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 #include <string>
 #include <string_view>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 
 #define RECORDING_STOPPED_MESSAGE (WM_APP + 1)
 
@@ -16,22 +19,62 @@
 
 struct RTMP;
 
+// output_rtmp streams to a single destination;
+// multiple destinations are served by multiple instances in an output tee;
+// a lost connection is reestablished by a reconnect thread so that the pipeline threads
+// aren't blocked by the handshake; meanwhile the samples are buffered in a bounded window
+// that starts from a key frame, and the stream resumes from that key frame after
+// the metadata and the cached sequence headers have been replayed
+
 class output_rtmp final : public output_class
 {
 public:
     using scoped_lock = std::lock_guard<std::mutex>;
+    enum state_t {STATE_CONNECTED, STATE_RECONNECTING, STATE_STOPPED};
+
+    // the delay between the reconnect attempts is doubled up to the maximum
+    static constexpr int reconnect_initial_delay_ms = 100;
+    static constexpr int reconnect_max_delay_ms = 4000;
+    // connect timeout of the reconnect attempts, in seconds
+    static constexpr int reconnect_timeout = 5;
+    // the length of the buffered window while reconnecting
+    static constexpr LONGLONG reconnect_buffer_duration = SECOND_IN_TIME_UNIT * 4;
 private:
     CWindow recording_initiator;
     RTMP* rtmp;
+    // librtmp keeps pointers to the url that is passed to it
+    std::string url, streaming_key, url_buffer;
     CComPtr<IMFMediaType> video_type;
     CComPtr<IMFMediaType> audio_type;
     std::mutex write_lock;
 
     std::deque<CComPtr<IMFSample>> video_samples, audio_samples;
 
+    // the sps and pps are cached so that the sequence header can be replayed
+    // after a reconnect
     std::string sps_nalu, pps_nalu;
     bool video_headers_sent, audio_headers_sent;
 
+    // the state is guarded by the write lock
+    state_t state;
+    // set until the video resumes from a key frame after a disconnect
+    bool key_frame_pending;
+    std::chrono::steady_clock::time_point disconnect_time;
+    std::condition_variable reconnect_cv;
+    std::thread reconnect_thread;
+
+    // the messages are chunked and written to the socket directly instead of
+    // passing flv tags to RTMP_Write, which parses the tag and copies the body twice;
+    // rtmp over http uses RTMP_Write
+    bool direct_send;
+    // the buffers are reused between the messages so that sending doesn't allocate
+    std::string message_body;
+    std::string flv_tag_buffer;
+
+    // the queued sample counts that this destination has added to the gauges
+    int64_t reported_video_samples, reported_audio_samples;
+    void update_queued_samples_metrics();
+
     std::string create_avc_decoder_configuration_record(
         const std::string_view& sps_nalu, const std::string_view& pps_nalu,
         int start_code_prefix_len) const;
@@ -42,18 +85,36 @@ private:
     void send_rtmp_video_packets(const std::string_view&, LONGLONG pts, LONGLONG dts, bool key_frame);
     void send_rtmp_audio_packets(const std::string_view&, LONGLONG ts);
     void send_flv_metadata();
+    // sends an rtmp message; the body is the flv tag data
+    void send_message(uint8_t type, uint32_t timestamp_ms, const std::string_view& body);
+    // chunks the message and writes the chunks with a single vectored write
+    void send_message_direct(uint8_t type, uint32_t timestamp_ms, const std::string_view& body);
 
     void send_rtmp_packets();
+
+    // creates a connected rtmp context; the url buffer must outlive the context;
+    // a timeout of 0 keeps the default of librtmp
+    RTMP* connect(std::string& url_buffer, int timeout) const;
+    // closes the connection and starts reconnecting; called with the write lock held
+    void disconnect();
+    // sends the metadata and the buffered samples on a new connection
+    void resume();
+    // drops the buffered video samples until a key frame and bounds the buffered window
+    void trim_buffered_samples();
+    void reconnect_thread_proc();
 public:
     output_rtmp();
     ~output_rtmp();
 
+    // if reconnect_on_failure is set, a failed initial connection is retried by
+    // the reconnect thread instead of throwing
     void initialize(
         const std::string_view& url,
         const std::string_view& streaming_key,
         CWindow recording_initiator,
         const CComPtr<IMFMediaType>& video_type,
-        const CComPtr<IMFMediaType>& audio_type);
+        const CComPtr<IMFMediaType>& audio_type,
+        bool reconnect_on_failure = false);
 
     void write_sample(bool video, const CComPtr<IMFSample>& sample) override;
 };
@@ -0,0 +1,154 @@
+#include "output_tee.h"
+#include "assert.h"
+#include "logger.h"
+#include "metrics.h"
+#include <iostream>
+
+output_tee::destination::destination(
+    const output_class_t& output, drop_policy_t drop_policy, size_t max_queue_size) :
+    output(output),
+    drop_policy(drop_policy),
+    max_queue_size(max_queue_size),
+    serving(false),
+    waiting_for_key_frame(false),
+    dropped_frames(0)
+{
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+output_tee::output_tee() : dispatcher(new request_dispatcher<destination_t>)
+{
+}
+
+void output_tee::add_output(
+    const output_class_t& output, drop_policy_t drop_policy, size_t max_queue_size)
+{
+    assert_(output);
+    assert_(max_queue_size > 0);
+
+    this->destinations.push_back(
+        std::make_shared<destination>(output, drop_policy, max_queue_size));
+}
+
+void output_tee::set_key_frame_requester(const key_frame_requester_t& requester)
+{
+    output_class::set_key_frame_requester(requester);
+    for(auto&& dest : this->destinations)
+        dest->output->set_key_frame_requester(requester);
+}
+
+bool output_tee::is_key_frame(const CComPtr<IMFSample>& sample)
+{
+    return (bool)MFGetAttributeUINT32(sample, MFSampleExtension_CleanPoint, FALSE);
+}
+
+void output_tee::drop_samples(destination& dest)
+{
+    const size_t old_size = dest.samples.size();
+
+    if(dest.drop_policy == DROP_OLDEST)
+        dest.samples.pop_front();
+    else
+    {
+        // remove all video frames so that the output resumes from the next key frame;
+        // audio frames are dropped from the front only if the queue is still full
+        for(auto it = dest.samples.begin(); it != dest.samples.end();)
+        {
+            if(it->video)
+                it = dest.samples.erase(it);
+            else
+                it++;
+        }
+        if(dest.samples.size() >= dest.max_queue_size)
+            dest.samples.pop_front();
+
+        dest.waiting_for_key_frame = true;
+    }
+
+    dest.dropped_frames += old_size - dest.samples.size();
+    static metric& frames_dropped = metrics::get_counter("output_tee_frames_dropped");
+    frames_dropped.add((int64_t)(old_size - dest.samples.size()));
+    LOG_WARNING("output tee dropped {} frames (output overloading)", old_size - dest.samples.size());
+}
+
+void output_tee::serve(destination_t& dest)
+{
+    destination::sample_t sample;
+    for(;;)
+    {
+        {
+            scoped_lock lock(dest->mutex);
+            if(dest->samples.empty())
+            {
+                dest->serving = false;
+                return;
+            }
+
+            sample = std::move(dest->samples.front());
+            dest->samples.pop_front();
+        }
+
+        // the output is called outside of the lock so that the writer
+        // isn't blocked by a stalling output
+        dest->output->write_sample(sample.video, sample.sample);
+        sample.sample = NULL;
+    }
+}
+
+void output_tee::write_sample(bool video, const CComPtr<IMFSample>& sample)
+{
+    for(auto&& dest : this->destinations)
+    {
+        bool dispatch = false;
+        {
+            scoped_lock lock(dest->mutex);
+
+            if(video && dest->waiting_for_key_frame)
+            {
+                if(!is_key_frame(sample))
+                {
+                    dest->dropped_frames++;
+                    continue;
+                }
+                dest->waiting_for_key_frame = false;
+            }
+
+            if(dest->samples.size() >= dest->max_queue_size)
+            {
+                this->drop_samples(*dest);
+                // the output resumes from a forced key frame instead of waiting for the next gop
+                if(dest->waiting_for_key_frame)
+                    this->request_key_frame();
+                // the sample itself is dropped if the output must wait for a key frame
+                if(video && dest->waiting_for_key_frame)
+                {
+                    if(!is_key_frame(sample))
+                    {
+                        dest->dropped_frames++;
+                        continue;
+                    }
+                    dest->waiting_for_key_frame = false;
+                }
+            }
+
+            // samples are shared between outputs by reference
+            dest->samples.push_back({video, sample});
+
+            if(!dest->serving)
+                dest->serving = dispatch = true;
+        }
+
+        if(dispatch)
+        {
+            output_tee_t this_ = this->shared_from_this<output_tee>();
+            destination_t dispatched_dest = dest;
+            this->dispatcher->dispatch_request(std::move(dispatched_dest),
+                [this_](destination_t& dest) { this_->serve(dest); });
+        }
+    }
+}
\ No newline at end of file
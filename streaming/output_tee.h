@@ -0,0 +1,72 @@
+#pragma once
+
+#include "output_class.h"
+#include "request_dispatcher.h"
+#include "enable_shared_from_this.h"
+#include <atlbase.h>
+#include <mfapi.h>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <mutex>
+
+// output tee shares a single encoded stream between multiple outputs;
+// each output has its own bounded queue and is served by its own work item,
+// so that a slow output(network stall) won't block the other outputs or the encoder
+
+class output_tee final : public output_class, public enable_shared_from_this
+{
+public:
+    typedef std::lock_guard<std::mutex> scoped_lock;
+
+    enum drop_policy_t
+    {
+        // drops the queued video frames up to the next key frame,
+        // and audio frames from the front of the queue
+        DROP_UNTIL_KEY_FRAME,
+        // drops the oldest queued frame
+        DROP_OLDEST
+    };
+
+    struct destination
+    {
+        struct sample_t { bool video; CComPtr<IMFSample> sample; };
+
+        std::mutex mutex;
+        output_class_t output;
+        drop_policy_t drop_policy;
+        size_t max_queue_size;
+        // queue is served by at most one work item at a time
+        bool serving;
+        // incoming video frames are dropped until a key frame arrives
+        bool waiting_for_key_frame;
+        size_t dropped_frames;
+        std::deque<sample_t> samples;
+
+        destination(const output_class_t&, drop_policy_t, size_t max_queue_size);
+    };
+    typedef std::shared_ptr<destination> destination_t;
+private:
+    std::vector<destination_t> destinations;
+    std::shared_ptr<request_dispatcher<destination_t>> dispatcher;
+
+    static bool is_key_frame(const CComPtr<IMFSample>&);
+    // drops samples from the queue so that a new sample fits in
+    static void drop_samples(destination&);
+    void serve(destination_t&);
+public:
+    output_tee();
+
+    // outputs must not be added after the tee has been started
+    void add_output(
+        const output_class_t&,
+        drop_policy_t = DROP_UNTIL_KEY_FRAME,
+        size_t max_queue_size = 256);
+    size_t get_output_count() const { return this->destinations.size(); }
+
+    void write_sample(bool video, const CComPtr<IMFSample>&) override;
+    // the requester is passed to the outputs
+    void set_key_frame_requester(const key_frame_requester_t&) override;
+};
+
+typedef std::shared_ptr<output_tee> output_tee_t;
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "async_callback.h"
 #include "request_packet.h"
 #include "buffer_pool.h"
+#include "metrics.h"
 #include <functional>
 #include <memory>
 #include <mfapi.h>
@@ -103,8 +104,12 @@ public:
 
 template<class T>
 request_dispatcher<T>::request_dispatcher() : 
-    buffer_pool_state_object(new buffer_pool_state_object_t)
+    buffer_pool_state_object(new buffer_pool_state_object_t(
+        "request_dispatcher::buffer_pool_state_object"))
 {
+    static metric& dispatchers_created = metrics::get_counter("request_dispatchers_created");
+    dispatchers_created.add();
+
     this->dispatch_callback.Attach(new async_callback_t(&request_dispatcher::dispatch_cb));
 }
 
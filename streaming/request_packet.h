@@ -1,6 +1,8 @@
 #pragma once
 #include "media_topology.h"
 #include "media_sample.h"
+#include "latency_trace.h"
+#include "lock_profiler.h"
 #include "assert.h"
 #include <mutex>
 #include <deque>
@@ -27,6 +29,8 @@ struct request_packet
     time_unit timestamp;
     // cant be a negative number
     int packet_number;
+    // null if latency tracing is disabled
+    latency_trace_t trace;
 };
 
 class media_stream;
@@ -45,7 +49,7 @@ public:
         // TODO: rename to args and args_t(or payload)
         sample_t sample;
     };
-    typedef std::lock_guard<std::recursive_mutex> scoped_lock;
+    typedef std::lock_guard<profiled_mutex<std::recursive_mutex>> scoped_lock;
 private:
     struct single_request_queue
     {
@@ -53,7 +57,7 @@ private:
         int first_packet_number, last_packet_number;
     };
 private:
-    mutable std::recursive_mutex requests_mutex;
+    mutable profiled_mutex<std::recursive_mutex> requests_mutex;
     std::deque<single_request_queue> requests;
     int first_topology_number, last_topology_number;
     std::atomic_bool initialized;
@@ -88,12 +92,15 @@ public:
     // returns NULL if couldn't get
     request_t* get();
     request_t* get(int packet_number);
+    // the requests returned by get can be modified while holding this lock
+    profiled_mutex<std::recursive_mutex>& get_mutex() const {return this->requests_mutex;}
 };
 
 
 
 template<class T>
 request_queue<T>::request_queue() : 
+    requests_mutex("request_queue::requests_mutex"),
     first_topology_number(-1), last_topology_number(-1),
     initialized(false)
 {
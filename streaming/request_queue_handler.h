@@ -4,6 +4,8 @@
 #include "media_sample.h"
 #include "request_packet.h"
 #include <mutex>
+#include <deque>
+#include <optional>
 
 #pragma warning(push)
 #pragma warning(disable: 4706) // assignment within conditional expression
@@ -17,7 +19,7 @@ public:
     typedef Request request_t;
     typedef request_queue<request_t> request_queue;
 private:
-    std::mutex serve_mutex, request_queue_mutex;
+    profiled_mutex<std::mutex> serve_mutex, request_queue_mutex;
 protected:
     request_queue requests;
     // returns true if the request should be popped from the queue;
@@ -27,12 +29,60 @@ protected:
     // singlethreaded
     virtual typename request_queue::request_t* next_request() = 0;
 public:
+    request_queue_handler() :
+        serve_mutex("request_queue_handler::serve_mutex"),
+        request_queue_mutex("request_queue_handler::request_queue_mutex") {}
     virtual ~request_queue_handler() {}
 
     // multithread safe
     void serve();
 };
 
+// helper base class for pipelined request serving;
+// the requests are served serially, processed concurrently and completed
+// in the order they were served;
+// this allows the processing of a request to overlap with the processing of
+// the previous requests and with the downstream components
+
+template<class Request, class Result>
+class pipelined_request_queue_handler : public request_queue_handler<Request>
+{
+public:
+    typedef Result result_t;
+    typedef std::lock_guard<std::mutex> scoped_lock;
+    // identifies a request in the pipeline
+    typedef int ticket_t;
+private:
+    std::mutex completion_mutex;
+    // the results of the requests in flight in the order they were served;
+    // a result is empty until its request has been processed
+    std::deque<std::optional<result_t>> completions;
+    ticket_t first_ticket;
+    bool completing;
+protected:
+    // returns whether another request can be begun;
+    // next_request should return NULL if this returns false
+    bool can_begin_request();
+    // reserves the completion slot for a request;
+    // singlethreaded(must be called from on_serve)
+    ticket_t begin_request();
+    // stores the result and completes the consecutive processed requests in order;
+    // multithread safe
+    void end_request(ticket_t, result_t&&);
+    // called in the order the requests were begun;
+    // singlethreaded
+    virtual void on_complete(result_t&) = 0;
+public:
+    const int max_in_flight;
+
+    explicit pipelined_request_queue_handler(int max_in_flight) :
+        first_ticket(0), completing(false), max_in_flight(max_in_flight)
+    {
+        assert_(max_in_flight > 0);
+    }
+    virtual ~pipelined_request_queue_handler() {}
+};
+
 
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -42,7 +92,7 @@ public:
 template<typename T>
 void request_queue_handler<T>::serve()
 {
-    std::unique_lock<std::mutex> request_queue_lock(this->request_queue_mutex),
+    std::unique_lock<profiled_mutex<std::mutex>> request_queue_lock(this->request_queue_mutex),
         serve_lock(this->serve_mutex, std::try_to_lock);
 
     if(!serve_lock)
@@ -63,4 +113,67 @@ void request_queue_handler<T>::serve()
     }
 }
 
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+template<typename T, typename U>
+bool pipelined_request_queue_handler<T, U>::can_begin_request()
+{
+    scoped_lock lock(this->completion_mutex);
+    return this->completions.size() < (size_t)this->max_in_flight;
+}
+
+template<typename T, typename U>
+typename pipelined_request_queue_handler<T, U>::ticket_t
+pipelined_request_queue_handler<T, U>::begin_request()
+{
+    scoped_lock lock(this->completion_mutex);
+    this->completions.emplace_back();
+    return this->first_ticket + (ticket_t)this->completions.size() - 1;
+}
+
+template<typename T, typename U>
+void pipelined_request_queue_handler<T, U>::end_request(ticket_t ticket, result_t&& result)
+{
+    {
+        scoped_lock lock(this->completion_mutex);
+        const size_t index = (size_t)(ticket - this->first_ticket);
+        assert_(index < this->completions.size() && !this->completions[index]);
+        this->completions[index] = std::move(result);
+
+        // the thread that is already completing will complete this request
+        if(this->completing)
+            return;
+        this->completing = true;
+    }
+
+    bool completed = false;
+    for(;;)
+    {
+        std::optional<result_t> completion;
+        {
+            scoped_lock lock(this->completion_mutex);
+            if(this->completions.empty() || !this->completions.front())
+            {
+                this->completing = false;
+                break;
+            }
+
+            completion = std::move(this->completions.front());
+            this->completions.pop_front();
+            this->first_ticket++;
+        }
+
+        this->on_complete(*completion);
+        completed = true;
+    }
+
+    // serve the requests that were held back by the in flight limit
+    if(completed)
+        this->serve();
+}
+
 #pragma warning(pop)
\ No newline at end of file
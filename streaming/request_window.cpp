@@ -0,0 +1,84 @@
+#include "request_window.h"
+#include <algorithm>
+
+#undef min
+#undef max
+
+request_window::request_window(const std::string& name, int initial_window) :
+    requests(0),
+    window(std::min(std::max(initial_window, min_window), max_window)),
+    completions_since_decrease(0),
+    dropped(false),
+    target_latency(0),
+    latency(0),
+    requests_metric(metrics::get_gauge(name + "_requests_in_flight")),
+    window_metric(metrics::get_gauge(name + "_request_window")),
+    latency_metric(metrics::get_gauge(name + "_request_latency_us"))
+{
+    this->window_metric.set(this->window);
+}
+
+void request_window::set_frame_interval(time_unit interval)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->target_latency = interval * target_latency_frames;
+}
+
+bool request_window::begin_request(bool no_drop)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if(this->requests >= this->window && !no_drop)
+    {
+        this->dropped = true;
+        return false;
+    }
+
+    this->requests_metric.set(++this->requests);
+    return true;
+}
+
+void request_window::end_request(time_unit latency)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    this->requests_metric.set(--this->requests);
+    this->completions_since_decrease++;
+
+    // exponential moving average with a weight of 1/8
+    this->latency += (latency - this->latency) / 8;
+    latency = this->latency;
+    this->latency_metric.set(latency / 10);
+
+    // the window isn't adapted until the frame interval is known
+    if(this->target_latency <= 0)
+        return;
+
+    if(latency > this->target_latency)
+    {
+        // the pipeline is queueing up requests; the window is halved so that
+        // the latency stays bounded and the excess requests are dropped at the sink
+        if(this->completions_since_decrease >= this->window && this->window > min_window)
+        {
+            this->window = std::max(this->window / 2, min_window);
+            this->completions_since_decrease = 0;
+            this->window_metric.set(this->window);
+        }
+    }
+    else if(this->dropped)
+    {
+        // requests were dropped even though the pipeline completes them in time
+        this->dropped = false;
+        if(this->window < max_window)
+        {
+            this->window++;
+            this->window_metric.set(this->window);
+        }
+    }
+}
+
+int request_window::get_window()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->window;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "media_sample.h"
+#include "metrics.h"
+#include <mutex>
+#include <string>
+
+// adaptive limit for the amount of requests a sink has in flight;
+// the window grows additively when requests are dropped while the pipeline keeps up,
+// and shrinks multiplicatively when the smoothed request latency exceeds the target;
+// the latency is measured from the due time of a request to its completion;
+// the window lives in the sink so that topology switching doesn't reset it
+
+class request_window final
+{
+public:
+    static constexpr int min_window = 1, max_window = 8;
+    // the target latency in frame intervals
+    static constexpr int target_latency_frames = 3;
+private:
+    std::mutex mutex;
+    int requests;
+    int window;
+    // the window is decreased at most once per window of completed requests
+    int completions_since_decrease;
+    bool dropped;
+    time_unit target_latency;
+    // smoothed latency, so that a single slow request doesn't shrink the window
+    time_unit latency;
+
+    metric& requests_metric;
+    metric& window_metric;
+    metric& latency_metric;
+public:
+    // the metrics are named after the name
+    request_window(const std::string& name, int initial_window);
+
+    // sets the interval between requests that the target latency is based on
+    void set_frame_interval(time_unit);
+
+    // returns false if the window is full, in which case the request should be dropped;
+    // no drop forces the request to be begun
+    bool begin_request(bool no_drop = false);
+    // latency is the time between the due time and the completion of the request
+    void end_request(time_unit latency);
+
+    int get_window();
+};
\ No newline at end of file
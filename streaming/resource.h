@@ -46,6 +46,9 @@
 #define IDC_SHOWKEY                     1050
 #define IDC_OPENFOLDER                  1051
 #define IDC_EDIT6                       1052
+#define IDC_CHECK2                      1053
+#define IDC_COMBO6                      1054
+#define IDC_CHECK3                      1055
 #define ID_ABOUT                        40001
 #define ID_FILE                         40002
 #define ID_DEBUG                        40003
@@ -60,7 +63,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        131
 #define _APS_NEXT_COMMAND_VALUE         40008
-#define _APS_NEXT_CONTROL_VALUE         1052
+#define _APS_NEXT_CONTROL_VALUE         1056
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
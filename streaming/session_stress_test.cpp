@@ -0,0 +1,305 @@
+#include "session_stress_test.h"
+#include "media_session.h"
+#include "media_component.h"
+#include "media_stream.h"
+#include "media_topology.h"
+#include "media_message_generator.h"
+#include "request_packet.h"
+#include "logger.h"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <set>
+#include <random>
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+
+class stress_component;
+class stress_sink_stream;
+
+struct stress_state
+{
+    std::mutex mutex;
+    // the topology that the requesting threads use; set when the session starts it
+    media_topology_t topology;
+    media_stream* sink_stream;
+
+    std::atomic_int issued_requests{0}, completed_requests{0}, last_packets{0};
+};
+
+// shared between all topologies of the test
+class stress_component final : public media_component
+{
+private:
+    std::mutex serve_mutex;
+    // the requests whose samples have arrived; the key is the topology and the packet number
+    std::set<std::pair<int, int>> arrived;
+    int last_topology_number, last_packet_number;
+public:
+    request_queue<bool> requests;
+    std::atomic_bool failed;
+    std::atomic_int served_requests;
+
+    explicit stress_component(const media_session_t& session) :
+        media_component(session),
+        last_topology_number(-1), last_packet_number(INVALID_PACKET_NUMBER),
+        failed(false), served_requests(0) {}
+
+    // serves the arrived requests in the queue order
+    void serve(const request_packet& arrived_rp);
+};
+
+typedef std::shared_ptr<stress_component> stress_component_t;
+
+class stress_component_stream final : public media_stream
+{
+private:
+    stress_component_t component;
+public:
+    explicit stress_component_stream(const stress_component_t& component) :
+        component(component) {}
+
+    result_t request_sample(const request_packet&, const media_stream*) override;
+    result_t process_sample(
+        const media_component_args*, const request_packet&, const media_stream*) override;
+};
+
+// serves the samples in the request chain with random delays, so that the chains interleave
+class stress_source_stream final : public media_stream
+{
+private:
+    media_session_t session;
+public:
+    explicit stress_source_stream(const media_session_t& session) :
+        media_stream(SOURCE), session(session) {}
+
+    result_t request_sample(const request_packet&, const media_stream*) override;
+    result_t process_sample(
+        const media_component_args*, const request_packet&, const media_stream*) override
+    { return OK; }
+};
+
+class stress_sink_stream final : public media_stream_message_listener
+{
+private:
+    media_session_t session;
+    stress_state& state;
+    void on_stream_start(time_unit) override;
+public:
+    stress_sink_stream(const media_component* component, const media_session_t& session,
+        stress_state& state) :
+        media_stream_message_listener(component), session(session), state(state) {}
+
+    result_t request_sample(const request_packet&, const media_stream*) override;
+    result_t process_sample(
+        const media_component_args*, const request_packet&, const media_stream*) override;
+};
+
+void stress_component::serve(const request_packet& arrived_rp)
+{
+    std::lock_guard<std::mutex> lock(this->serve_mutex);
+    this->arrived.insert(
+        std::make_pair(arrived_rp.topology->get_topology_number(), arrived_rp.packet_number));
+
+    request_queue<bool>::request_t request;
+    while(this->requests.get(request))
+    {
+        const auto key = std::make_pair(
+            request.rp.topology->get_topology_number(), request.rp.packet_number);
+        if(this->arrived.erase(key) == 0)
+            break;
+
+        const bool popped = this->requests.pop();
+        assert_(popped); popped;
+
+        // the topologies are served in the switch order and the packets of a topology
+        // are served in the numbering order
+        if(key.first != this->last_topology_number)
+        {
+            if(key.first < this->last_topology_number || key.second != 0)
+                this->failed = true;
+        }
+        else if(key.second != this->last_packet_number + 1)
+            this->failed = true;
+
+        this->last_topology_number = key.first;
+        this->last_packet_number = key.second;
+        this->served_requests++;
+
+        if(!this->session->give_sample(request.stream, NULL, request.rp))
+            this->failed = true;
+    }
+}
+
+media_stream::result_t stress_component_stream::request_sample(
+    const request_packet& rp, const media_stream*)
+{
+    this->component->requests.initialize_queue(rp);
+
+    request_queue<bool>::request_t request;
+    request.rp = rp;
+    request.stream = this;
+    request.sample = false;
+    this->component->requests.push(request);
+
+    if(!this->component->session->request_sample(this, rp))
+        return FATAL_ERROR;
+    return OK;
+}
+
+media_stream::result_t stress_component_stream::process_sample(
+    const media_component_args*, const request_packet& rp, const media_stream*)
+{
+    this->component->serve(rp);
+    return OK;
+}
+
+media_stream::result_t stress_source_stream::request_sample(
+    const request_packet& rp, const media_stream*)
+{
+    thread_local std::minstd_rand random_generator(
+        (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    if(random_generator() % 4 == 0)
+        std::this_thread::yield();
+
+    if(!this->session->give_sample(this, NULL, rp))
+        return FATAL_ERROR;
+    return OK;
+}
+
+void stress_sink_stream::on_stream_start(time_unit)
+{
+    // called by the session when it switches to the topology of this stream
+    std::lock_guard<std::mutex> lock(this->state.mutex);
+    this->state.topology = this->get_topology();
+    this->state.sink_stream = this;
+}
+
+media_stream::result_t stress_sink_stream::request_sample(
+    const request_packet& rp, const media_stream*)
+{
+    if(rp.flags & FLAG_LAST_PACKET)
+        this->state.last_packets++;
+
+    if(!this->session->request_sample(this, rp))
+        return FATAL_ERROR;
+    return OK;
+}
+
+media_stream::result_t stress_sink_stream::process_sample(
+    const media_component_args*, const request_packet&, const media_stream*)
+{
+    this->state.completed_requests++;
+    return OK;
+}
+
+media_topology_t create_topology(const media_session_t& session,
+    const stress_component_t& component, stress_state& state)
+{
+    media_topology_t topology(
+        new media_topology(media_message_generator_t(new media_message_generator)));
+
+    std::shared_ptr<stress_sink_stream> sink_stream(
+        new stress_sink_stream(component.get(), session, state));
+    media_stream_t component_stream(new stress_component_stream(component));
+    media_stream_t source_stream(new stress_source_stream(session));
+
+    sink_stream->register_listener(topology->get_message_generator());
+    source_stream->connect_streams(sink_stream, topology);
+    component_stream->connect_streams(source_stream, topology);
+    sink_stream->connect_streams(component_stream, topology);
+
+    return topology;
+}
+
+// waits until the condition is true; returns false on timeout
+template<typename F>
+bool wait_for(F&& condition)
+{
+    using namespace std::chrono;
+    const steady_clock::time_point timeout = steady_clock::now() + seconds(10);
+    while(!condition())
+    {
+        if(steady_clock::now() > timeout)
+            return false;
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    return true;
+}
+
+}
+
+bool run_session_stress_test(int thread_count, int topology_count)
+{
+    if(thread_count <= 0 || topology_count <= 0)
+        return false;
+
+    media_session_t session(new media_session(media_clock_t(new media_clock), 60, 1));
+    stress_component_t component(new stress_component(session));
+    stress_state state;
+
+    session->start_playback(create_topology(session, component, state), 0);
+
+    std::atomic_bool stopping(false);
+    std::atomic<time_unit> request_time(0);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < thread_count; i++)
+        threads.emplace_back([&]()
+            {
+                while(!stopping)
+                {
+                    request_packet rp;
+                    media_topology_t topology;
+                    media_stream* sink_stream;
+                    {
+                        std::lock_guard<std::mutex> lock(state.mutex);
+                        topology = state.topology;
+                        sink_stream = state.sink_stream;
+                    }
+
+                    rp.flags = 0;
+                    rp.request_time = rp.timestamp = request_time++;
+                    // the requests of the stopped topology are rejected after its last packet
+                    if(session->begin_request_sample(sink_stream, rp, topology))
+                        state.issued_requests++;
+                }
+            });
+
+    // the next switch is published after the previous topology has numbered its last packet,
+    // like the video sink does
+    bool passed = true;
+    for(int i = 1; i <= topology_count && passed; i++)
+    {
+        const int issued = state.issued_requests;
+        passed = wait_for([&] {return state.issued_requests - issued >= thread_count;});
+        session->switch_topology(create_topology(session, component, state));
+        passed = passed && wait_for([&] {return state.last_packets == i;});
+    }
+
+    stopping = true;
+    for(auto&& thread : threads)
+        thread.join();
+
+    passed = passed && !component->failed &&
+        state.completed_requests == state.issued_requests &&
+        component->served_requests == state.issued_requests;
+
+    std::cout << "session stress test " << (passed ? "passed" : "failed") <<
+        ", threads: " << thread_count << ", topologies: " << topology_count <<
+        ", requests issued: " << state.issued_requests <<
+        ", completed: " << state.completed_requests << std::endl;
+
+    // break the circular references between the topology and the streams
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.topology = nullptr;
+    }
+    session->start_playback(media_topology_t(
+        new media_topology(media_message_generator_t(new media_message_generator))), 0);
+
+    return passed;
+}
\ No newline at end of file
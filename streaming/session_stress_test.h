@@ -0,0 +1,13 @@
+#pragma once
+
+// stress test for the concurrent request chains of the media session;
+// several threads request samples through a component that is shared between the successive
+// topologies while the topologies are switched continuously;
+// the component checks that the requests are served in the packet number order within
+// a topology, that the topologies are served in the switch order and that every request
+// is served;
+// the test uses the session, topology and request queue classes without the rest of
+// the pipeline; media foundation must be started
+
+// returns false if the test failed
+bool run_session_stress_test(int thread_count, int topology_count);
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "sink_audio.h"
+#include "logger.h"
+#include "metrics.h"
 #include <iostream>
 
 #undef min
@@ -6,8 +8,14 @@
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
 
-sink_audio::sink_audio(const media_session_t& session) : media_sink(session)
+sink_audio::sink_audio(const media_session_t& session) : 
+    media_sink(session),
+    window("audio_sink", DEFAULT_MAX_REQUESTS)
 {
+    // the audio is requested at the length of one aac encoder packet;
+    // the frame rate of the audio session equals to the sample rate
+    this->window.set_frame_interval(
+        convert_to_time_unit(1024, session->frame_rate_num, session->frame_rate_den));
 }
 
 void sink_audio::initialize()
@@ -33,8 +41,7 @@ stream_audio::stream_audio(const sink_audio_t& sink) :
     media_stream_message_listener(sink.get()), 
     stopping(false),
     stop_point(std::numeric_limits<time_unit>::min()),
-    requesting(false),
-    requests(0), max_requests(DEFAULT_MAX_REQUESTS)
+    requesting(false)
 {
 }
 
@@ -54,10 +61,8 @@ void stream_audio::dispatch_request(const request_packet& incomplete_rp, bool no
 {
     assert_(this->unavailable <= 240);
 
-    const int requests = this->requests.load();
-    if(requests < this->max_requests || no_drop)
+    if(this->sink->window.begin_request(no_drop))
     {
-        this->requests++;
         this->unavailable = 0;
 
         assert_(this->topology);
@@ -67,7 +72,9 @@ void stream_audio::dispatch_request(const request_packet& incomplete_rp, bool no
     {
         this->unavailable++;
 
-        std::cout << "--SAMPLE REQUEST DROPPED IN AUDIO_SINK--" << std::endl;
+        static metric& requests_dropped = metrics::get_counter("audio_sink_requests_dropped");
+        requests_dropped.add();
+        LOG_WARNING("sample request dropped in audio sink");
     }
 }
 
@@ -87,8 +94,9 @@ media_stream::result_t stream_audio::request_sample(const request_packet& rp, co
 }
 
 media_stream::result_t stream_audio::process_sample(
-    const media_component_args*, const request_packet&, const media_stream*)
+    const media_component_args*, const request_packet& rp, const media_stream*)
 {
-    this->requests--;
+    const media_clock_t& clock = this->sink->session->get_clock();
+    this->sink->window.end_request(clock ? clock->get_current_time() - rp.timestamp : 0);
     return OK;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "async_callback.h"
 #include "output_file.h"
 #include "transform_aac_encoder.h"
+#include "request_window.h"
 #include "assert.h"
 #include <vector>
 #include <mutex>
@@ -21,6 +22,7 @@ class sink_audio : public media_sink
 public:
     typedef std::lock_guard<std::recursive_mutex> scoped_lock;
 private:
+    request_window window;
 public:
     explicit sink_audio(const media_session_t& session);
 
@@ -42,9 +44,6 @@ private:
     bool stopping;
     time_unit stop_point;
 
-    std::atomic_int requests;
-    int max_requests;
-
     // for debug
     int unavailable;
     /*bool ran_once, stopped;*/
@@ -109,6 +109,8 @@ bool sink_file<T>::on_serve(typename request_queue::request_t& request)
 {
     if(request.sample)
     {
+        latency_tracer::stamp(request.rp.trace, latency_trace::STAGE_OUTPUT);
+
         for(const auto& frame : request.sample->sample->frames)
         {
             const LONGLONG timestamp = (LONGLONG)frame.ts;
@@ -116,6 +118,9 @@ bool sink_file<T>::on_serve(typename request_queue::request_t& request)
 
             // TODO: print if frames in wrong order
 
+            // the output stamps the trace when the sample has been sent
+            latency_tracer::attach(frame.sample, request.rp.trace);
+
             this->last_timestamp = timestamp;
             this->output->write_sample(this->video, frame.sample);
         }
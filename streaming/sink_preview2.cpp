@@ -24,7 +24,7 @@ void sink_preview2::initialize(
     const CComPtr<ID3D11Device>& d3d11dev,
     const CComPtr<ID2D1Factory1>& d2d1factory,
     const CComPtr<ID2D1Device>& d2d1dev,
-    std::recursive_mutex& context_mutex)
+    context_mutex_t::element_type& context_mutex)
 {
     this->d3d11dev = d3d11dev;
     this->d2d1factory = d2d1factory;
@@ -42,7 +42,7 @@ void sink_preview2::initialize(
     DXGI_SWAP_CHAIN_DESC1 swapchain_desc = {0};
 
     std::lock(context_mutex, this->d2d1_context_mutex);
-    scoped_lock lock(context_mutex, std::adopt_lock);
+    std::lock_guard<context_mutex_t::element_type> lock(context_mutex, std::adopt_lock);
     scoped_lock lock2(this->d2d1_context_mutex, std::adopt_lock);
 
     // obtain the dxgi device of the d3d11 device
@@ -136,10 +136,12 @@ void sink_preview2::update_preview_sample(const media_component_args* args_)
 
     if(args)
     {
-        // find the first available bitmap
+        // find the first available bitmap;
+        // the frames of the cpu videomixer are in system memory
         for(const auto& item : args->sample->get_frames())
         {
-            if(item.buffer && item.buffer->bitmap)
+            if(item.buffer && (item.buffer->bitmap ||
+                dynamic_cast<const media_buffer_memory_texture*>(item.buffer.get())))
             {
                 std::atomic_store(&this->last_buffer, item.buffer);
                 break;
@@ -148,6 +150,54 @@ void sink_preview2::update_preview_sample(const media_component_args* args_)
     }
 }
 
+CComPtr<ID2D1Bitmap1> sink_preview2::get_last_bitmap()
+{
+    HRESULT hr = S_OK;
+    const media_buffer_texture_t last_buffer = this->get_last_buffer();
+    const media_buffer_memory_texture* buffer =
+        dynamic_cast<const media_buffer_memory_texture*>(last_buffer.get());
+
+    if(!last_buffer)
+        return NULL;
+    if(!buffer)
+        return last_buffer->bitmap;
+    if(last_buffer == this->memory_bitmap_buffer)
+        return this->memory_bitmap;
+
+    // the bitmap is recreated if the canvas size changes
+    if(this->memory_bitmap)
+    {
+        const D2D1_SIZE_U size = this->memory_bitmap->GetPixelSize();
+        if(size.width != buffer->width || size.height != buffer->height)
+            this->memory_bitmap = NULL;
+    }
+    if(!this->memory_bitmap)
+    {
+        const D2D1_BITMAP_PROPERTIES1 bitmap_props = D2D1::BitmapProperties1(
+            D2D1_BITMAP_OPTIONS_NONE,
+            D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE));
+        CHECK_HR(hr = this->d2d1devctx->CreateBitmap(
+            D2D1::SizeU(buffer->width, buffer->height),
+            buffer->texture_buffer.get(), buffer->pitch, bitmap_props, &this->memory_bitmap));
+    }
+    else
+        CHECK_HR(hr = this->memory_bitmap->CopyFromMemory(
+            NULL, buffer->texture_buffer.get(), buffer->pitch));
+
+    this->memory_bitmap_buffer = last_buffer;
+
+done:
+    if(FAILED(hr))
+    {
+        // the preview is skipped
+        PRINT_ERROR(hr);
+        this->memory_bitmap = NULL;
+        this->memory_bitmap_buffer = NULL;
+    }
+
+    return this->memory_bitmap;
+}
+
 media_stream_t sink_preview2::create_stream()
 {
     return stream_preview2_t(new stream_preview2(this->shared_from_this<sink_preview2>()));
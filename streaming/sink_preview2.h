@@ -17,6 +17,10 @@ public:
     using scoped_lock = std::lock_guard<std::recursive_mutex>;
 private:
     media_buffer_texture_t last_buffer;
+    // the bitmap that the frames in system memory are uploaded to and the frame
+    // that was uploaded last; guarded by the d2d1 context mutex
+    CComPtr<ID2D1Bitmap1> memory_bitmap;
+    media_buffer_texture_t memory_bitmap_buffer;
 
     void update_preview_sample(const media_component_args*);
 public:
@@ -41,10 +45,14 @@ public:
         const CComPtr<ID3D11Device>&,
         const CComPtr<ID2D1Factory1>&,
         const CComPtr<ID2D1Device>&,
-        std::recursive_mutex& context_mutex);
+        context_mutex_t::element_type& context_mutex);
     media_stream_t create_stream();
 
     media_buffer_texture_t get_last_buffer() const { return std::atomic_load(&this->last_buffer); }
+    // returns the bitmap of the last frame, or null if there's no frame;
+    // the frames of the cpu videomixer are uploaded to a bitmap;
+    // the d2d1 context mutex must be held
+    CComPtr<ID2D1Bitmap1> get_last_bitmap();
 };
 
 typedef std::shared_ptr<sink_preview2> sink_preview2_t;
@@ -1,5 +1,7 @@
 #include "sink_video.h"
 #include "transform_aac_encoder.h"
+#include "logger.h"
+#include "metrics.h"
 #include <iostream>
 #include <Mferror.h>
 
@@ -16,8 +18,11 @@
 sink_video::sink_video(const media_session_t& session, const media_session_t& audio_session) : 
     media_sink(session),
     audio_session(audio_session),
-    started(false), instant_switch(false)
+    started(false), instant_switch(false),
+    window("video_sink", DEFAULT_MAX_REQUESTS)
 {
+    this->window.set_frame_interval(
+        convert_to_time_unit(1, session->frame_rate_num, session->frame_rate_den));
 }
 
 sink_video::~sink_video()
@@ -89,7 +94,6 @@ stream_video::stream_video(
     stopping(false),
     discontinuity(false),
     requesting(false),
-    requests(0), max_requests(DEFAULT_MAX_REQUESTS),
     video_next_due_time(-1)
 {
 }
@@ -244,8 +248,7 @@ void stream_video::schedule_new(time_unit due_time)
             this->discontinuity = true;
 
             // at least one frame request was late
-            std::cout << "---------------------------------------------------------------"
-                "-----------------------------" << std::endl;
+            LOG_WARNING("video sink request was late");
 
             const time_unit current_time = t->get_current_time();
             this->video_next_due_time = this->get_next_due_time(current_time);
@@ -265,10 +268,12 @@ void stream_video::dispatch_request(const request_packet& incomplete_rp, bool no
 
     assert_(drops <= 1000);*/
 
-    const int requests = this->requests.load();
-    if(requests < this->max_requests || no_drop)
+    static metric& requests_dropped = metrics::get_counter("video_sink_requests_dropped");
+    static metric& requests_dropped_overloading =
+        metrics::get_counter("video_sink_requests_dropped_encoder_overloading");
+
+    if(this->sink->window.begin_request(no_drop))
     {
-        this->requests++;
         this->unavailable = 0;
 
         assert_(this->topology);
@@ -279,10 +284,13 @@ void stream_video::dispatch_request(const request_packet& incomplete_rp, bool no
         this->discontinuity = true;
         this->unavailable++;
 
-        std::cout << "--SAMPLE REQUEST DROPPED IN VIDEO_SINK--";
-        if(this->encoder_stream && this->encoder_stream->get_transform()->is_encoder_overloading())
-            std::cout << " (encoder overloading)";
-        std::cout << std::endl;
+        const bool encoder_overloading = this->encoder_stream &&
+            this->encoder_stream->get_transform()->is_encoder_overloading();
+        requests_dropped.add();
+        if(encoder_overloading)
+            requests_dropped_overloading.add();
+        LOG_WARNING("sample request dropped in video sink{}",
+            encoder_overloading ? " (encoder overloading)" : "");
 
         /*drops++;*/
     }
@@ -304,13 +312,14 @@ media_stream::result_t stream_video::request_sample(const request_packet& rp, co
 }
 
 media_stream::result_t stream_video::process_sample(
-    const media_component_args*, const request_packet&, const media_stream*)
+    const media_component_args*, const request_packet& rp, const media_stream*)
 {
     // TODO: request count should be dropped only after the request packet has been destroyed
 
     // multithreaded
 
-    this->requests--;
+    const media_clock_t& clock = this->sink->session->get_clock();
+    this->sink->window.end_request(clock ? clock->get_current_time() - rp.timestamp : 0);
 
     return OK;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "media_session.h"
 #include "transform_h264_encoder.h"
 #include "output_file.h"
+#include "request_window.h"
 #include "assert.h"
 #include <vector>
 #include <mutex>
@@ -41,6 +42,8 @@ private:
     media_topology_t pending_audio_topology;
 
     bool instant_switch;
+
+    request_window window;
 public:
     sink_video(const media_session_t& session, const media_session_t& audio_session);
     ~sink_video();
@@ -83,11 +86,6 @@ private:
 
     stream_audio_t audio_sink_stream;
 
-    // TODO: this probably should be moved to sink_video, so that topology switching doesn't
-    // reset the request limit
-    std::atomic_int requests;
-    int max_requests;
-
     // for debug
     int unavailable;
 
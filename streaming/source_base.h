@@ -23,6 +23,21 @@
 template<class SourceBase>
 class stream_source_base;
 
+// observes the samples that a source serves;
+// source_recorder uses this for recording the arrival pattern of the samples
+template<class Args>
+class source_tap
+{
+public:
+    virtual ~source_tap() {}
+
+    // called after make_request for the requests of the active topology;
+    // samples_end is valid only if valid_end is true; args can be null;
+    // singlethreaded
+    virtual void on_make_request(time_unit request_time, bool valid_end, frame_unit samples_end,
+        const std::optional<Args>&) = 0;
+};
+
 template<class Args>
 class source_base : public media_component
 {
@@ -41,11 +56,18 @@ private:
     mutable std::mutex active_topology_mutex;
     std::vector<media_topology_t> active_topology;
     std::atomic<bool> broken_flag;
+    std::shared_ptr<source_tap<Args>> tap;
+    // the dispatchers are shared by the streams of the source, so that rebuilding the topology
+    // only allocates the streams for the sources that stay in the topology
+    std::shared_ptr<request_dispatcher<void*>> serve_dispatcher;
+    std::shared_ptr<request_dispatcher<request_t>> dispatcher;
 
     // set_broken must be used instead
     using media_component::request_reinitialization;
 protected:
     control_class_t ctrl_pipeline;
+    // null if the lateness of the source isn't measured
+    jitter_buffer::source_statistics_t jitter_statistics;
 
     // derived class must call this
     void initialize(const control_class_t& ctrl_pipeline);
@@ -76,6 +98,8 @@ public:
     virtual ~source_base();
 
     bool is_broken() const { return this->broken_flag; }
+    // the tap must be set before the streams of the source are created
+    void set_tap(const std::shared_ptr<source_tap<Args>>& tap) { this->tap = tap; }
 
     stream_source_base_t create_stream(media_message_generator_t&& message_generator);
 };
@@ -129,7 +153,9 @@ public:
 template<typename T>
 source_base<T>::source_base(const media_session_t& session) :
     media_component(session),
-    broken_flag(false)
+    broken_flag(false),
+    serve_dispatcher(new request_dispatcher<void*>),
+    dispatcher(new request_dispatcher<request_t>)
 {
 }
 
@@ -149,6 +175,8 @@ template<typename T>
 void source_base<T>::initialize(const control_class_t& ctrl_pipeline)
 {
     this->ctrl_pipeline = ctrl_pipeline;
+    if(this->session->jitter_buffer)
+        this->jitter_statistics = this->session->jitter_buffer->register_source();
 }
 
 template<typename T>
@@ -171,8 +199,8 @@ stream_source_base<T>::stream_source_base(const source_base_t& source) :
     media_stream_message_listener(source.get(), SOURCE),
     source(source),
     drainable_or_drained(false),
-    dispatcher(new request_dispatcher),
-    serve_dispatcher(new ::request_dispatcher<void*>)
+    serve_dispatcher(source->serve_dispatcher),
+    dispatcher(source->dispatcher)
 {
 }
 
@@ -268,7 +296,7 @@ bool stream_source_base<T>::on_serve(typename request_queue::request_t& request)
     // only serve the request with samples if the request originates from the active topology
     if(active_topology == request.rp.topology)
     {
-        frame_unit samples_end;
+        frame_unit samples_end = 0;
         const frame_unit request_end = convert_to_frame_unit(request.rp.request_time,
             this->source->session->frame_rate_num,
             this->source->session->frame_rate_den);
@@ -281,10 +309,21 @@ bool stream_source_base<T>::on_serve(typename request_queue::request_t& request)
             const frame_unit end = std::min(request_end, samples_end);
             // make_request is allowed to set the args in request to null
             this->make_request(request, end);
+
+            // the lateness of the samples adapts the latency of the buffering sources
+            if(this->source->jitter_statistics)
+                this->source->session->jitter_buffer->add_lateness(
+                    *this->source->jitter_statistics, request.rp.request_time,
+                    request.rp.request_time - convert_to_time_unit(samples_end,
+                        this->source->session->frame_rate_num,
+                        this->source->session->frame_rate_den));
         }
         else
             assert_(!request.sample.args);
 
+        if(this->source->tap)
+            this->source->tap->on_make_request(
+                request.rp.request_time, valid_end, samples_end, request.sample.args);
     }
     else
         assert_(!request.sample.args);
@@ -4,12 +4,15 @@
 #include "media_stream.h"
 #include "transform_videomixer.h"
 #include "transform_audiomixer2.h"
+#include "metrics.h"
 #include <memory>
 
 // forces transform_mixer to buffer samples by serving samples by a predefined latency;
 // it is used to make sure that a topology switch to sources with different latencies
 // won't cause frame drops;
-// it also stabilizes the processing interval of samples in mixing and encoding stages
+// it also stabilizes the processing interval of samples in mixing and encoding stages;
+// if the session has a jitter buffer, the latency adapts to the measured lateness of
+// the other sources, and the initialized latency is used only without a jitter buffer
 
 template<class OutArgs>
 class stream_buffering;
@@ -75,6 +78,9 @@ void source_buffering<T>::initialize(const control_class_t& ctrl_pipeline, time_
 {
     this->source_base<T>::initialize(ctrl_pipeline);
     this->latency = latency;
+
+    // the buffering source itself is not measured
+    this->jitter_statistics.reset();
 }
 
 template<class T>
@@ -87,7 +93,17 @@ template<class T>
 bool source_buffering<T>::get_samples_end(time_unit /*request_time*/, frame_unit& end) const
 {
     media_clock_t clock = this->session->get_clock();
-    end = convert_to_frame_unit(clock->get_current_time() - this->latency,
+    const time_unit current_time = clock->get_current_time();
+
+    time_unit latency = this->latency;
+    if(this->session->jitter_buffer)
+    {
+        static metric& latency_gauge = metrics::get_gauge("buffering_latency_ms");
+        latency = this->session->jitter_buffer->get_latency(current_time);
+        latency_gauge.set(latency / 10000);
+    }
+
+    end = convert_to_frame_unit(current_time - latency,
         this->session->frame_rate_num, this->session->frame_rate_den);
     return true;
 }
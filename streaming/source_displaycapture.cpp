@@ -1,5 +1,7 @@
 #include "source_displaycapture.h"
 #include "control_pipeline.h"
+#include "logger.h"
+#include "metrics.h"
 #include <iostream>
 #include <d2d1.h>
 #include <Mferror.h>
@@ -29,10 +31,13 @@ source_displaycapture::source_displaycapture(
     context_mutex(context_mutex),
     output_index((UINT)-1),
     same_adapter(false),
-    available_samples(new buffer_pool),
-    available_pointer_samples(new buffer_pool)
+    staging(staging_ring_size),
+    desktop_generation(0),
+    available_samples(new buffer_pool("source_displaycapture::available_samples")),
+    available_pointer_samples(new buffer_pool("source_displaycapture::available_pointer_samples"))
 {
     this->outdupl_desc.Rotation = DXGI_MODE_ROTATION_UNSPECIFIED;
+    memset(&this->staging_desc, 0, sizeof(this->staging_desc));
     this->pointer_position.Visible = FALSE;
     this->pointer_shape_info.Type = DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR;
 }
@@ -97,6 +102,8 @@ void source_displaycapture::make_request(request_t& request, frame_unit frame_en
         frame.params.source_rect.bottom = (FLOAT)desc.Height;
         frame.params.dest_rect = frame.params.source_rect;
         frame.params.source_m = frame.params.dest_m = D2D1::Matrix3x2F::Identity();
+        // the desktop image has no transparency
+        frame.opaque = true;
 
         using namespace D2D1;
         switch(this->outdupl_desc.Rotation)
@@ -150,6 +157,9 @@ void source_displaycapture::make_request(request_t& request, frame_unit frame_en
     media_component_videomixer_args& args = *request.sample.args->args;
     media_component_videomixer_args& pointer_args = *request.sample.args->pointer_args;
     media_sample_video_mixer_frame frame, pointer_frame;
+    // capture_frame serves the newest buffer again if the desktop hasn't been updated
+    const media_buffer_texture_t previous_buffer = this->newest_buffer,
+        previous_pointer_buffer = this->newest_pointer_buffer;
 
     try
     {
@@ -163,6 +173,10 @@ void source_displaycapture::make_request(request_t& request, frame_unit frame_en
     // params are ignored if the buffer in sample is null(=silent)
     build_frame(frame);
     build_pointer_frame(pointer_frame);
+    frame.unchanged = (frame.buffer && frame.buffer == previous_buffer);
+    if(frame.buffer && !frame.unchanged)
+        frame.changed_region = this->newest_dirty_region;
+    pointer_frame.unchanged = (pointer_frame.buffer && pointer_frame.buffer == previous_pointer_buffer);
 
     this->source_helper.add_new_sample(frame);
     this->source_pointer_helper.add_new_sample(pointer_frame);
@@ -307,11 +321,9 @@ capture:
     CHECK_HR(hr = frame->QueryInterface(&screen_frame));
 
     D3D11_TEXTURE2D_DESC screen_frame_desc;
-    output_frame = this->acquire_buffer(this->available_samples);
     screen_frame->GetDesc(&screen_frame_desc);
     screen_frame_desc.MiscFlags = 0;
     screen_frame_desc.Usage = D3D11_USAGE_DEFAULT;
-    output_frame->initialize(this->d3d11dev2, screen_frame_desc, NULL);
 
     // pointer position update
     if(frame_info.LastMouseUpdateTime.QuadPart != 0)
@@ -332,21 +344,40 @@ capture:
     // the last present time might be 0 on the first call aswell,
     // so checking for the newest buffer is necessary;
     // newest pointer shape on the other hand seems to be true on the first call
-    if(frame_info.LastPresentTime.QuadPart != 0 || !this->newest_buffer)
+    if(frame_info.LastPresentTime.QuadPart != 0 || (!this->newest_buffer && this->staging.empty()))
     {
+        this->update_dirty_region(frame_info, screen_frame_desc);
+
         if(this->same_adapter)
-            this->d3d11devctx->CopyResource(output_frame->texture, screen_frame);
-        else
-            CHECK_HR(hr = this->copy_between_adapters(
-                this->d3d11dev2, output_frame->texture, this->d3d11dev, screen_frame));
+        {
+            output_frame = this->acquire_buffer(this->available_samples);
+            output_frame->initialize(this->d3d11dev2, screen_frame_desc, NULL);
+            this->copy_dirty_region(this->d3d11devctx, screen_frame, output_frame,
+                this->desktop_generation);
 
-        this->newest_buffer = output_frame;
+            this->newest_buffer = output_frame;
+            this->newest_dirty_region = this->dirty_region_history.back();
+        }
+        else
+            CHECK_HR(hr = this->submit_staging_copy(screen_frame, screen_frame_desc));
     }
 
 done:
     if(this->output_duplication)
         this->output_duplication->ReleaseFrame();
 
+    // the finished cross adapter copies are passed on even if the desktop hasn't been updated
+    if(!this->same_adapter && (SUCCEEDED(hr) || hr == DXGI_ERROR_WAIT_TIMEOUT))
+    {
+        const HRESULT staging_hr = this->complete_staging_copies(false);
+        if(FAILED(staging_hr))
+            hr = staging_hr;
+    }
+
+    // an acquired frame that isn't recorded breaks the dirty region history
+    if(FAILED(hr) && hr != DXGI_ERROR_WAIT_TIMEOUT)
+        this->reset_dirty_region();
+
     if(FAILED(hr))
     {
         if(hr == DXGI_ERROR_WAIT_TIMEOUT)
@@ -376,7 +407,7 @@ done:
         }
     }
 
-    if(frame_info.LastPresentTime.QuadPart == 0)
+    if(frame_info.LastPresentTime.QuadPart == 0 || !this->same_adapter)
         output_frame = this->newest_buffer;
     if(!new_pointer_shape)
         pointer_frame = this->newest_pointer_buffer;
@@ -432,11 +463,132 @@ HRESULT source_displaycapture::reinitialize(UINT output_index)
         ARRAYSIZE(supported_formats), supported_formats, &this->output_duplication));
 
     this->output_duplication->GetDesc(&this->outdupl_desc);
+    this->reset_dirty_region();
 
 done:
     return hr;
 }
 
+void source_displaycapture::update_dirty_region(
+    const DXGI_OUTDUPL_FRAME_INFO& frame_info, const D3D11_TEXTURE2D_DESC& desc)
+{
+    std::shared_ptr<dirty_region> region(new dirty_region((int32_t)desc.Width, (int32_t)desc.Height));
+    HRESULT hr = S_OK;
+    UINT move_rects_size = 0, dirty_rects_size = 0;
+
+    // the metadata is relative to the previous acquired frame, so the whole frame
+    // is dirty if the previous frame isn't in the history;
+    // the rects of rotated outputs aren't in the texture coordinates
+    const bool rotated = (this->outdupl_desc.Rotation != DXGI_MODE_ROTATION_IDENTITY &&
+        this->outdupl_desc.Rotation != DXGI_MODE_ROTATION_UNSPECIFIED);
+    if(this->dirty_region_history.empty() || rotated || frame_info.TotalMetadataBufferSize == 0)
+    {
+        region->set_full();
+        goto done;
+    }
+
+    if(this->metadata_buffer.size() < frame_info.TotalMetadataBufferSize)
+        this->metadata_buffer.resize(frame_info.TotalMetadataBufferSize);
+
+    // the move rects are stored before the dirty rects;
+    // the acquired frame already contains the moved pixels, so the destination rects
+    // are copied like the dirty rects
+    CHECK_HR(hr = this->output_duplication->GetFrameMoveRects(
+        (UINT)this->metadata_buffer.size(),
+        (DXGI_OUTDUPL_MOVE_RECT*)this->metadata_buffer.data(), &move_rects_size));
+    CHECK_HR(hr = this->output_duplication->GetFrameDirtyRects(
+        (UINT)this->metadata_buffer.size() - move_rects_size,
+        (RECT*)(this->metadata_buffer.data() + move_rects_size), &dirty_rects_size));
+
+    {
+        const DXGI_OUTDUPL_MOVE_RECT* move_rects =
+            (const DXGI_OUTDUPL_MOVE_RECT*)this->metadata_buffer.data();
+        for(UINT i = 0; i < move_rects_size / sizeof(DXGI_OUTDUPL_MOVE_RECT); i++)
+        {
+            const RECT& rect = move_rects[i].DestinationRect;
+            region->add({rect.left, rect.top, rect.right, rect.bottom});
+        }
+
+        const RECT* dirty_rects = (const RECT*)(this->metadata_buffer.data() + move_rects_size);
+        for(UINT i = 0; i < dirty_rects_size / sizeof(RECT); i++)
+        {
+            const RECT& rect = dirty_rects[i];
+            region->add({rect.left, rect.top, rect.right, rect.bottom});
+        }
+    }
+
+done:
+    if(FAILED(hr))
+    {
+        LOG_WARNING("displaycapture couldn't get the frame metadata, hr {}", log_hex(hr));
+        region->set_full();
+    }
+
+    this->dirty_region_history.push_back(region);
+    this->desktop_generation++;
+    if(this->dirty_region_history.size() > max_dirty_region_history)
+        this->dirty_region_history.pop_front();
+}
+
+void source_displaycapture::copy_dirty_region(ID3D11DeviceContext* ctx, ID3D11Texture2D* src,
+    const media_buffer_texture_t& output_frame, uint64_t generation)
+{
+    static metric& copied_bytes = metrics::get_counter("displaycapture_copied_bytes");
+
+    auto it = std::find_if(this->buffer_generations.begin(), this->buffer_generations.end(),
+        [&](const buffer_generation_t& item) {return item.texture == output_frame->texture;});
+
+    // the texture is missing the regions of the generations that are newer than its contents
+    // up to the generation of the source
+    D3D11_TEXTURE2D_DESC desc;
+    output_frame->texture->GetDesc(&desc);
+    dirty_region region((int32_t)desc.Width, (int32_t)desc.Height);
+    const uint64_t oldest_generation =
+        this->desktop_generation + 1 - this->dirty_region_history.size();
+    if(it != this->buffer_generations.end() && it->generation < generation &&
+        it->generation + 1 >= oldest_generation && generation <= this->desktop_generation)
+    {
+        for(uint64_t i = it->generation + 1; i <= generation; i++)
+            region.add(*this->dirty_region_history[(size_t)(i - oldest_generation)]);
+    }
+    else
+        region.set_full();
+
+    if(region.is_full())
+        ctx->CopyResource(output_frame->texture, src);
+    else
+    {
+        for(const auto& rect : region.get_rects())
+        {
+            const D3D11_BOX box = {(UINT)rect.left, (UINT)rect.top, 0,
+                (UINT)rect.right, (UINT)rect.bottom, 1};
+            ctx->CopySubresourceRegion(output_frame->texture, 0,
+                (UINT)rect.left, (UINT)rect.top, 0, src, 0, &box);
+        }
+    }
+    // the desktop is bgra
+    copied_bytes.add(region.get_area() * 4);
+
+    if(it != this->buffer_generations.end())
+        it->generation = generation;
+    else
+    {
+        // the texture holding the oldest generation is forgotten
+        if(this->buffer_generations.size() >= max_dirty_region_history)
+            this->buffer_generations.erase(std::min_element(
+                this->buffer_generations.begin(), this->buffer_generations.end(),
+                [](const buffer_generation_t& a, const buffer_generation_t& b)
+                {return a.generation < b.generation;}));
+        this->buffer_generations.push_back({output_frame->texture, generation});
+    }
+}
+
+void source_displaycapture::reset_dirty_region()
+{
+    this->dirty_region_history.clear();
+    this->buffer_generations.clear();
+}
+
 void source_displaycapture::initialize(
     const control_class_t& ctrl_pipeline,
     UINT output_index,
@@ -458,7 +610,7 @@ void source_displaycapture::initialize(
 done:
     if(hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
     {
-        std::cerr << "maximum number of desktop duplication api applications running" << std::endl;
+        LOG_ERROR("maximum number of desktop duplication api applications running");
     }
 }
 
@@ -504,67 +656,174 @@ void source_displaycapture::initialize(
 done:
     if(hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
     {
-        std::cerr << "maximum number of desktop duplication api applications running" << std::endl;
+        LOG_ERROR("maximum number of desktop duplication api applications running");
     }
     else if(FAILED(hr))
         throw HR_EXCEPTION(hr);
 }
 
-HRESULT source_displaycapture::copy_between_adapters(
-    ID3D11Device* dst_dev, ID3D11Texture2D* dst,
-    ID3D11Device* src_dev, ID3D11Texture2D* src)
+HRESULT source_displaycapture::submit_staging_copy(
+    ID3D11Texture2D* screen_frame, const D3D11_TEXTURE2D_DESC& screen_frame_desc)
 {
     HRESULT hr = S_OK;
-    D3D11_TEXTURE2D_DESC desc;
-    CComPtr<ID3D11DeviceContext> src_dev_ctx, dst_dev_ctx;
+    dirty_region_t region = this->dirty_region_history.back();
 
-    src_dev->GetImmediateContext(&src_dev_ctx);
-    dst_dev->GetImmediateContext(&dst_dev_ctx);
+    // the staging textures are recreated if the desktop changes;
+    // the new destination staging texture is then written fully
+    if(!this->stage_dst || screen_frame_desc.Width != this->staging_desc.Width ||
+        screen_frame_desc.Height != this->staging_desc.Height ||
+        screen_frame_desc.Format != this->staging_desc.Format)
+    {
+        D3D11_TEXTURE2D_DESC desc = screen_frame_desc;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.MiscFlags = 0;
 
-    src->GetDesc(&desc);
-    desc.Usage = D3D11_USAGE_STAGING;
-    desc.BindFlags = 0;
-    desc.MiscFlags = 0;
+        this->staging.reset();
+        this->stage_dst = NULL;
 
-    // create staging texture for reading
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-    if(!this->stage_src)
-        CHECK_HR(hr = src_dev->CreateTexture2D(&desc, NULL, &this->stage_src));
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        for(auto&& slot : this->staging.get_slots())
+        {
+            slot.texture = NULL;
+            slot.region = NULL;
+            CHECK_HR(hr = this->d3d11dev->CreateTexture2D(&desc, NULL, &slot.texture));
+        }
 
-    // create staging texture for writing
-    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-    if(!this->stage_dst)
-        CHECK_HR(hr = dst_dev->CreateTexture2D(&desc, NULL, &this->stage_dst));
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        CHECK_HR(hr = this->d3d11dev2->CreateTexture2D(&desc, NULL, &this->stage_dst));
+        this->staging_desc = screen_frame_desc;
 
-    // copy src video memory to src staging buffer
-    src_dev_ctx->CopyResource(this->stage_src, src);
+        std::shared_ptr<dirty_region> full_region(new dirty_region(
+            (int32_t)screen_frame_desc.Width, (int32_t)screen_frame_desc.Height));
+        full_region->set_full();
+        region = full_region;
+    }
 
-    // map the src staging buffer for reading
-    D3D11_MAPPED_SUBRESOURCE src_sub_rsrc;
-    src_dev_ctx->Map(this->stage_src, 0, D3D11_MAP_READ, 0, &src_sub_rsrc);
+    // the oldest copy must be completed if all slots are in flight
+    if(this->staging.full())
+        CHECK_HR(hr = this->complete_staging_copies(true));
 
-    // map the dst staging buffer for writing
-    D3D11_MAPPED_SUBRESOURCE dst_sub_rsrc;
     {
-        // context mutex needs to be locked for the whole duration of map/unmap
-        scoped_lock lock(*this->context_mutex);
-        dst_dev_ctx->Map(this->stage_dst, 0, D3D11_MAP_WRITE, 0, &dst_sub_rsrc);
+        staging_slot_t& slot = this->staging.get_free();
+        slot.generation = this->desktop_generation;
+        slot.region = region;
+
+        // only the changed region is read back, since the destination staging texture
+        // holds the previous submitted frame when this copy completes
+        if(region->is_full())
+            this->d3d11devctx->CopyResource(slot.texture, screen_frame);
+        else
+        {
+            for(const auto& rect : region->get_rects())
+            {
+                const D3D11_BOX box = {(UINT)rect.left, (UINT)rect.top, 0,
+                    (UINT)rect.right, (UINT)rect.bottom, 1};
+                this->d3d11devctx->CopySubresourceRegion(slot.texture, 0,
+                    (UINT)rect.left, (UINT)rect.top, 0, screen_frame, 0, &box);
+            }
+        }
+
+        this->staging.submit();
+    }
 
-        assert_(src_sub_rsrc.RowPitch == dst_sub_rsrc.RowPitch);
+    // the gpu starts the copy before the slot is polled
+    this->d3d11devctx->Flush();
+
+done:
+    if(FAILED(hr))
+    {
+        this->staging.reset();
+        this->stage_dst = NULL;
+    }
 
-        // copy from src staging buffer to dst staging buffer
-        const size_t size = dst_sub_rsrc.RowPitch * desc.Height;
-        memcpy(dst_sub_rsrc.pData, src_sub_rsrc.pData, size);
+    return hr;
+}
 
-        // unmap the staging buffers
-        src_dev_ctx->Unmap(this->stage_src, 0);
-        dst_dev_ctx->Unmap(this->stage_dst, 0);
+HRESULT source_displaycapture::complete_staging_copies(bool wait)
+{
+    static metric& readback_bytes = metrics::get_counter("displaycapture_readback_bytes");
 
-        // copy from dst staging buffer to dst video memory
-        dst_dev_ctx->CopyResource(dst, this->stage_dst);
+    HRESULT hr = S_OK;
+    bool completed = false;
+    uint64_t generation = 0;
+    std::shared_ptr<dirty_region> changed_region;
+    media_buffer_texture_t output_frame;
+
+    while(!this->staging.empty())
+    {
+        staging_slot_t& slot = this->staging.get_oldest();
+        D3D11_MAPPED_SUBRESOURCE src_sub_rsrc, dst_sub_rsrc;
+
+        // only the oldest copy is waited for; the newer copies are completed
+        // if the gpu has already finished them
+        hr = this->d3d11devctx->Map(slot.texture, 0, D3D11_MAP_READ,
+            (wait && !completed) ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &src_sub_rsrc);
+        if(hr == DXGI_ERROR_WAS_STILL_DRAWING)
+        {
+            hr = S_OK;
+            break;
+        }
+        CHECK_HR(hr);
+
+        // the destination map waits only for the previous copy to the output frame
+        if(FAILED(hr = this->d3d11devctx2->Map(this->stage_dst, 0, D3D11_MAP_WRITE, 0, &dst_sub_rsrc)))
+        {
+            this->d3d11devctx->Unmap(slot.texture, 0);
+            goto done;
+        }
+
+        // the rows of the changed rects are copied; the row pitches may differ
+        for(const auto& rect : slot.region->get_rects())
+        {
+            const size_t row_size = (size_t)(rect.right - rect.left) * 4;
+            const BYTE* src = (const BYTE*)src_sub_rsrc.pData +
+                (size_t)rect.top * src_sub_rsrc.RowPitch + (size_t)rect.left * 4;
+            BYTE* dst = (BYTE*)dst_sub_rsrc.pData +
+                (size_t)rect.top * dst_sub_rsrc.RowPitch + (size_t)rect.left * 4;
+            for(int32_t y = rect.top; y < rect.bottom; y++)
+            {
+                memcpy(dst, src, row_size);
+                src += src_sub_rsrc.RowPitch;
+                dst += dst_sub_rsrc.RowPitch;
+            }
+            readback_bytes.add((int64_t)(row_size * (rect.bottom - rect.top)));
+        }
+
+        this->d3d11devctx->Unmap(slot.texture, 0);
+        this->d3d11devctx2->Unmap(this->stage_dst, 0);
+
+        if(changed_region)
+            changed_region->add(*slot.region);
+        else
+            changed_region.reset(new dirty_region(*slot.region));
+        generation = slot.generation;
+        completed = true;
+
+        slot.region = NULL;
+        this->staging.complete();
+    }
+
+    // the output frame is updated once with the changes of all completed copies
+    if(completed)
+    {
+        output_frame = this->acquire_buffer(this->available_samples);
+        output_frame->initialize(this->d3d11dev2, this->staging_desc, NULL);
+        this->copy_dirty_region(this->d3d11devctx2, this->stage_dst, output_frame, generation);
+
+        this->newest_buffer = output_frame;
+        this->newest_dirty_region = changed_region;
     }
 
 done:
+    if(FAILED(hr))
+    {
+        // the destination staging texture no longer follows the submitted frames
+        this->staging.reset();
+        this->stage_dst = NULL;
+        this->reset_dirty_region();
+    }
+
     return hr;
 }
 
@@ -2,12 +2,16 @@
 #include "source_base.h"
 #include "video_source_helper.h"
 #include "transform_videomixer.h"
+#include "dirty_region.h"
+#include "staging_ring.h"
 #include <d3d11.h>
 #include <dxgi.h>
 #include <dxgi1_2.h>
 #include <dxgi1_5.h>
 #include <memory>
 #include <optional>
+#include <vector>
+#include <deque>
 
 #pragma comment(lib, "dxgi")
 
@@ -33,9 +37,28 @@ class source_displaycapture final : public source_base<displaycapture_args>
 {
     friend class stream_displaycapture;
 public:
-    typedef std::lock_guard<std::recursive_mutex> scoped_lock;
+    typedef std::lock_guard<context_mutex_t::element_type> scoped_lock;
     typedef buffer_pool<media_buffer_pooled_texture> buffer_pool;
+
+    // the amount of desktop generations whose changed regions are kept
+    static constexpr size_t max_dirty_region_history = 8;
+    // the amount of cross adapter copies in flight
+    static constexpr size_t staging_ring_size = 3;
 private:
+    struct buffer_generation_t
+    {
+        CComPtr<ID3D11Texture2D> texture;
+        uint64_t generation;
+    };
+    struct staging_slot_t
+    {
+        // readable staging texture on the capture adapter
+        CComPtr<ID3D11Texture2D> texture;
+        uint64_t generation;
+        // the region that changed since the previous submitted frame
+        dirty_region_t region;
+    };
+
     // since the dxgi output duplication seems to use the d3d11 context,
     // the mutex must be locked when capturing a frame
     context_mutex_t context_mutex;
@@ -56,9 +79,25 @@ private:
     // second devs for the rendering operations in the pipeline
     CComPtr<ID3D11Device> d3d11dev, d3d11dev2;
     CComPtr<ID3D11DeviceContext> d3d11devctx, d3d11devctx2;
-    CComPtr<ID3D11Texture2D> stage_src, stage_dst;
     bool same_adapter;
 
+    // the cross adapter copies are read back through the staging ring without waiting
+    // for the gpu, and written to the staging texture on the pipeline adapter, which holds
+    // the newest completed frame
+    staging_ring<staging_slot_t> staging;
+    CComPtr<ID3D11Texture2D> stage_dst;
+    D3D11_TEXTURE2D_DESC staging_desc;
+
+    // the pooled textures keep their contents between uses, so a reused texture is
+    // updated with the regions that changed after the desktop generation it holds;
+    // the textures are referenced so that their addresses stay unique
+    std::vector<BYTE> metadata_buffer;
+    std::deque<dirty_region_t> dirty_region_history;
+    uint64_t desktop_generation;
+    std::vector<buffer_generation_t> buffer_generations;
+    // the region that changed between the newest buffer and the buffer before it
+    dirty_region_t newest_dirty_region;
+
     // source_base
     stream_source_base_t create_derived_stream() override;
     bool get_samples_end(time_unit request_time, frame_unit& end) const override;
@@ -68,12 +107,21 @@ private:
 
     media_buffer_texture_t acquire_buffer(const std::shared_ptr<buffer_pool>&);
 
-    HRESULT copy_between_adapters(
-        ID3D11Device* dst_dev,
-        ID3D11Texture2D* dst,
-        ID3D11Device* src_dev,
-        ID3D11Texture2D* src);
+    // the staging functions are called with the context mutex locked;
+    // submits the copy of the changed region of the screen frame to the staging ring
+    HRESULT submit_staging_copy(ID3D11Texture2D* screen_frame, const D3D11_TEXTURE2D_DESC&);
+    // completes the finished copies in the submission order and updates the newest buffer;
+    // waits for the oldest copy if the wait flag is set
+    HRESULT complete_staging_copies(bool wait);
     HRESULT reinitialize(UINT output_index);
+    // reads the dirty and move rects of the acquired frame to the history
+    void update_dirty_region(const DXGI_OUTDUPL_FRAME_INFO&, const D3D11_TEXTURE2D_DESC&);
+    // copies the regions that the output frame is missing from the source texture
+    // that holds the desktop generation
+    void copy_dirty_region(ID3D11DeviceContext*, ID3D11Texture2D* src,
+        const media_buffer_texture_t& output_frame, uint64_t generation);
+    // the next frames are copied fully
+    void reset_dirty_region();
     HRESULT initialize_pointer_texture(media_buffer_texture_t&);
     HRESULT create_pointer_texture(
         const DXGI_OUTDUPL_FRAME_INFO&, media_buffer_texture_t&);
@@ -1,9 +1,11 @@
 #include "source_empty.h"
+#include "logger.h"
 #include <Mferror.h>
 
 source_empty_audio::source_empty_audio(const media_session_t& session) :
     source_base(session),
-    buffer_pool_audio_frames(new buffer_pool_audio_frames_t)
+    buffer_pool_audio_frames(new buffer_pool_audio_frames_t(
+        "source_empty_audio::buffer_pool_audio_frames"))
 {
 }
 
@@ -56,7 +58,7 @@ void source_empty_audio::make_request(request_t& request, frame_unit frame_end)
             transform_audiomixer2::block_align);
     if(limit_reached)
     {
-        std::cout << "source_empty_audio buffer limit reached, excess frames discarded" << std::endl;
+        LOG_WARNING("source_empty_audio buffer limit reached, excess frames discarded");
     }
 
     this->last_frame_end = frame_end;
@@ -94,7 +96,8 @@ void stream_empty_audio::on_component_start(time_unit t)
 
 source_empty_video::source_empty_video(const media_session_t& session) :
     source_base(session),
-    buffer_pool_video_frames(new buffer_pool_video_frames_t)
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "source_empty_video::buffer_pool_video_frames"))
 {
 }
 
@@ -146,7 +149,7 @@ void source_empty_video::make_request(request_t& request, frame_unit frame_end)
         args.sample->move_frames_to(NULL, args.sample->get_end() - maximum_buffer_size);
     if(limit_reached)
     {
-        std::cout << "source_empty_video buffer limit reached, excess frames discarded" << std::endl;
+        LOG_WARNING("source_empty_video buffer limit reached, excess frames discarded");
     }
 
     this->last_frame_end = frame_end;
@@ -0,0 +1,148 @@
+#include "source_recorder.h"
+#include "assert.h"
+#include "logger.h"
+#include <type_traits>
+
+#undef min
+#undef max
+
+template<class Args>
+source_recorder<Args>::source_recorder() :
+    hash_payloads(true), write_failed(false),
+    last_hash(0)
+{
+}
+
+template<class Args>
+void source_recorder<Args>::initialize(const std::wstring& path,
+    const media_session_t& session, bool hash_payloads)
+{
+    const source_trace::type_t type = std::is_same_v<Args, media_component_audiomixer_args> ?
+        source_trace::TYPE_AUDIO : source_trace::TYPE_VIDEO;
+
+    this->hash_payloads = hash_payloads;
+    if(!this->writer.open(path, type, session->frame_rate_num, session->frame_rate_den))
+    {
+        LOG_ERROR("source_recorder could not create the trace file");
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(ERROR_OPEN_FAILED));
+    }
+}
+
+template<class Args>
+void source_recorder<Args>::make_frame(const media_sample_video_mixer_frame& frame,
+    source_trace::frame_t& out)
+{
+    out.pos = frame.pos;
+    out.dur = frame.dur;
+    out.hash = 0;
+    out.flags = 0;
+    out.width = out.height = 0;
+
+    if(!frame.buffer)
+    {
+        out.flags |= source_trace::FRAME_NULL_BUFFER;
+        return;
+    }
+    if(frame.unchanged)
+        out.flags |= source_trace::FRAME_UNCHANGED;
+
+    const media_buffer_memory_texture* buffer =
+        dynamic_cast<const media_buffer_memory_texture*>(frame.buffer.get());
+    if(buffer)
+    {
+        out.width = buffer->width;
+        out.height = buffer->height;
+    }
+    else if(frame.buffer->texture)
+    {
+        D3D11_TEXTURE2D_DESC desc;
+        frame.buffer->texture->GetDesc(&desc);
+        out.width = desc.Width;
+        out.height = desc.Height;
+    }
+
+    if(!this->hash_payloads || !buffer || !buffer->texture_buffer)
+        return;
+
+    if(frame.buffer == this->last_buffer)
+    {
+        out.hash = this->last_hash;
+        return;
+    }
+
+    // the padding of the rows is not part of the payload
+    uint64_t hash = 0;
+    for(UINT32 y = 0; y < buffer->height; y++)
+        hash = source_trace::hash(buffer->texture_buffer.get() + (size_t)y * buffer->pitch,
+            (size_t)buffer->width * 4, hash);
+
+    this->last_buffer = frame.buffer;
+    this->last_hash = hash;
+    out.hash = hash;
+}
+
+template<class Args>
+void source_recorder<Args>::make_frame(const media_sample_audio_mixer_frame& frame,
+    source_trace::frame_t& out)
+{
+    out.pos = frame.pos;
+    out.dur = frame.dur;
+    out.hash = 0;
+    out.flags = 0;
+    out.width = out.height = 0;
+
+    if(!frame.buffer)
+    {
+        out.flags |= source_trace::FRAME_NULL_BUFFER;
+        return;
+    }
+
+    if(!this->hash_payloads)
+        return;
+
+    BYTE* data;
+    DWORD len;
+    if(SUCCEEDED(frame.buffer->Lock(&data, NULL, &len)))
+    {
+        out.hash = source_trace::hash(data, len);
+        frame.buffer->Unlock();
+    }
+}
+
+template<class Args>
+void source_recorder<Args>::on_make_request(time_unit request_time,
+    bool valid_end, frame_unit samples_end, const std::optional<Args>& args)
+{
+    source_trace::request_t request = {};
+    request.request_time = request_time;
+    request.samples_end = valid_end ? samples_end : 0;
+    request.flags = valid_end ? source_trace::REQUEST_VALID_END : 0;
+
+    this->frames.clear();
+    if(args)
+    {
+        request.frame_end = args->frame_end;
+        const auto* sample_args = get_sample_args(*args);
+        if(sample_args && sample_args->sample)
+        {
+            request.flags |= source_trace::REQUEST_HAS_SAMPLE;
+            for(auto&& frame : sample_args->sample->get_frames())
+            {
+                this->frames.emplace_back();
+                this->make_frame(frame, this->frames.back());
+            }
+        }
+    }
+    request.frame_count = (uint32_t)this->frames.size();
+
+    // the pipeline keeps running if the recording fails
+    if(!this->writer.write(request, this->frames.data()) && !this->write_failed)
+    {
+        this->write_failed = true;
+        LOG_ERROR("source_recorder could not write to the trace file; recording stopped");
+    }
+}
+
+template class source_recorder<media_component_videomixer_args>;
+template class source_recorder<media_component_audiomixer_args>;
+template class source_recorder<displaycapture_args>;
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+#include "source_base.h"
+#include "source_trace.h"
+#include "transform_videomixer.h"
+#include "transform_audiomixer2.h"
+#include "source_displaycapture.h"
+#include <memory>
+#include <vector>
+#include <string>
+
+// records the samples that a source serves to a trace file, so that the arrival pattern
+// can be reproduced by source_replay;
+// the recorder is set to a source with source_base::set_tap;
+// the payloads of the audio frames and of the video frames in system memory are hashed;
+// the video frames in gpu memory are recorded without a hash because reading them back
+// would stall the pipeline;
+// the displaycapture is recorded without the pointer
+
+template<class Args>
+class source_recorder final : public source_tap<Args>
+{
+private:
+    source_trace::writer writer;
+    bool hash_payloads, write_failed;
+    // reused for each request
+    std::vector<source_trace::frame_t> frames;
+
+    // the buffer of the previous hashed video frame; repeated frames share the buffer;
+    // the reference keeps the buffer from being recycled
+    media_buffer_texture_t last_buffer;
+    uint64_t last_hash;
+
+    void make_frame(const media_sample_video_mixer_frame&, source_trace::frame_t&);
+    void make_frame(const media_sample_audio_mixer_frame&, source_trace::frame_t&);
+
+    template<class T>
+    static const T* get_sample_args(const T& args) { return &args; }
+    static const media_component_videomixer_args* get_sample_args(const displaycapture_args& args)
+    { return args.args ? &*args.args : NULL; }
+public:
+    source_recorder();
+
+    // throws if the file couldn't be created;
+    // the payloads can be left unhashed to reduce the recording overhead
+    void initialize(const std::wstring& path, const media_session_t&, bool hash_payloads = true);
+
+    void on_make_request(time_unit request_time, bool valid_end, frame_unit samples_end,
+        const std::optional<Args>&) override;
+};
+
+typedef source_recorder<media_component_videomixer_args> source_recorder_video;
+typedef source_recorder<media_component_audiomixer_args> source_recorder_audio;
+typedef source_recorder<displaycapture_args> source_recorder_displaycapture;
+typedef std::shared_ptr<source_recorder_video> source_recorder_video_t;
+typedef std::shared_ptr<source_recorder_audio> source_recorder_audio_t;
\ No newline at end of file
@@ -0,0 +1,431 @@
+#include "source_replay.h"
+#include "assert.h"
+#include "logger.h"
+#include <Mferror.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#undef max
+#undef min
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
+
+namespace
+{
+
+// xorshift generator for the synthesized payloads
+struct payload_generator
+{
+    uint32_t state;
+
+    // a zero hash means that the payload wasn't recorded, so the position is used instead
+    payload_generator(uint64_t hash, int64_t pos)
+    {
+        const uint64_t seed = hash ? hash : (uint64_t)pos * 0x9e3779b97f4a7c15ull;
+        this->state = (uint32_t)(seed ^ (seed >> 32)) | 1;
+    }
+    uint32_t next()
+    {
+        this->state ^= this->state << 13;
+        this->state ^= this->state >> 17;
+        this->state ^= this->state << 5;
+        return this->state;
+    }
+};
+
+}
+
+source_replay_schedule::source_replay_schedule() :
+    frame_rate_num(0), frame_rate_den(0),
+    started(false),
+    frame_offset(0), time_offset(0),
+    next_frame(0),
+    last_samples_end(std::numeric_limits<frame_unit>::min())
+{
+}
+
+void source_replay_schedule::initialize(const std::wstring& path, source_trace::type_t type,
+    const media_session_t& session)
+{
+    if(!source_trace::read(path, this->trace))
+    {
+        LOG_ERROR("source_replay could not read the trace file");
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    }
+
+    // the frame positions are replayed as is, so the frame rates must match
+    if(this->trace.header.type != type ||
+        this->trace.header.frame_rate_num != session->frame_rate_num ||
+        this->trace.header.frame_rate_den != session->frame_rate_den)
+    {
+        LOG_ERROR("source_replay trace doesn't match the session");
+        throw HR_EXCEPTION(E_INVALIDARG);
+    }
+
+    this->frame_rate_num = session->frame_rate_num;
+    this->frame_rate_den = session->frame_rate_den;
+
+    for(auto&& request : this->trace.requests)
+        if(request.flags & source_trace::REQUEST_VALID_END)
+            this->last_samples_end = std::max(this->last_samples_end, (frame_unit)request.samples_end);
+
+    LOG_INFO("source_replay trace loaded, {} requests, {} frames",
+        this->trace.requests.size(), this->trace.frames.size());
+}
+
+void source_replay_schedule::start(time_unit t)
+{
+    if(this->started)
+        return;
+
+    this->started = true;
+    if(this->trace.requests.empty())
+        return;
+
+    this->frame_offset =
+        convert_to_frame_unit(t, this->frame_rate_num, this->frame_rate_den) -
+        convert_to_frame_unit(this->trace.requests[0].request_time,
+            this->frame_rate_num, this->frame_rate_den);
+    this->time_offset = convert_to_time_unit(this->frame_offset,
+        this->frame_rate_num, this->frame_rate_den);
+}
+
+size_t source_replay_schedule::get_request_count(time_unit request_time) const
+{
+    const time_unit recorded_time = request_time - this->time_offset;
+    return std::upper_bound(this->trace.requests.begin(), this->trace.requests.end(),
+        recorded_time,
+        [](time_unit t, const source_trace::request_t& request) {return t < request.request_time;}) -
+        this->trace.requests.begin();
+}
+
+bool source_replay_schedule::get_samples_end(time_unit request_time, frame_unit& end) const
+{
+    if(!this->started)
+        return false;
+
+    const size_t count = this->get_request_count(request_time);
+    const bool ended = (count == this->trace.requests.size()) &&
+        (count == 0 || request_time > this->trace.requests.back().request_time + this->time_offset);
+    if(ended)
+    {
+        // the remaining frames are served and frame skips after them
+        end = convert_to_frame_unit(request_time, this->frame_rate_num, this->frame_rate_den);
+        if(this->last_samples_end != std::numeric_limits<frame_unit>::min())
+            end = std::max(end, this->last_samples_end + this->frame_offset);
+        return true;
+    }
+    if(count == 0)
+        return false;
+
+    const source_trace::request_t& request = this->trace.requests[count - 1];
+    if(!(request.flags & source_trace::REQUEST_VALID_END))
+        return false;
+
+    end = request.samples_end + this->frame_offset;
+    return true;
+}
+
+bool source_replay_schedule::next_frame(frame_unit frame_end, source_trace::frame_t& frame)
+{
+    // the frames were buffered by the source at the latest when they were served,
+    // so every frame before the samples end has arrived
+    if(this->next_frame == this->trace.frames.size() ||
+        this->trace.frames[this->next_frame].pos + this->frame_offset >= frame_end)
+        return false;
+
+    frame = this->trace.frames[this->next_frame++];
+    frame.pos += this->frame_offset;
+    return true;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+source_replay_video::source_replay_video(const media_session_t& session) :
+    source_base(session),
+    pending_frames(new media_sample_video_mixer_frames),
+    buffer_pool_memory_texture(new buffer_pool_memory_texture_t(
+        "source_replay_video::buffer_pool_memory_texture")),
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "source_replay_video::buffer_pool_video_frames")),
+    last_hash(0)
+{
+}
+
+source_replay_video::~source_replay_video()
+{
+    {
+        buffer_pool_video_frames_t::scoped_lock lock(this->buffer_pool_video_frames->mutex);
+        this->buffer_pool_video_frames->dispose();
+    }
+    {
+        buffer_pool_memory_texture_t::scoped_lock lock(this->buffer_pool_memory_texture->mutex);
+        this->buffer_pool_memory_texture->dispose();
+    }
+}
+
+void source_replay_video::initialize(const control_class_t& ctrl_pipeline, const std::wstring& path)
+{
+    this->source_base::initialize(ctrl_pipeline);
+    this->schedule.initialize(path, source_trace::TYPE_VIDEO, this->session);
+}
+
+media_buffer_memory_texture_t source_replay_video::make_buffer(const source_trace::frame_t& frame)
+{
+    static constexpr UINT32 block_size = 16;
+
+    // repeated frames share the buffer like in the recording
+    const bool repeated = (frame.flags & source_trace::FRAME_UNCHANGED) ||
+        (frame.hash && frame.hash == this->last_hash);
+    if(repeated && this->last_buffer &&
+        this->last_buffer->width == frame.width && this->last_buffer->height == frame.height)
+        return this->last_buffer;
+
+    media_buffer_memory_texture_t buffer;
+    {
+        buffer_pool_memory_texture_t::scoped_lock lock(this->buffer_pool_memory_texture->mutex);
+        buffer = this->buffer_pool_memory_texture->acquire_buffer();
+    }
+    buffer->initialize(frame.width, frame.height);
+
+    // blocks of random colors; the contents only depend on the hash
+    payload_generator generator(frame.hash, frame.pos);
+    std::vector<uint32_t> block_colors((frame.width + block_size - 1) / block_size);
+    for(UINT32 y = 0; y < frame.height; y++)
+    {
+        if(y % block_size == 0)
+            for(auto&& color : block_colors)
+                color = generator.next() | 0xff000000;
+
+        uint32_t* row = (uint32_t*)(buffer->texture_buffer.get() + (size_t)y * buffer->pitch);
+        for(UINT32 x = 0; x < frame.width; x++)
+            row[x] = block_colors[x / block_size];
+    }
+
+    this->last_buffer = buffer;
+    this->last_hash = frame.hash;
+    return buffer;
+}
+
+source_replay_video::stream_source_base_t source_replay_video::create_derived_stream()
+{
+    return stream_replay_video_t(new stream_replay_video(this->shared_from_this<source_replay_video>()));
+}
+
+bool source_replay_video::get_samples_end(time_unit request_time, frame_unit& end) const
+{
+    scoped_lock lock(this->schedule_mutex);
+    return this->schedule.get_samples_end(request_time, end);
+}
+
+void source_replay_video::make_request(request_t& request, frame_unit frame_end)
+{
+    scoped_lock lock(this->schedule_mutex);
+
+    source_trace::frame_t trace_frame;
+    while(this->schedule.next_frame(frame_end, trace_frame))
+    {
+        if(trace_frame.dur <= 0)
+            continue;
+
+        media_sample_video_mixer_frame frame;
+        frame.pos = trace_frame.pos;
+        frame.dur = trace_frame.dur;
+        if(!(trace_frame.flags & source_trace::FRAME_NULL_BUFFER) &&
+            trace_frame.width && trace_frame.height)
+        {
+            frame.buffer = this->make_buffer(trace_frame);
+            frame.params.source_rect.top = frame.params.source_rect.left = 0.f;
+            frame.params.source_rect.right = (FLOAT)trace_frame.width;
+            frame.params.source_rect.bottom = (FLOAT)trace_frame.height;
+            frame.params.dest_rect = frame.params.source_rect;
+            frame.params.source_m = frame.params.dest_m = D2D1::Matrix3x2F::Identity();
+            frame.opaque = true;
+            frame.unchanged = (trace_frame.flags & source_trace::FRAME_UNCHANGED) != 0;
+        }
+
+        this->pending_frames->add_consecutive_frames(frame);
+    }
+
+    request.sample.args = std::make_optional<media_component_videomixer_args>();
+    media_component_videomixer_args& args = *request.sample.args;
+    args.frame_end = frame_end;
+
+    media_sample_video_mixer_frames_t sample;
+    {
+        buffer_pool_video_frames_t::scoped_lock lock(this->buffer_pool_video_frames->mutex);
+        sample = this->buffer_pool_video_frames->acquire_buffer();
+    }
+    sample->initialize();
+
+    // frames are simply skipped if there is no sample for the args
+    if(this->pending_frames->move_frames_to(sample.get(), frame_end))
+        args.sample = std::move(sample);
+}
+
+void source_replay_video::dispatch(request_t& request)
+{
+    this->session->give_sample(request.stream, request.sample.args.has_value() ?
+        &(*request.sample.args) : NULL, request.rp);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+stream_replay_video::stream_replay_video(const source_replay_video_t& source) :
+    stream_source_base(source),
+    source(source)
+{
+}
+
+void stream_replay_video::on_component_start(time_unit t)
+{
+    source_replay_video::scoped_lock lock(this->source->schedule_mutex);
+    this->source->schedule.start(t);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+source_replay_audio::source_replay_audio(const media_session_t& session) :
+    source_base(session),
+    pending_frames(new media_sample_audio_mixer_frames),
+    buffer_pool_memory(new buffer_pool_memory_t("source_replay_audio::buffer_pool_memory")),
+    buffer_pool_audio_frames(new buffer_pool_audio_frames_t(
+        "source_replay_audio::buffer_pool_audio_frames"))
+{
+}
+
+source_replay_audio::~source_replay_audio()
+{
+    {
+        buffer_pool_audio_frames_t::scoped_lock lock(this->buffer_pool_audio_frames->mutex);
+        this->buffer_pool_audio_frames->dispose();
+    }
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        this->buffer_pool_memory->dispose();
+    }
+}
+
+void source_replay_audio::initialize(const control_class_t& ctrl_pipeline, const std::wstring& path)
+{
+    this->source_base::initialize(ctrl_pipeline);
+    this->schedule.initialize(path, source_trace::TYPE_AUDIO, this->session);
+}
+
+media_buffer_memory_t source_replay_audio::make_buffer(const source_trace::frame_t& frame)
+{
+    static constexpr bit_depth_t amplitude = 0.1f;
+
+    HRESULT hr = S_OK;
+    media_buffer_memory_t buffer;
+    const DWORD len = (DWORD)frame.dur * transform_audiomixer2::block_align;
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        buffer = this->buffer_pool_memory->acquire_buffer();
+        buffer->initialize(len);
+    }
+
+    // noise that only depends on the hash
+    BYTE* data;
+    CHECK_HR(hr = buffer->buffer->Lock(&data, NULL, NULL));
+    {
+        payload_generator generator(frame.hash, frame.pos);
+        bit_depth_t* audio_data = (bit_depth_t*)data;
+        for(DWORD i = 0; i < len / sizeof(bit_depth_t); i++)
+            audio_data[i] = ((bit_depth_t)generator.next() / UINT32_MAX * 2.f - 1.f) * amplitude;
+    }
+    CHECK_HR(hr = buffer->buffer->Unlock());
+    CHECK_HR(hr = buffer->buffer->SetCurrentLength(len));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+    return buffer;
+}
+
+source_replay_audio::stream_source_base_t source_replay_audio::create_derived_stream()
+{
+    return stream_replay_audio_t(new stream_replay_audio(this->shared_from_this<source_replay_audio>()));
+}
+
+bool source_replay_audio::get_samples_end(time_unit request_time, frame_unit& end) const
+{
+    scoped_lock lock(this->schedule_mutex);
+    return this->schedule.get_samples_end(request_time, end);
+}
+
+void source_replay_audio::make_request(request_t& request, frame_unit frame_end)
+{
+    scoped_lock lock(this->schedule_mutex);
+
+    source_trace::frame_t trace_frame;
+    while(this->schedule.next_frame(frame_end, trace_frame))
+    {
+        if(trace_frame.dur <= 0)
+            continue;
+
+        media_sample_audio_mixer_frame frames;
+        frames.pos = trace_frame.pos;
+        frames.dur = trace_frame.dur;
+        if(!(trace_frame.flags & source_trace::FRAME_NULL_BUFFER))
+        {
+            frames.memory_host = this->make_buffer(trace_frame);
+            frames.buffer = frames.memory_host->buffer;
+        }
+
+        this->pending_frames->add_consecutive_frames(frames);
+    }
+
+    request.sample.args = std::make_optional<media_component_audiomixer_args>();
+    media_component_audiomixer_args& args = *request.sample.args;
+    args.frame_end = frame_end;
+
+    media_sample_audio_mixer_frames_t sample;
+    {
+        buffer_pool_audio_frames_t::scoped_lock lock(this->buffer_pool_audio_frames->mutex);
+        sample = this->buffer_pool_audio_frames->acquire_buffer();
+        sample->initialize();
+    }
+
+    // frames are simply skipped if there is no sample for the args
+    if(this->pending_frames->move_frames_to(sample.get(), frame_end,
+        transform_audiomixer2::block_align))
+        args.sample = std::move(sample);
+}
+
+void source_replay_audio::dispatch(request_t& request)
+{
+    this->session->give_sample(request.stream, request.sample.args.has_value() ?
+        &(*request.sample.args) : NULL, request.rp);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+stream_replay_audio::stream_replay_audio(const source_replay_audio_t& source) :
+    stream_source_base(source),
+    source(source)
+{
+}
+
+void stream_replay_audio::on_component_start(time_unit t)
+{
+    source_replay_audio::scoped_lock lock(this->source->schedule_mutex);
+    this->source->schedule.start(t);
+}
\ No newline at end of file
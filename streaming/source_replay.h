@@ -0,0 +1,149 @@
+#pragma once
+#include "source_base.h"
+#include "source_trace.h"
+#include "media_component.h"
+#include "media_stream.h"
+#include "media_sample.h"
+#include "transform_videomixer.h"
+#include "transform_audiomixer2.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+// replay sources reproduce the arrival pattern of a trace that was recorded by source_recorder;
+// the samples become available at the same request times relative to the start of the
+// replay as in the recording, which makes the replay deterministic against the request times
+// of the pipeline;
+// the payloads are synthesized from the recorded hashes, so that the frames with the same hash
+// have the same contents; the video frames are memory textures for the cpu videomixer;
+// after the end of the trace the sources serve frame skips
+
+// maps the trace to the time of the replay
+class source_replay_schedule final
+{
+private:
+    source_trace::trace_t trace;
+    frame_unit frame_rate_num, frame_rate_den;
+    bool started;
+    // the replay positions are the recorded positions plus the offsets
+    frame_unit frame_offset;
+    time_unit time_offset;
+    size_t next_frame;
+    // the largest recorded samples end
+    frame_unit last_samples_end;
+
+    // returns the amount of requests that were recorded at or before the replay time
+    size_t get_request_count(time_unit request_time) const;
+public:
+    source_replay_schedule();
+
+    // throws if the trace couldn't be read or doesn't match the session
+    void initialize(const std::wstring& path, source_trace::type_t, const media_session_t&);
+    // aligns the first request of the trace to the time; subsequent calls are ignored
+    void start(time_unit);
+
+    bool get_samples_end(time_unit request_time, frame_unit& end) const;
+    // returns the next frame of the trace if it starts before the frame end;
+    // the position of the frame is converted to the replay
+    bool next_frame(frame_unit frame_end, source_trace::frame_t&);
+};
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+class source_replay_video final : public source_base<media_component_videomixer_args>
+{
+    friend class stream_replay_video;
+public:
+    typedef buffer_pool<media_buffer_memory_texture_pooled> buffer_pool_memory_texture_t;
+    typedef buffer_pool<media_sample_video_mixer_frames_pooled> buffer_pool_video_frames_t;
+private:
+    mutable std::mutex schedule_mutex;
+    source_replay_schedule schedule;
+    // the frames that have arrived but haven't been served yet
+    media_sample_video_mixer_frames_t pending_frames;
+
+    std::shared_ptr<buffer_pool_memory_texture_t> buffer_pool_memory_texture;
+    std::shared_ptr<buffer_pool_video_frames_t> buffer_pool_video_frames;
+    // the buffer of the previous frame; reused for the repeated frames
+    media_buffer_memory_texture_t last_buffer;
+    uint64_t last_hash;
+
+    media_buffer_memory_texture_t make_buffer(const source_trace::frame_t&);
+
+    stream_source_base_t create_derived_stream() override;
+    bool get_samples_end(time_unit request_time, frame_unit& end) const override;
+    void make_request(request_t&, frame_unit frame_end) override;
+    void dispatch(request_t&) override;
+public:
+    explicit source_replay_video(const media_session_t& session);
+    ~source_replay_video();
+
+    void initialize(const control_class_t&, const std::wstring& path);
+};
+
+typedef std::shared_ptr<source_replay_video> source_replay_video_t;
+
+class stream_replay_video final :
+    public stream_source_base<source_base<media_component_videomixer_args>>
+{
+private:
+    source_replay_video_t source;
+    void on_component_start(time_unit) override;
+public:
+    explicit stream_replay_video(const source_replay_video_t&);
+};
+
+typedef std::shared_ptr<stream_replay_video> stream_replay_video_t;
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+class source_replay_audio final : public source_base<media_component_audiomixer_args>
+{
+    friend class stream_replay_audio;
+public:
+    typedef buffer_pool<media_buffer_memory_pooled> buffer_pool_memory_t;
+    typedef buffer_pool<media_sample_audio_mixer_frames_pooled> buffer_pool_audio_frames_t;
+    typedef float bit_depth_t;
+private:
+    mutable std::mutex schedule_mutex;
+    source_replay_schedule schedule;
+    // the frames that have arrived but haven't been served yet
+    media_sample_audio_mixer_frames_t pending_frames;
+
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    std::shared_ptr<buffer_pool_audio_frames_t> buffer_pool_audio_frames;
+
+    media_buffer_memory_t make_buffer(const source_trace::frame_t&);
+
+    stream_source_base_t create_derived_stream() override;
+    bool get_samples_end(time_unit request_time, frame_unit& end) const override;
+    void make_request(request_t&, frame_unit frame_end) override;
+    void dispatch(request_t&) override;
+public:
+    explicit source_replay_audio(const media_session_t& session);
+    ~source_replay_audio();
+
+    void initialize(const control_class_t&, const std::wstring& path);
+};
+
+typedef std::shared_ptr<source_replay_audio> source_replay_audio_t;
+
+class stream_replay_audio final :
+    public stream_source_base<source_base<media_component_audiomixer_args>>
+{
+private:
+    source_replay_audio_t source;
+    void on_component_start(time_unit) override;
+public:
+    explicit stream_replay_audio(const source_replay_audio_t&);
+};
+
+typedef std::shared_ptr<stream_replay_audio> stream_replay_audio_t;
\ No newline at end of file
@@ -0,0 +1,588 @@
+#include "source_synthetic.h"
+#include "assert.h"
+#include "logger.h"
+#include "metrics.h"
+#include <Mferror.h>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#undef max
+#undef min
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
+
+synthetic_delivery::synthetic_delivery() :
+    stopping(false),
+    next_packet(0),
+    start_timestamp(0)
+{
+}
+
+synthetic_delivery::~synthetic_delivery()
+{
+    this->stop();
+}
+
+time_unit synthetic_delivery::get_packets_time(int64_t packet_count) const
+{
+    // a faster source clock produces the packets in less real time
+    return (time_unit)(packet_count * this->params.packet_duration /
+        (1.0 + this->params.drift_ppm / 1000000.0));
+}
+
+void synthetic_delivery::start(const synthetic_delivery_params& params,
+    time_unit start_timestamp, callback_t&& callback)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if(this->thread.joinable())
+        return;
+
+    assert_(params.packet_duration > 0);
+
+    this->params = params;
+    this->params.burst_length = std::max(this->params.burst_length, 1);
+    this->callback = std::move(callback);
+    this->random_generator.seed(params.seed);
+    this->next_packet = 0;
+    this->start_time = clock_t::now();
+    this->start_timestamp = start_timestamp;
+    this->stopping = false;
+    this->thread = std::thread(&synthetic_delivery::thread_proc, this);
+}
+
+void synthetic_delivery::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if(!this->thread.joinable())
+            return;
+        this->stopping = true;
+    }
+
+    this->cv.notify_one();
+    this->thread.join();
+}
+
+void synthetic_delivery::thread_proc()
+{
+    typedef std::chrono::duration<time_unit, std::ratio<1, SECOND_IN_TIME_UNIT>> time_unit_t;
+    std::uniform_int_distribution<time_unit> jitter(0, std::max(this->params.jitter, (time_unit)0));
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while(!this->stopping)
+    {
+        // a burst is delivered once its last packet has been produced
+        const int64_t burst_end = this->next_packet + this->params.burst_length;
+        const time_unit due_time = this->get_packets_time(burst_end) + jitter(this->random_generator);
+
+        this->cv.wait_until(lock, this->start_time + time_unit_t(due_time));
+        if(this->stopping)
+            break;
+
+        const int64_t first_packet = this->next_packet;
+        this->next_packet = burst_end;
+        lock.unlock();
+
+        try
+        {
+            for(int64_t i = first_packet; i < burst_end; i++)
+                this->callback(i, this->start_timestamp + this->get_packets_time(i));
+        }
+        catch(streaming::exception e)
+        {
+            streaming::print_error_and_abort(e.what());
+        }
+
+        lock.lock();
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+source_synthetic_video::source_synthetic_video(const media_session_t& session,
+    context_mutex_t context_mutex) :
+    source_base(session),
+    last_frame_pos(std::numeric_limits<frame_unit>::min()),
+    buffer_pool_memory_texture(new buffer_pool_memory_texture_t(
+        "source_synthetic_video::buffer_pool_memory_texture")),
+    buffer_pool_texture(new buffer_pool_texture_t("source_synthetic_video::buffer_pool_texture")),
+    context_mutex(context_mutex),
+    last_box{0, 0, 0, 0}
+{
+}
+
+source_synthetic_video::~source_synthetic_video()
+{
+    // the delivery thread must not access the source anymore
+    this->delivery.stop();
+
+    {
+        buffer_pool_memory_texture_t::scoped_lock lock(this->buffer_pool_memory_texture->mutex);
+        this->buffer_pool_memory_texture->dispose();
+    }
+    {
+        buffer_pool_texture_t::scoped_lock lock(this->buffer_pool_texture->mutex);
+        this->buffer_pool_texture->dispose();
+    }
+}
+
+void source_synthetic_video::initialize(const control_class_t& ctrl_pipeline,
+    const params_t& params,
+    const CComPtr<ID3D11Device>& d3d11dev,
+    const CComPtr<ID3D11DeviceContext>& d3d11devctx)
+{
+    this->source_base::initialize(ctrl_pipeline);
+
+    assert_(params.width > 0 && params.height > 0);
+    assert_(params.frame_rate_num > 0 && params.frame_rate_den > 0);
+
+    this->params = params;
+    this->params.delivery.packet_duration =
+        convert_to_time_unit(1, params.frame_rate_num, params.frame_rate_den);
+    this->d3d11dev = d3d11dev;
+    this->d3d11devctx = d3d11devctx;
+
+    if(this->d3d11dev)
+        this->upload_buffer.reset(new BYTE[(size_t)params.width * 4 * params.height]);
+}
+
+void source_synthetic_video::render(int64_t frame, BYTE* data, UINT32 pitch,
+    dirty_region::rect_t& box)
+{
+    const int32_t width = (int32_t)this->params.width, height = (int32_t)this->params.height;
+    const int32_t row_bytes = width * 4;
+
+    if(this->params.pattern == PATTERN_NOISE)
+    {
+        // xorshift is fast enough to fill large frames at high frame rates
+        uint32_t state = (uint32_t)frame * 2654435761u + 1;
+        for(int32_t y = 0; y < height; y++)
+        {
+            uint32_t* row = (uint32_t*)(data + (size_t)y * pitch);
+            for(int32_t x = 0; x < width; x++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                row[x] = state | 0xff000000;
+            }
+        }
+
+        box = {0, 0, width, height};
+        return;
+    }
+
+    // color bars; bgra
+    static const uint32_t bar_colors[] =
+    {
+        0xffc0c0c0, 0xff00c0c0, 0xffc0c000, 0xff00c000,
+        0xffc000c0, 0xff0000c0, 0xffc00000, 0xff101010
+    };
+    static const int32_t bar_count = (int32_t)(sizeof(bar_colors) / sizeof(bar_colors[0]));
+
+    uint32_t* first_row = (uint32_t*)data;
+    for(int32_t x = 0; x < width; x++)
+        first_row[x] = bar_colors[std::min((int64_t)x * bar_count / width, (int64_t)bar_count - 1)];
+    for(int32_t y = 1; y < height; y++)
+        memcpy(data + (size_t)y * pitch, data, row_bytes);
+
+    // the box bounces between the edges and its shade changes every frame
+    auto bounce = [](int64_t pos, int32_t range) -> int32_t
+    {
+        if(range <= 0)
+            return 0;
+        const int64_t period_pos = pos % (2 * (int64_t)range);
+        return (int32_t)(period_pos < range ? period_pos : 2 * (int64_t)range - period_pos);
+    };
+
+    const int32_t box_size = std::max(std::min(width, height) / 6, 1);
+    const int32_t speed = std::max(std::min(width, height) / 120, 1);
+    box.left = bounce(frame * speed, width - box_size);
+    box.top = bounce(frame * speed * 3 / 4, height - box_size);
+    box.right = box.left + box_size;
+    box.bottom = box.top + box_size;
+
+    const uint32_t shade = (uint32_t)(frame & 0xff);
+    const uint32_t box_color = 0xff000000 | (shade << 16) | (shade << 8) | (0xff - shade);
+    for(int32_t y = box.top; y < box.bottom; y++)
+    {
+        uint32_t* row = (uint32_t*)(data + (size_t)y * pitch);
+        std::fill(row + box.left, row + box.right, box_color);
+    }
+}
+
+media_buffer_texture_t source_synthetic_video::make_buffer(int64_t frame,
+    dirty_region_t& changed_region)
+{
+    dirty_region::rect_t box;
+    media_buffer_texture_t buffer;
+
+    if(!this->d3d11dev)
+    {
+        media_buffer_memory_texture_t memory_buffer;
+        {
+            buffer_pool_memory_texture_t::scoped_lock lock(this->buffer_pool_memory_texture->mutex);
+            memory_buffer = this->buffer_pool_memory_texture->acquire_buffer();
+        }
+        memory_buffer->initialize(this->params.width, this->params.height);
+
+        this->render(frame, memory_buffer->texture_buffer.get(), memory_buffer->pitch, box);
+        buffer = memory_buffer;
+    }
+    else
+    {
+        // the pattern is rendered to system memory and uploaded
+        const UINT32 pitch = this->params.width * 4;
+        this->render(frame, this->upload_buffer.get(), pitch, box);
+
+        D3D11_TEXTURE2D_DESC desc;
+        desc.Width = this->params.width;
+        desc.Height = this->params.height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+        {
+            buffer_pool_texture_t::scoped_lock lock(this->buffer_pool_texture->mutex);
+            buffer = this->buffer_pool_texture->acquire_buffer();
+        }
+        buffer->initialize(this->d3d11dev, desc, NULL);
+
+        {
+            using scoped_lock = std::lock_guard<context_mutex_t::element_type>;
+            scoped_lock lock(*this->context_mutex);
+            this->d3d11devctx->UpdateSubresource(
+                buffer->texture, 0, NULL, this->upload_buffer.get(), pitch, 0);
+        }
+    }
+
+    // only the old and the new box area change in the moving box pattern
+    changed_region.reset();
+    if(this->params.pattern == PATTERN_MOVING_BOX && !this->last_box.empty())
+    {
+        std::shared_ptr<dirty_region> region(
+            new dirty_region((int32_t)this->params.width, (int32_t)this->params.height));
+        region->add(this->last_box);
+        region->add(box);
+        changed_region = region;
+    }
+    this->last_box = box;
+
+    return buffer;
+}
+
+void source_synthetic_video::deliver(int64_t frame, time_unit timestamp)
+{
+    const frame_unit fps_num = this->session->frame_rate_num,
+        fps_den = this->session->frame_rate_den;
+    const frame_unit pos = convert_to_frame_unit(timestamp, fps_num, fps_den);
+
+    // the frames of a source that is faster than the session are decimated
+    if(pos <= this->last_frame_pos)
+        return;
+    this->last_frame_pos = pos;
+
+    media_sample_video_mixer_frame new_frame;
+    new_frame.pos = pos;
+    new_frame.dur = 1;
+    new_frame.buffer = this->make_buffer(frame, new_frame.changed_region);
+
+    new_frame.params.source_rect.top = new_frame.params.source_rect.left = 0.f;
+    new_frame.params.source_rect.right = (FLOAT)this->params.width;
+    new_frame.params.source_rect.bottom = (FLOAT)this->params.height;
+    new_frame.params.dest_rect = new_frame.params.source_rect;
+    new_frame.params.source_m = new_frame.params.dest_m = D2D1::Matrix3x2F::Identity();
+    new_frame.opaque = true;
+
+    static metric& frames_generated = metrics::get_counter("synthetic_video_frames");
+    frames_generated.add();
+
+    scoped_lock lock(this->source_helper_mutex);
+    this->source_helper.add_new_sample(new_frame);
+}
+
+source_synthetic_video::stream_source_base_t source_synthetic_video::create_derived_stream()
+{
+    return stream_synthetic_video_t(
+        new stream_synthetic_video(this->shared_from_this<source_synthetic_video>()));
+}
+
+bool source_synthetic_video::get_samples_end(time_unit request_time, frame_unit& end) const
+{
+    scoped_lock lock(this->source_helper_mutex);
+    return this->source_helper.get_samples_end(request_time, end);
+}
+
+void source_synthetic_video::make_request(request_t& request, frame_unit frame_end)
+{
+    scoped_lock lock(this->source_helper_mutex);
+
+    request.sample.args = std::make_optional<media_component_videomixer_args>();
+    media_component_videomixer_args& args = *request.sample.args;
+
+    args.frame_end = frame_end;
+
+    media_sample_video_mixer_frames_t sample = this->source_helper.make_sample(frame_end);
+    if(args.sample)
+        sample->move_frames_to(args.sample.get(), frame_end);
+    else
+        args.sample = sample;
+
+    // the sample must not be empty
+    assert_(args.sample->is_valid());
+}
+
+void source_synthetic_video::dispatch(request_t& request)
+{
+    this->session->give_sample(request.stream, request.sample.args.has_value() ?
+        &(*request.sample.args) : NULL, request.rp);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+stream_synthetic_video::stream_synthetic_video(const source_synthetic_video_t& source) :
+    stream_source_base(source),
+    source(source)
+{
+}
+
+void stream_synthetic_video::on_component_start(time_unit t)
+{
+    {
+        source_synthetic_video::scoped_lock lock(this->source->source_helper_mutex);
+        this->source->source_helper.initialize(convert_to_frame_unit(t,
+            this->source->session->frame_rate_num,
+            this->source->session->frame_rate_den),
+            this->source->session->frame_rate_num,
+            this->source->session->frame_rate_den);
+    }
+
+    // the delivery is started only once
+    source_synthetic_video* source = this->source.get();
+    this->source->delivery.start(this->source->params.delivery, t,
+        [source](int64_t frame, time_unit timestamp) { source->deliver(frame, timestamp); });
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+source_synthetic_audio::source_synthetic_audio(const media_session_t& session) :
+    source_base(session),
+    buffer_pool_memory(new buffer_pool_memory_t("source_synthetic_audio::buffer_pool_memory")),
+    buffer_pool_audio_frames(new buffer_pool_audio_frames_t(
+        "source_synthetic_audio::buffer_pool_audio_frames")),
+    captured_audio(new media_sample_audio_mixer_frames),
+    next_frame_position(std::numeric_limits<frame_unit>::min()),
+    generated_frames(0),
+    phase(0.0)
+{
+}
+
+source_synthetic_audio::~source_synthetic_audio()
+{
+    // the delivery thread must not access the source anymore
+    this->delivery.stop();
+
+    {
+        buffer_pool_audio_frames_t::scoped_lock lock(this->buffer_pool_audio_frames->mutex);
+        this->buffer_pool_audio_frames->dispose();
+    }
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        this->buffer_pool_memory->dispose();
+    }
+}
+
+void source_synthetic_audio::initialize(const control_class_t& ctrl_pipeline, const params_t& params)
+{
+    this->source_base::initialize(ctrl_pipeline);
+
+    assert_(params.sample_rate > 0 && params.channels > 0);
+
+    this->params = params;
+    this->noise_generator.seed(params.delivery.seed + 1);
+
+    this->resampler.initialize(
+        (UINT32)this->session->frame_rate_num, transform_aac_encoder::channels,
+        transform_audiomixer2::bit_depth,
+        params.sample_rate, params.channels, sizeof(bit_depth_t) * 8);
+}
+
+void source_synthetic_audio::generate(bit_depth_t* data, UINT32 frames)
+{
+    static constexpr double two_pi = 6.283185307179586;
+    const UINT32 channels = this->params.channels;
+    const bit_depth_t amplitude = (bit_depth_t)this->params.amplitude;
+
+    if(this->params.signal == SIGNAL_NOISE)
+    {
+        std::uniform_real_distribution<bit_depth_t> noise(-amplitude, amplitude);
+        for(UINT32 i = 0; i < frames * channels; i++)
+            data[i] = noise(this->noise_generator);
+        return;
+    }
+
+    const double phase_increment = two_pi * this->params.frequency / this->params.sample_rate;
+    for(UINT32 i = 0; i < frames; i++)
+    {
+        const bit_depth_t val = (bit_depth_t)(std::sin(this->phase) * this->params.amplitude);
+        for(UINT32 j = 0; j < channels; j++)
+            data[i * channels + j] = val;
+
+        this->phase += phase_increment;
+        if(this->phase >= two_pi)
+            this->phase -= two_pi;
+    }
+}
+
+void source_synthetic_audio::deliver(int64_t packet, time_unit timestamp)
+{
+    HRESULT hr = S_OK;
+
+    // the frame count is derived from the packet count so that rounding doesn't accumulate;
+    // the drift only changes how fast the packets are produced
+    const frame_unit packets_end = convert_to_frame_unit(
+        (packet + 1) * this->params.delivery.packet_duration, this->params.sample_rate, 1);
+    const UINT32 frames = (UINT32)(packets_end - this->generated_frames);
+    const DWORD len = frames * this->params.channels * sizeof(bit_depth_t);
+    this->generated_frames = packets_end;
+
+    if(!frames)
+        return;
+
+    media_buffer_memory_t buffer;
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        buffer = this->buffer_pool_memory->acquire_buffer();
+        buffer->initialize(len);
+    }
+
+    BYTE* buffer_data;
+    CHECK_HR(hr = buffer->buffer->Lock(&buffer_data, NULL, NULL));
+    this->generate((bit_depth_t*)buffer_data, frames);
+    CHECK_HR(hr = buffer->buffer->Unlock());
+    CHECK_HR(hr = buffer->buffer->SetCurrentLength(len));
+
+    {
+        scoped_lock lock(this->captured_audio_mutex);
+
+        // the first packet sets the base; after that the position only advances by the
+        // generated frames, so a drifting source diverges from the session clock
+        if(packet == 0)
+            this->next_frame_position = convert_to_frame_unit(timestamp,
+                this->session->frame_rate_num, this->session->frame_rate_den);
+
+        media_sample_audio_mixer_frame new_frames;
+        new_frames.memory_host = buffer;
+        new_frames.pos = 0;
+        new_frames.dur = frames;
+        new_frames.buffer = buffer->buffer;
+        this->next_frame_position +=
+            this->resampler.resample(this->next_frame_position, new_frames,
+                *this->captured_audio, false);
+
+        // keep the buffer within the limits
+        if(this->captured_audio->is_valid() && this->captured_audio->move_frames_to(
+            NULL, this->captured_audio->get_end() - this->get_maximum_buffer_size(),
+            transform_audiomixer2::block_align))
+        {
+            static metric& discards = metrics::get_counter("synthetic_audio_buffer_limit_discards");
+            discards.add();
+            LOG_WARNING("source_synthetic_audio buffer limit reached, excess frames discarded");
+        }
+    }
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+source_synthetic_audio::stream_source_base_t source_synthetic_audio::create_derived_stream()
+{
+    return stream_synthetic_audio_t(
+        new stream_synthetic_audio(this->shared_from_this<source_synthetic_audio>()));
+}
+
+bool source_synthetic_audio::get_samples_end(time_unit /*request_time*/, frame_unit& end) const
+{
+    scoped_lock lock(this->captured_audio_mutex);
+    if(!this->captured_audio->is_valid())
+        return false;
+
+    end = this->captured_audio->get_end();
+    return true;
+}
+
+void source_synthetic_audio::make_request(request_t& request, frame_unit frame_end)
+{
+    request.sample.args = std::make_optional<media_component_audiomixer_args>();
+    media_component_audiomixer_args& args = *request.sample.args;
+
+    media_sample_audio_mixer_frames_t captured_audio;
+    if(!args.sample)
+    {
+        buffer_pool_audio_frames_t::scoped_lock lock(this->buffer_pool_audio_frames->mutex);
+        captured_audio = this->buffer_pool_audio_frames->acquire_buffer();
+        captured_audio->initialize();
+    }
+    else
+        captured_audio = args.sample;
+
+    scoped_lock lock(this->captured_audio_mutex);
+    const bool moved = this->captured_audio->move_frames_to(captured_audio.get(), frame_end,
+        transform_audiomixer2::block_align);
+
+    args.frame_end = frame_end;
+    // frames are simply skipped if there is no sample for the args
+    if(moved)
+    {
+        args.sample = std::move(captured_audio);
+        // the sample must be valid
+        assert_(args.sample->is_valid());
+    }
+}
+
+void source_synthetic_audio::dispatch(request_t& request)
+{
+    this->session->give_sample(request.stream, request.sample.args.has_value() ?
+        &(*request.sample.args) : NULL, request.rp);
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+stream_synthetic_audio::stream_synthetic_audio(const source_synthetic_audio_t& source) :
+    stream_source_base(source),
+    source(source)
+{
+}
+
+void stream_synthetic_audio::on_component_start(time_unit t)
+{
+    // the delivery is started only once
+    source_synthetic_audio* source = this->source.get();
+    this->source->delivery.start(this->source->params.delivery, t,
+        [source](int64_t packet, time_unit timestamp) { source->deliver(packet, timestamp); });
+}
\ No newline at end of file
@@ -0,0 +1,250 @@
+#pragma once
+#include "source_base.h"
+#include "video_source_helper.h"
+#include "media_component.h"
+#include "media_stream.h"
+#include "media_sample.h"
+#include "transform_videomixer.h"
+#include "transform_audiomixer2.h"
+#include "transform_aac_encoder.h"
+#include "audio_resampler.h"
+#include "dirty_region.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <d3d11.h>
+
+// synthetic sources for load generation;
+// the sources generate their content on a delivery thread that behaves like a capture device,
+// so that the mixers, encoders and the scheduler can be benchmarked with any amount of sources
+// without capture hardware
+
+// the timing of the packets of a synthetic source
+struct synthetic_delivery_params
+{
+    // the duration of a packet
+    time_unit packet_duration;
+    // the maximum random delay of a delivery; the timestamps aren't affected
+    time_unit jitter;
+    // the amount of packets that are delivered at once
+    int burst_length;
+    // the source clock runs faster than the session clock if positive
+    double drift_ppm;
+    // sources with the same seed deliver identically
+    unsigned int seed;
+
+    synthetic_delivery_params() :
+        packet_duration(SECOND_IN_TIME_UNIT / 100), jitter(0), burst_length(1), drift_ppm(0.0), seed(0) {}
+};
+
+// delivery thread of a synthetic source
+class synthetic_delivery final
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+    // called on the delivery thread for each packet with the index of the packet and
+    // the session time at which the packet was produced
+    typedef std::function<void(int64_t packet, time_unit timestamp)> callback_t;
+private:
+    synthetic_delivery_params params;
+    callback_t callback;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+    std::thread thread;
+
+    std::mt19937 random_generator;
+    int64_t next_packet;
+    clock_t::time_point start_time;
+    time_unit start_timestamp;
+
+    // the real time that has passed when the source clock has produced the packets
+    time_unit get_packets_time(int64_t packet_count) const;
+    void thread_proc();
+public:
+    synthetic_delivery();
+    ~synthetic_delivery();
+
+    // the first packet is produced at start_timestamp
+    void start(const synthetic_delivery_params&, time_unit start_timestamp, callback_t&&);
+    void stop();
+    bool is_started() const {return this->thread.joinable();}
+};
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+// generates a moving test pattern at any resolution and frame rate;
+// the frames are memory textures for the cpu videomixer if the source isn't initialized
+// with a device; otherwise the frames are uploaded to textures
+class source_synthetic_video final : public source_base<media_component_videomixer_args>
+{
+    friend class stream_synthetic_video;
+public:
+    typedef buffer_pool<media_buffer_memory_texture_pooled> buffer_pool_memory_texture_t;
+    typedef buffer_pool<media_buffer_pooled_texture> buffer_pool_texture_t;
+
+    enum pattern_t
+    {
+        // color bars with a bouncing box; only the box changes between the frames
+        PATTERN_MOVING_BOX,
+        // every pixel changes between the frames; the worst case for the encoder
+        PATTERN_NOISE
+    };
+
+    struct params_t
+    {
+        UINT32 width, height;
+        // the frame rate of the source; it doesn't need to match the session frame rate
+        frame_unit frame_rate_num, frame_rate_den;
+        pattern_t pattern;
+        // the packet duration of the delivery is the frame duration
+        synthetic_delivery_params delivery;
+
+        params_t() : width(1280), height(720), frame_rate_num(60), frame_rate_den(1),
+            pattern(PATTERN_MOVING_BOX) {}
+    };
+private:
+    params_t params;
+    synthetic_delivery delivery;
+
+    mutable std::mutex source_helper_mutex;
+    video_source_helper source_helper;
+    // the position of the newest frame in the session frame rate
+    frame_unit last_frame_pos;
+
+    std::shared_ptr<buffer_pool_memory_texture_t> buffer_pool_memory_texture;
+    std::shared_ptr<buffer_pool_texture_t> buffer_pool_texture;
+    context_mutex_t context_mutex;
+    CComPtr<ID3D11Device> d3d11dev;
+    CComPtr<ID3D11DeviceContext> d3d11devctx;
+
+    // accessed by the delivery thread only;
+    // the box position of the previous frame
+    dirty_region::rect_t last_box;
+    // the pattern is rendered here before it is uploaded to a texture
+    std::unique_ptr<BYTE[]> upload_buffer;
+
+    void render(int64_t frame, BYTE* data, UINT32 pitch, dirty_region::rect_t& box);
+    media_buffer_texture_t make_buffer(int64_t frame, dirty_region_t& changed_region);
+    void deliver(int64_t frame, time_unit timestamp);
+
+    stream_source_base_t create_derived_stream() override;
+    bool get_samples_end(time_unit request_time, frame_unit& end) const override;
+    void make_request(request_t&, frame_unit frame_end) override;
+    void dispatch(request_t&) override;
+public:
+    source_synthetic_video(const media_session_t& session, context_mutex_t);
+    ~source_synthetic_video();
+
+    void get_size(UINT32& width, UINT32& height) const
+    { width = this->params.width; height = this->params.height; }
+
+    // the device can be null
+    void initialize(const control_class_t&,
+        const params_t&,
+        const CComPtr<ID3D11Device>&,
+        const CComPtr<ID3D11DeviceContext>&);
+};
+
+typedef std::shared_ptr<source_synthetic_video> source_synthetic_video_t;
+
+class stream_synthetic_video final :
+    public stream_source_base<source_base<media_component_videomixer_args>>
+{
+private:
+    source_synthetic_video_t source;
+    void on_component_start(time_unit) override;
+public:
+    explicit stream_synthetic_video(const source_synthetic_video_t&);
+};
+
+typedef std::shared_ptr<stream_synthetic_video> stream_synthetic_video_t;
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+// generates a tone or noise at any sample rate;
+// the audio is resampled to the session sample rate;
+// with a drift, the amount of the generated frames diverges from the session clock
+// like with a real device
+class source_synthetic_audio final : public source_base<media_component_audiomixer_args>
+{
+    friend class stream_synthetic_audio;
+public:
+    typedef buffer_pool<media_buffer_memory_pooled> buffer_pool_memory_t;
+    typedef buffer_pool<media_sample_audio_mixer_frames_pooled> buffer_pool_audio_frames_t;
+    typedef float bit_depth_t;
+
+    enum signal_t {SIGNAL_TONE, SIGNAL_NOISE};
+
+    struct params_t
+    {
+        UINT32 sample_rate, channels;
+        signal_t signal;
+        // the frequency of the tone
+        double frequency;
+        double amplitude;
+        synthetic_delivery_params delivery;
+
+        params_t() : sample_rate(48000), channels(2), signal(SIGNAL_TONE),
+            frequency(440.0), amplitude(0.2) {}
+    };
+private:
+    params_t params;
+    synthetic_delivery delivery;
+    audio_resampler resampler;
+
+    mutable std::mutex captured_audio_mutex;
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    std::shared_ptr<buffer_pool_audio_frames_t> buffer_pool_audio_frames;
+    media_sample_audio_mixer_frames_t captured_audio;
+    // the position of the next resampled frame; set by the first packet
+    frame_unit next_frame_position;
+
+    // accessed by the delivery thread only
+    frame_unit generated_frames;
+    double phase;
+    std::minstd_rand noise_generator;
+
+    // one second
+    frame_unit get_maximum_buffer_size() const { return this->session->frame_rate_num; }
+
+    void generate(bit_depth_t* data, UINT32 frames);
+    void deliver(int64_t packet, time_unit timestamp);
+
+    stream_source_base_t create_derived_stream() override;
+    bool get_samples_end(time_unit request_time, frame_unit& end) const override;
+    void make_request(request_t&, frame_unit frame_end) override;
+    void dispatch(request_t&) override;
+public:
+    explicit source_synthetic_audio(const media_session_t& session);
+    ~source_synthetic_audio();
+
+    void initialize(const control_class_t&, const params_t&);
+};
+
+typedef std::shared_ptr<source_synthetic_audio> source_synthetic_audio_t;
+
+class stream_synthetic_audio final :
+    public stream_source_base<source_base<media_component_audiomixer_args>>
+{
+private:
+    source_synthetic_audio_t source;
+    void on_component_start(time_unit) override;
+public:
+    explicit stream_synthetic_audio(const source_synthetic_audio_t&);
+};
+
+typedef std::shared_ptr<stream_synthetic_audio> stream_synthetic_audio_t;
\ No newline at end of file
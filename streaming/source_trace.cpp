@@ -0,0 +1,130 @@
+#include "source_trace.h"
+#include <cstring>
+#include <filesystem>
+
+#undef min
+#undef max
+
+namespace source_trace
+{
+
+uint64_t hash(const void* data, size_t len, uint64_t seed)
+{
+    // multiply and xorshift over 8 byte words
+    static constexpr uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t h = seed ^ (len * multiplier);
+    for(; len >= sizeof(uint64_t); len -= sizeof(uint64_t), bytes += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(uint64_t));
+        h = (h ^ word) * multiplier;
+        h ^= h >> 29;
+    }
+
+    uint64_t word = 0;
+    memcpy(&word, bytes, len);
+    h = (h ^ word) * multiplier;
+    h ^= h >> 32;
+
+    // 0 is reserved for the payloads that weren't hashed
+    return h ? h : 1;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+writer::writer() : failed(false)
+{
+}
+
+bool writer::open(const std::wstring& path, type_t type,
+    int64_t frame_rate_num, int64_t frame_rate_den)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    header_t header = {};
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.type = type;
+    header.frame_rate_num = frame_rate_num;
+    header.frame_rate_den = frame_rate_den;
+
+    // the path overloads of the wide strings are msvc extensions
+    this->file.open(std::filesystem::path(path), std::ios::out | std::ios::binary | std::ios::trunc);
+    this->failed = !this->file ||
+        !this->file.write((const char*)&header, sizeof(header));
+    return !this->failed;
+}
+
+bool writer::write(const request_t& request, const frame_t* frames)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if(this->failed)
+        return false;
+
+    this->file.write((const char*)&request, sizeof(request));
+    if(request.frame_count)
+        this->file.write((const char*)frames, sizeof(frame_t) * request.frame_count);
+
+    this->failed = !this->file;
+    return !this->failed;
+}
+
+void writer::close()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->file.close();
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+bool read(const std::wstring& path, trace_t& trace)
+{
+    std::ifstream file(std::filesystem::path(path), std::ios::in | std::ios::binary);
+    if(!file)
+        return false;
+
+    if(!file.read((char*)&trace.header, sizeof(trace.header)) ||
+        memcmp(trace.header.magic, magic, sizeof(magic)) != 0 ||
+        trace.header.version != version ||
+        trace.header.frame_rate_num <= 0 || trace.header.frame_rate_den <= 0)
+        return false;
+
+    trace.requests.clear();
+    trace.first_frames.clear();
+    trace.frames.clear();
+
+    request_t request;
+    while(file.read((char*)&request, sizeof(request)))
+    {
+        // a corrupted frame count is treated like a truncation
+        if(request.frame_count > max_frame_count)
+            break;
+
+        const size_t first_frame = trace.frames.size();
+        trace.frames.resize(first_frame + request.frame_count);
+        if(request.frame_count && !file.read((char*)&trace.frames[first_frame],
+            sizeof(frame_t) * request.frame_count))
+        {
+            // the last request was truncated
+            trace.frames.resize(first_frame);
+            break;
+        }
+
+        trace.requests.push_back(request);
+        trace.first_frames.push_back(first_frame);
+    }
+
+    return true;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+
+// compact binary file of the samples that a source has served;
+// the file consists of a header and a list of requests that are each followed by
+// the frames that were served with the request;
+// the payloads are stored as hashes only, so the file stays small enough to record
+// long captures; the integers are stored in the native byte order
+
+namespace source_trace
+{
+
+enum type_t : uint32_t {TYPE_VIDEO, TYPE_AUDIO};
+
+enum request_flags_t : uint32_t
+{
+    // the source had samples available; the samples end is valid
+    REQUEST_VALID_END = 1,
+    // the request was served with a sample
+    REQUEST_HAS_SAMPLE = 2
+};
+
+enum frame_flags_t : uint32_t
+{
+    FRAME_NULL_BUFFER = 1,
+    FRAME_UNCHANGED = 2
+};
+
+#pragma pack(push, 1)
+struct header_t
+{
+    char magic[4];
+    uint32_t version;
+    type_t type;
+    uint32_t reserved;
+    // the frame rate of the session that was recorded
+    int64_t frame_rate_num, frame_rate_den;
+};
+
+struct request_t
+{
+    int64_t request_time;
+    int64_t samples_end;
+    // the end of the served sample
+    int64_t frame_end;
+    uint32_t flags;
+    uint32_t frame_count;
+};
+
+struct frame_t
+{
+    int64_t pos, dur;
+    // 0 if the payload wasn't hashed
+    uint64_t hash;
+    uint32_t flags;
+    // 0 for audio frames
+    uint32_t width, height;
+};
+#pragma pack(pop)
+
+static constexpr char magic[4] = {'S', 'T', 'R', 'C'};
+static constexpr uint32_t version = 1;
+// the maximum amount of frames of a request that the reader accepts
+static constexpr uint32_t max_frame_count = 1 << 16;
+
+// fast non cryptographic hash; never returns 0;
+// the previous hash can be passed as the seed for hashing discontinuous data
+uint64_t hash(const void* data, size_t len, uint64_t seed = 0);
+
+// the writer is multithread safe
+class writer
+{
+private:
+    std::mutex mutex;
+    std::ofstream file;
+    bool failed;
+public:
+    writer();
+
+    // returns false if the file couldn't be created
+    bool open(const std::wstring& path, type_t, int64_t frame_rate_num, int64_t frame_rate_den);
+    // returns false if the writing has failed; the file is left truncated then
+    bool write(const request_t&, const frame_t* frames);
+    void close();
+};
+
+// the trace that is read fully into memory
+struct trace_t
+{
+    header_t header;
+    std::vector<request_t> requests;
+    // index of the first frame of each request
+    std::vector<size_t> first_frames;
+    std::vector<frame_t> frames;
+};
+
+// returns false if the file couldn't be read or is not a valid trace;
+// the requests of a truncated file are read up to the truncation point
+bool read(const std::wstring& path, trace_t&);
+
+}
\ No newline at end of file
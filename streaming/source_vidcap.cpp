@@ -2,6 +2,7 @@
 #include "transform_videomixer.h"
 #include "assert.h"
 #include "wtl.h"
+#include "logger.h"
 #include <Dbt.h>
 #include <ks.h>
 #include <ksmedia.h>
@@ -228,20 +229,20 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
         //  this is assumed to be singlethreaded
         if((flags & MF_SOURCE_READERF_ENDOFSTREAM) || (flags & MF_SOURCE_READERF_ERROR))
         {
-            std::cout << "end of stream" << std::endl;
+            LOG_INFO("source_vidcap end of stream");
             source->set_broken();
         }
         if(flags & MF_SOURCE_READERF_NEWSTREAM)
         {
-            std::cout << "new stream" << std::endl;
+            LOG_INFO("source_vidcap new stream");
         }
         if(flags & MF_SOURCE_READERF_NATIVEMEDIATYPECHANGED)
         {
-            std::cout << "native mediatype changed" << std::endl;
+            LOG_INFO("source_vidcap native mediatype changed");
         }
         if(flags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED)
         {
-            std::cout << "current mediatype changed" << std::endl;
+            LOG_INFO("source_vidcap current mediatype changed");
 
             source->output_type = NULL;
 
@@ -263,7 +264,7 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
         }
         if(flags & MF_SOURCE_READERF_STREAMTICK)
         {
-            std::cout << "stream tick" << std::endl;
+            LOG_DEBUG("source_vidcap stream tick");
         }
 
         if(sample)
@@ -277,7 +278,7 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
 
             if(!clock)
             {
-                std::cout << "clock was not initialized" << std::endl;
+                LOG_WARNING("clock was not initialized");
                 goto done;
             }
 
@@ -301,7 +302,7 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
             if(source->next_frame_pos < 0 ||
                 std::abs(real_timestamp - calculated_timestamp) > (frame_interval / 2))
             {
-                std::cout << "source_vidcap time base reset" << std::endl;
+                LOG_INFO("source_vidcap time base reset");
                 source->next_frame_pos = convert_to_frame_unit(real_timestamp, fps_num, fps_den);
             }
 
@@ -313,7 +314,7 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
             // media foundation has a limit for pooled samples and if it is reached
             // media foundation begins to stall
             {
-                using scoped_lock = std::lock_guard<std::recursive_mutex>;
+                using scoped_lock = std::lock_guard<context_mutex_t::element_type>;
                 scoped_lock lock(*source->context_mutex);
                 source->d3d11devctx->CopyResource(frame.buffer->texture, texture);
             }
@@ -323,6 +324,7 @@ HRESULT source_vidcap::source_reader_callback_t::OnReadSample(HRESULT hr, DWORD
             frame.params.source_rect.bottom = (FLOAT)source->frame_height;
             frame.params.dest_rect = frame.params.source_rect;
             frame.params.source_m = frame.params.dest_m = D2D1::Matrix3x2F::Identity();
+            frame.opaque = true;
 
             // add the frame
             {
@@ -346,7 +348,7 @@ done:
         else if(FAILED(hr) && hr != MF_E_SHUTDOWN)
         {
             if(!source->is_broken())
-                std::cout << "error code: " << std::hex << "0x" << hr << std::dec << std::endl;
+                LOG_ERROR("source_vidcap error code: {}", log_hex(hr));
             this->on_error(source);
         }
     }
@@ -367,7 +369,7 @@ done:
 source_vidcap::source_vidcap(const media_session_t& session, context_mutex_t context_mutex) :
     source_base(session),
     context_mutex(context_mutex),
-    buffer_pool_texture(new buffer_pool_texture_t),
+    buffer_pool_texture(new buffer_pool_texture_t("source_vidcap::buffer_pool_texture")),
     frame_width(0), frame_height(0), 
     next_frame_pos(-1),
     is_capture_initialized(false), is_helper_initialized(false),
@@ -2,6 +2,8 @@
 #include "assert.h"
 #include "control_pipeline.h"
 #include "transform_aac_encoder.h"
+#include "logger.h"
+#include "metrics.h"
 #include <initguid.h>
 #include <mmdeviceapi.h>
 #include <audiopolicy.h>
@@ -23,8 +25,9 @@ source_wasapi::source_wasapi(const media_session_t& session) :
     native_frame_base(std::numeric_limits<frame_unit>::min()),
     set_new_frame_base(true),
     next_frame_position(std::numeric_limits<frame_unit>::min()),
-    buffer_pool_memory(new buffer_pool_memory_t),
-    buffer_pool_audio_frames(new buffer_pool_audio_frames_t),
+    buffer_pool_memory(new buffer_pool_memory_t("source_wasapi::buffer_pool_memory")),
+    buffer_pool_audio_frames(new buffer_pool_audio_frames_t(
+        "source_wasapi::buffer_pool_audio_frames")),
     captured_audio(new media_sample_audio_mixer_frames),
     sine_wave_counter(0.0)
 {
@@ -44,7 +47,7 @@ source_wasapi::~source_wasapi()
         this->buffer_pool_memory->dispose();
     }
 
-    std::cout << "stopping wasapi..." << std::endl;
+    LOG_INFO("stopping wasapi...");
 
     HRESULT hr = S_OK;
 
@@ -177,7 +180,7 @@ void source_wasapi::capture_cb(void*)
             if(flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR)
             {
                 this->set_new_frame_base = true;
-                std::cout << "TIMESTAMP ERROR" << std::endl;
+                LOG_WARNING("wasapi timestamp error");
             }
 
             getbuffer = false;
@@ -190,13 +193,12 @@ void source_wasapi::capture_cb(void*)
 
         if((flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) || this->set_new_frame_base)
         {
-            std::cout << "DATA DISCONTINUITY, " << devposition << ", "
-                << devposition + frames << std::endl;
+            LOG_WARNING("wasapi data discontinuity, {}, {}", devposition, devposition + frames);
 
             media_clock_t clock = this->session->get_clock();
             if(!clock)
             {
-                std::cout << "time source was not initialized" << std::endl;
+                LOG_WARNING("time source was not initialized");
                 this->set_new_frame_base = true;
                 goto done;
             }
@@ -277,7 +279,9 @@ void source_wasapi::capture_cb(void*)
                 NULL, this->captured_audio->get_end() - this->get_maximum_buffer_size(), 
                 this->resampled_block_align))
             {
-                std::cout << "source_wasapi buffer limit reached, excess frames discarded" << std::endl;
+                static metric& discards = metrics::get_counter("wasapi_buffer_limit_discards");
+                discards.add();
+                LOG_WARNING("source_wasapi buffer limit reached, excess frames discarded");
             }
         }
     }
@@ -293,7 +297,7 @@ done:
         if(hr == AUDCLNT_E_DEVICE_INVALIDATED || hr == AUDCLNT_E_SERVICE_NOT_RUNNING)
         {
             if(!this->is_broken())
-                std::cout << "error code: " << std::hex << "0x" << hr << std::dec << std::endl;
+                LOG_ERROR("source_wasapi error code: {}", log_hex(hr));
             this->set_broken();
         }
         else
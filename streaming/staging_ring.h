@@ -0,0 +1,54 @@
+#pragma once
+
+#include "assert.h"
+#include <stddef.h>
+#include <vector>
+
+// schedules the copies that go through a ring of staging slots;
+// a copy is submitted to the next free slot and the slots are completed in the
+// submission order, so that an older copy can be read back while the newer copies
+// are still in flight on the gpu;
+// when all slots are in flight, the oldest one must be completed before the next submission;
+// has no graphics api dependencies
+
+template<typename Slot>
+class staging_ring
+{
+private:
+    std::vector<Slot> slots;
+    // the oldest slot in flight
+    size_t first;
+    size_t in_flight;
+public:
+    explicit staging_ring(size_t size) : slots(size), first(0), in_flight(0) {assert_(size > 0);}
+
+    size_t size() const {return this->slots.size();}
+    size_t get_in_flight() const {return this->in_flight;}
+    bool empty() const {return this->in_flight == 0;}
+    bool full() const {return this->in_flight == this->slots.size();}
+
+    // the slot that the next copy is submitted to
+    Slot& get_free()
+    {
+        assert_(!this->full());
+        return this->slots[(this->first + this->in_flight) % this->slots.size()];
+    }
+    void submit() {assert_(!this->full()); this->in_flight++;}
+
+    // the slot of the oldest copy in flight
+    Slot& get_oldest()
+    {
+        assert_(!this->empty());
+        return this->slots[this->first];
+    }
+    void complete()
+    {
+        assert_(!this->empty());
+        this->first = (this->first + 1) % this->slots.size();
+        this->in_flight--;
+    }
+
+    // the copies in flight are discarded; the slots are kept
+    void reset() {this->first = 0; this->in_flight = 0;}
+    std::vector<Slot>& get_slots() {return this->slots;}
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#include "staging_ring_test.h"
+#include "staging_ring.h"
+#include <deque>
+#include <random>
+#include <iostream>
+
+namespace
+{
+
+bool check(bool condition, const char* description)
+{
+    if(!condition)
+        std::cout << "staging ring test failed: " << description << std::endl;
+    return condition;
+}
+
+bool check_states()
+{
+    bool passed = true;
+    staging_ring<int> ring(3);
+
+    passed &= check(ring.size() == 3 && ring.empty() && !ring.full() &&
+        ring.get_in_flight() == 0, "start empty");
+
+    for(int i = 1; i <= 3; i++)
+    {
+        ring.get_free() = i;
+        ring.submit();
+    }
+    passed &= check(ring.full() && !ring.empty() && ring.get_in_flight() == 3,
+        "become full");
+    passed &= check(ring.get_oldest() == 1, "complete the oldest slot first");
+
+    // the freed slot is reused for the next submission
+    ring.complete();
+    passed &= check(!ring.full() && ring.get_in_flight() == 2, "free a slot");
+    passed &= check(&ring.get_free() == &ring.get_slots()[0], "wrap around to the first slot");
+    ring.get_free() = 4;
+    ring.submit();
+    passed &= check(ring.full(), "become full after the wraparound");
+
+    for(int i = 2; i <= 4; i++)
+    {
+        passed &= check(ring.get_oldest() == i, "complete in the submission order");
+        ring.complete();
+    }
+    passed &= check(ring.empty() && !ring.full(), "become empty");
+
+    ring.get_free() = 5;
+    ring.submit();
+    ring.reset();
+    passed &= check(ring.empty() && ring.size() == 3 && ring.get_slots()[1] == 5,
+        "discard the slots in flight and keep the slots");
+
+    staging_ring<int> single_ring(1);
+    single_ring.submit();
+    passed &= check(single_ring.full() &&
+        &single_ring.get_oldest() == &single_ring.get_slots()[0], "fill a ring of a single slot");
+    single_ring.complete();
+    passed &= check(single_ring.empty(), "empty a ring of a single slot");
+
+    return passed;
+}
+
+// the slots are submitted and completed in random order and compared to a queue
+bool check_wraparound()
+{
+    std::minstd_rand random_generator(1);
+
+    for(size_t size = 1; size <= 5; size++)
+    {
+        staging_ring<int> ring(size);
+        std::deque<int> in_flight;
+        int next_value = 0;
+
+        for(int i = 0; i < 1000; i++)
+        {
+            if(!ring.full() && (ring.empty() || random_generator() % 2 == 0))
+            {
+                ring.get_free() = next_value;
+                ring.submit();
+                in_flight.push_back(next_value++);
+            }
+            else
+            {
+                if(!check(ring.get_oldest() == in_flight.front(),
+                    "complete in the submission order after the wraparound"))
+                    return false;
+                ring.complete();
+                in_flight.pop_front();
+            }
+
+            if(!check(ring.get_in_flight() == in_flight.size() &&
+                ring.empty() == in_flight.empty() && ring.full() == (in_flight.size() == size),
+                "count the slots in flight"))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+bool run_staging_ring_test()
+{
+    bool passed = true;
+    passed &= check_states();
+    passed &= check_wraparound();
+
+    std::cout << "staging ring test " << (passed ? "passed" : "failed") << std::endl;
+    return passed;
+}
\ No newline at end of file
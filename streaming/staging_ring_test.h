@@ -0,0 +1,9 @@
+#pragma once
+
+// checks for the staging ring of the desktop capture;
+// the empty and full states, the wraparound of the slots and the submission order of
+// the completed slots are checked against a queue;
+// the test has no dependencies on the pipeline
+
+// returns false if a check failed; the failed checks are printed
+bool run_staging_ring_test();
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "transform_aac_encoder.h"
+#include "logger.h"
 #include <Mferror.h>
 #include <iostream>
 
@@ -10,7 +11,7 @@ transform_aac_encoder::transform_aac_encoder(const media_session_t& session) :
     media_component(session),
     last_time_stamp(std::numeric_limits<frame_unit>::min()),
     time_shift(-1),
-    buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_memory(new buffer_pool_memory_t("transform_aac_encoder::buffer_pool_memory")),
     encoded_audio(new media_sample_aac_frames),
     dispatcher(new request_dispatcher)
 {
@@ -106,7 +107,7 @@ bool transform_aac_encoder::encode(const media_sample_audio_frames* in_frames,
     };
     auto drain_all = [&]()
     {
-        std::cout << "drain on aac encoder" << std::endl;
+        LOG_DEBUG("drain on aac encoder");
 
         HRESULT hr = S_OK;
         CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
@@ -144,7 +145,7 @@ bool transform_aac_encoder::encode(const media_sample_audio_frames* in_frames,
             {
                 LONGLONG off = time;
                 time = 0;
-                std::cout << "aac encoder time shift was off by " << off << std::endl;
+                LOG_WARNING("aac encoder time shift was off by {}", off);
             }
 
             CHECK_HR(hr = in_sample->SetSampleTime(time));
@@ -357,7 +358,8 @@ media_stream_t transform_aac_encoder::create_stream(media_message_generator_t&&
 stream_aac_encoder::stream_aac_encoder(const transform_aac_encoder_t& transform) : 
     media_stream_message_listener(transform.get()),
     transform(transform),
-    buffer_pool_aac_frames(new buffer_pool_aac_frames_t),
+    buffer_pool_aac_frames(new buffer_pool_aac_frames_t(
+        "stream_aac_encoder::buffer_pool_aac_frames")),
     stopping(false)
 {
 }
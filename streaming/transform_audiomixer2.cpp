@@ -1,6 +1,7 @@
 #include "transform_audiomixer2.h"
 #include "transform_aac_encoder.h"
 #include "assert.h"
+#include "logger.h"
 #include <Mferror.h>
 #include <iostream>
 #include <limits>
@@ -10,10 +11,12 @@
 #undef max
 
 transform_audiomixer2::transform_audiomixer2(const media_session_t& session) :
-    transform_audiomixer2_base(session),
-    buffer_pool_memory(new buffer_pool_memory_t),
-    buffer_pool_audio_frames(new buffer_pool_audio_frames_t),
-    buffer_pool_audio_mixer_frames(new buffer_pool_audio_mixer_frames_t)
+    transform_audiomixer2_base(session, "audiomixer"),
+    buffer_pool_memory(new buffer_pool_memory_t("transform_audiomixer2::buffer_pool_memory")),
+    buffer_pool_audio_frames(new buffer_pool_audio_frames_t(
+        "transform_audiomixer2::buffer_pool_audio_frames")),
+    buffer_pool_audio_mixer_frames(new buffer_pool_audio_mixer_frames_t(
+        "transform_audiomixer2::buffer_pool_audio_mixer_frames"))
 {
 }
 
@@ -69,7 +72,7 @@ bool stream_audiomixer2::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_
         to->frame_end = end;
 
         if(discarded)
-            std::cout << "discarded audio frames" << std::endl;
+            LOG_WARNING("discarded audio frames");
 
         return true;
     }
@@ -112,7 +115,7 @@ bool stream_audiomixer2::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_
         const bool moved = from->sample->move_frames_to(to->sample.get(), end,
             transform_audiomixer2::block_align);
         if(moved && discarded)
-            std::cout << "discarded audio frames" << std::endl;
+            LOG_WARNING("discarded audio frames");
     }
     if(end >= from->frame_end)
         from.reset();
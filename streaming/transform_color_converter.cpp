@@ -9,8 +9,9 @@
 transform_color_converter::transform_color_converter(
     const media_session_t& session, context_mutex_t context_mutex) :
     media_component(session),
-    texture_pool(new buffer_pool),
-    buffer_pool_video_frames(new buffer_pool_video_frames_t),
+    texture_pool(new buffer_pool("transform_color_converter::texture_pool")),
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "transform_color_converter::buffer_pool_video_frames")),
     context_mutex(context_mutex)
 {
 }
@@ -179,7 +180,26 @@ void stream_color_converter::process(media_component_h264_encoder_args_t& this_a
     {
         media_sample_video_frame frame(item.pos);
 
-        if(item.buffer)
+        // frames in system memory are passed as is;
+        // the encoder converts them on the cpu
+        if(item.buffer && !item.buffer->texture)
+        {
+            frame.buffer = item.buffer;
+            frame.unchanged = item.unchanged;
+        }
+
+        // unchanged frames reuse the last converted output
+        if(item.buffer && !frame.buffer && item.unchanged)
+        {
+            std::lock_guard<std::mutex> lock(this->last_frame_mutex);
+            if(item.buffer == this->last_input_buffer)
+            {
+                frame.buffer = this->last_output_buffer;
+                frame.unchanged = true;
+            }
+        }
+
+        if(item.buffer && !frame.buffer)
         {
             // TODO: acquire buffer here should also allocate device resources the same way
             // videomixer does
@@ -259,6 +279,10 @@ void stream_color_converter::process(media_component_h264_encoder_args_t& this_a
                 0, stream_count, &stream));
 
             frame.buffer = output_buffer;
+
+            std::lock_guard<std::mutex> last_frame_lock(this->last_frame_mutex);
+            this->last_input_buffer = item.buffer;
+            this->last_output_buffer = output_buffer;
         }
 
         frames->add_consecutive_frames(frame);
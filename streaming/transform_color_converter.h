@@ -9,15 +9,15 @@
 #include <mutex>
 #include <stack>
 
-// color space converter
-
-// TODO: allow upscaling and downscaling of the source texture
+// color space converter;
+// the video processor also scales the input texture to the output size;
+// frames in system memory are passed through unchanged
 
 class transform_color_converter : public media_component
 {
     friend class stream_color_converter;
 public:
-    typedef std::lock_guard<std::recursive_mutex> scoped_lock;
+    typedef std::lock_guard<context_mutex_t::element_type> scoped_lock;
     typedef buffer_pool<media_sample_video_frames_pooled> buffer_pool_video_frames_t;
     typedef buffer_pool<media_buffer_pooled_texture> buffer_pool;
 private:
@@ -51,11 +51,16 @@ typedef std::shared_ptr<transform_color_converter> transform_color_converter_t;
 class stream_color_converter : public media_stream
 {
 public:
-    typedef std::lock_guard<std::recursive_mutex> scoped_lock;
+    typedef std::lock_guard<context_mutex_t::element_type> scoped_lock;
 private:
     transform_color_converter_t transform;
     CComPtr<ID3D11VideoProcessor> videoprocessor;
 
+    std::mutex last_frame_mutex;
+    // the last converted input and its output;
+    // the input is referenced so that it won't be recycled while compared against
+    media_buffer_texture_t last_input_buffer, last_output_buffer;
+
     void initialize_buffer(const media_buffer_texture_t&);
     media_buffer_texture_t acquire_buffer();
     void process(media_component_h264_encoder_args_t& args, const request_packet&);
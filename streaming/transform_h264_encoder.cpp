@@ -5,6 +5,8 @@
 #include <iostream>
 #include "assert.h"
 #include "IUnknownImpl.h"
+#include "logger.h"
+#include "metrics.h"
 
 #pragma comment(lib, "dxguid.lib")
 
@@ -27,6 +29,8 @@ private:
     const bool use_system_memory;
     // memory corruption occurs if media_buffer_wrapper outlives media_sample_tracker
     media_buffer_texture_t buffer;
+    // the nv12 buffer for frames that were converted on the cpu
+    media_buffer_memory_t memory_buffer;
     CComPtr<IMFMediaBuffer> media_buffer;
 public:
     explicit media_buffer_wrapper(const context_mutex_t& /*context_mutex*/,
@@ -36,6 +40,10 @@ public:
         buffer(buffer), media_buffer(media_buffer), use_system_memory(use_system_memory)
     {
     }
+    explicit media_buffer_wrapper(const media_buffer_memory_t& memory_buffer) :
+        memory_buffer(memory_buffer), media_buffer(memory_buffer->buffer), use_system_memory(true)
+    {
+    }
 
     ULONG STDMETHODCALLTYPE AddRef() {return IUnknownImpl::AddRef();}
     ULONG STDMETHODCALLTYPE Release() {return IUnknownImpl::Release();}
@@ -98,6 +106,8 @@ transform_h264_encoder::transform_h264_encoder(const media_session_t& session,
     context_mutex_t context_mutex) :
     media_component(session),
     encoder_requests(0),
+    key_frame_requested(false),
+    last_forced_key_frame_time(-forced_key_frame_interval),
     last_time_stamp(std::numeric_limits<time_unit>::min()),
     last_time_stamp2(std::numeric_limits<time_unit>::min()),
     last_packet(std::numeric_limits<int>::min()),
@@ -107,8 +117,11 @@ transform_h264_encoder::transform_h264_encoder(const media_session_t& session,
     draining(false),
     first_sample(true),
     time_shift(-1),
-    buffer_pool_h264_frames(new buffer_pool_h264_frames_t),
-    buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_h264_frames(new buffer_pool_h264_frames_t(
+        "transform_h264_encoder::buffer_pool_h264_frames")),
+    buffer_pool_memory(new buffer_pool_memory_t("transform_h264_encoder::buffer_pool_memory")),
+    buffer_pool_input_memory(new buffer_pool_memory_t(
+        "transform_h264_encoder::buffer_pool_input_memory")),
     dispatcher(new request_dispatcher)
 {
     this->events_callback.Attach(new async_callback_t(&transform_h264_encoder::events_cb));
@@ -125,6 +138,10 @@ transform_h264_encoder::~transform_h264_encoder()
         buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
         this->buffer_pool_memory->dispose();
     }
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_input_memory->mutex);
+        this->buffer_pool_input_memory->dispose();
+    }
     {
         buffer_pool_h264_frames_t::scoped_lock lock(this->buffer_pool_h264_frames->mutex);
         this->buffer_pool_h264_frames->dispose();
@@ -220,9 +237,12 @@ HRESULT transform_h264_encoder::set_encoder_parameters()
         CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonBufferSize, &max_bitrate));
     }*/
 
-    /*v.vt = VT_UI4;
-    v.ullVal = 1;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &v));*/
+    // the outputs can force key frames
+    if(codec->IsSupported(&CODECAPI_AVEncVideoForceKeyFrame) == S_OK)
+        this->codec_api = codec;
+    else
+        LOG_WARNING("h264 encoder doesn't support forced key frames");
+
     if(codec->IsSupported(&CODECAPI_AVLowLatencyMode) == S_OK)
     {
         v = {0};
@@ -247,6 +267,60 @@ done:
     return hr;
 }
 
+HRESULT transform_h264_encoder::convert_frame(const media_sample_video_frame& frame,
+    const media_buffer_memory_texture& memory_texture, media_buffer_memory_t& out)
+{
+    HRESULT hr = S_OK;
+    const DWORD len = this->frame_width * this->frame_height * 3 / 2;
+    BYTE* data = NULL;
+
+    if(memory_texture.width != this->frame_width || memory_texture.height != this->frame_height)
+        CHECK_HR(hr = MF_E_INVALIDMEDIATYPE);
+
+    // unchanged frames reuse the last converted buffer
+    if(frame.unchanged && frame.buffer == this->last_input_frame)
+    {
+        out = this->last_input_memory;
+        goto done;
+    }
+
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_input_memory->mutex);
+        out = this->buffer_pool_input_memory->acquire_buffer();
+    }
+    out->initialize(len);
+
+    if(!this->color_converter)
+        // the video processor of the gpu path outputs bt.709 limited range
+        this->color_converter.reset(new cpu_color_converter(
+            cpu_color_converter::MATRIX_BT709, cpu_color_converter::RANGE_LIMITED,
+            cpu_color_converter::FORMAT_NV12));
+
+    CHECK_HR(hr = out->buffer->Lock(&data, NULL, NULL));
+    {
+        // the encoder input type uses the default stride
+        cpu_color_converter::planes_t planes;
+        planes.y = data;
+        planes.y_pitch = (int)this->frame_width;
+        planes.u = data + this->frame_width * this->frame_height;
+        planes.u_pitch = (int)this->frame_width;
+        planes.v = NULL;
+        planes.v_pitch = 0;
+
+        this->color_converter->convert(memory_texture.texture_buffer.get(),
+            (int)memory_texture.pitch, (int)memory_texture.width, (int)memory_texture.height,
+            planes);
+    }
+    CHECK_HR(hr = out->buffer->Unlock());
+    CHECK_HR(hr = out->buffer->SetCurrentLength(len));
+
+    this->last_input_frame = frame.buffer;
+    this->last_input_memory = out;
+
+done:
+    return hr;
+}
+
 HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& frame)
 {
     HRESULT hr = S_OK;
@@ -255,22 +329,34 @@ HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& fra
     CComPtr<media_buffer_wrapper> buffer_wrapper;
     CComPtr<IMFSample> sample;
     CComPtr<IUnknown> sample_tracker;
+    const media_buffer_memory_texture* memory_texture =
+        dynamic_cast<const media_buffer_memory_texture*>(frame.buffer.get());
 
-#ifdef _DEBUG
+    // sample tracker should be used for each texture individually
+
+    // create the input sample buffer
+    if(memory_texture)
     {
-        D3D11_TEXTURE2D_DESC desc;
-        frame.buffer->texture->GetDesc(&desc);
-        assert_(desc.Width == this->frame_width && desc.Height == this->frame_height);
+        // frames composited on the cpu are converted to nv12 in system memory
+        media_buffer_memory_t memory_buffer;
+        CHECK_HR(hr = this->convert_frame(frame, *memory_texture, memory_buffer));
+        buffer_wrapper.Attach(new media_buffer_wrapper(memory_buffer));
     }
+    else
+    {
+#ifdef _DEBUG
+        {
+            D3D11_TEXTURE2D_DESC desc;
+            frame.buffer->texture->GetDesc(&desc);
+            assert_(desc.Width == this->frame_width && desc.Height == this->frame_height);
+        }
 #endif
 
-    // sample tracker should be used for each texture individually
-
-    // create the input sample buffer
-    CHECK_HR(hr = MFCreateDXGISurfaceBuffer(IID_ID3D11Texture2D,
-        frame.buffer->texture, 0, FALSE, &buffer));
-    buffer_wrapper.Attach(new media_buffer_wrapper(this->context_mutex,
-        frame.buffer, buffer, this->use_system_memory));
+        CHECK_HR(hr = MFCreateDXGISurfaceBuffer(IID_ID3D11Texture2D,
+            frame.buffer->texture, 0, FALSE, &buffer));
+        buffer_wrapper.Attach(new media_buffer_wrapper(this->context_mutex,
+            frame.buffer, buffer, this->use_system_memory));
+    }
 
     assert_(frame.dur == 1);
 
@@ -282,7 +368,7 @@ HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& fra
     sample_time -= this->time_shift;
     if(sample_time < 0)
     {
-        std::cout << "h264 encoder time shift was off by " << sample_time << std::endl;
+        LOG_WARNING("h264 encoder time shift was off by {}", sample_time);
         sample_time = 0;
     }
 
@@ -304,6 +390,30 @@ HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& fra
     sample_tracker.Attach(new media_sample_tracker(buffer_wrapper));
     CHECK_HR(hr = sample->SetUnknown(media_sample_tracker_guid, sample_tracker));
 
+    // the requested key frame is forced on this frame unless the previous forced key frame
+    // is too recent, in which case the request stays pending
+    if(this->codec_api && this->key_frame_requested.load() &&
+        sample_time - this->last_forced_key_frame_time >= forced_key_frame_interval)
+    {
+        static metric& forced_key_frames = metrics::get_counter("h264_encoder_forced_key_frames");
+
+        this->key_frame_requested = false;
+
+        VARIANT v = {0};
+        v.vt = VT_UI4;
+        v.ulVal = 1;
+        if(SUCCEEDED(hr = this->codec_api->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &v)))
+        {
+            forced_key_frames.add();
+            this->last_forced_key_frame_time = sample_time;
+        }
+        else
+        {
+            LOG_WARNING("h264 encoder failed to force a key frame, hr {}", log_hex(hr));
+            hr = S_OK;
+        }
+    }
+
     // feed the encoder
     {
         /*std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
@@ -316,6 +426,15 @@ done:
     return hr;
 }
 
+void transform_h264_encoder::request_key_frame()
+{
+    static metric& key_frame_requests = metrics::get_counter("h264_encoder_key_frame_requests");
+
+    // the requests that arrive before the key frame is forced are coalesced
+    key_frame_requests.add();
+    this->key_frame_requested = true;
+}
+
 void transform_h264_encoder::events_cb(void* unk)
 {
     try
@@ -337,7 +456,9 @@ void transform_h264_encoder::events_cb(void* unk)
 
         if(type == METransformNeedInput)
         {
-            this->encoder_requests++;
+            // the encoder is overloading while it doesn't request any input
+            static metric& encoder_input_requests = metrics::get_gauge("h264_encoder_input_requests");
+            encoder_input_requests.set(++this->encoder_requests);
             this->serve();
         }
         else if(type == METransformHaveOutput)
@@ -408,6 +529,8 @@ bool transform_h264_encoder::on_serve(request_queue::request_t& request)
 
     HRESULT hr = S_OK;
 
+    latency_tracer::stamp(request.rp.trace, latency_trace::STAGE_ENCODE);
+
     const bool not_served_request = !request.sample.already_served;
     media_sample_video_frame video_frame;
     const bool pop_request = this->extract_frame(video_frame, request);
@@ -422,13 +545,16 @@ bool transform_h264_encoder::on_serve(request_queue::request_t& request)
             this->session->frame_rate_num, this->session->frame_rate_den);
         if(timestamp <= this->last_time_stamp && timestamp >= 0)
         {
-            std::cout << "timestamp error in transform_h264_encoder::processing_cb" << std::endl;
+            LOG_ERROR("timestamp error in transform_h264_encoder::processing_cb");
             assert_(false);
         }
 
     back:
         if(!this->software)
-            this->encoder_requests--;
+        {
+            static metric& encoder_input_requests = metrics::get_gauge("h264_encoder_input_requests");
+            encoder_input_requests.set(--this->encoder_requests);
+        }
 
         hr = this->feed_encoder(video_frame);
 
@@ -470,7 +596,7 @@ bool transform_h264_encoder::on_serve(request_queue::request_t& request)
         }
         else
         {
-            std::cout << "drain on h264 encoder" << std::endl;
+            LOG_DEBUG("drain on h264 encoder");
             this->last_request = request;
             this->draining = true;
             CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
@@ -781,7 +907,7 @@ void transform_h264_encoder::initialize(const control_class_t& ctrl_pipeline,
 
     // start the encoder
     {
-        std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
+        std::unique_lock<context_mutex_t::element_type> lock(*this->context_mutex, std::defer_lock);
         if(!this->use_system_memory)
             lock.lock();
         if(!this->software)
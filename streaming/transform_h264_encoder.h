@@ -6,6 +6,8 @@
 #include "request_dispatcher.h"
 #include "request_queue_handler.h"
 #include "control_class.h"
+#include "cpu_color_converter.h"
+#include "key_frame_requester.h"
 #include <d3d11.h>
 #include <atlbase.h>
 #include <mfapi.h>
@@ -34,6 +36,7 @@ does not use b frames by default
 
 class transform_h264_encoder : 
     public media_component,
+    public key_frame_requester,
     request_queue_handler<h264_encoder_transform_packet>
 {
     friend class stream_h264_encoder;
@@ -52,6 +55,9 @@ public:
     //static const UINT32 avg_bitrate = 10000/*4500*/ * 1000;
     // 0: low quality, 100: high quality
     /*static const UINT32 quality_vs_speed = 50;*/
+
+    // the minimum interval between the forced key frames
+    static constexpr time_unit forced_key_frame_interval = SECOND_IN_TIME_UNIT;
 private:
     control_class_t ctrl_pipeline;
     context_mutex_t context_mutex;
@@ -69,6 +75,10 @@ private:
     CComPtr<IMFDXGIDeviceManager> devmngr;
     CComPtr<async_callback_t> events_callback;
     UINT reset_token;
+    // null if the encoder doesn't support forcing key frames
+    CComPtr<ICodecAPI> codec_api;
+    std::atomic_bool key_frame_requested;
+    time_unit last_forced_key_frame_time;
 
     std::mutex process_output_mutex;
     std::atomic_int32_t encoder_requests;
@@ -80,6 +90,11 @@ private:
 
     std::shared_ptr<buffer_pool_h264_frames_t> buffer_pool_h264_frames;
     std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    // nv12 input buffers for frames that reside in system memory
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_input_memory;
+    std::unique_ptr<cpu_color_converter> color_converter;
+    media_buffer_texture_t last_input_frame;
+    media_buffer_memory_t last_input_memory;
     media_sample_h264_frames_t out_sample;
 
     // time shift must be used instead of adjusting the time in the output_file, because
@@ -97,6 +112,9 @@ private:
     HRESULT set_output_stream_type();
     HRESULT set_encoder_parameters();
 
+    // converts a bgra frame in system memory to nv12
+    HRESULT convert_frame(const media_sample_video_frame&,
+        const media_buffer_memory_texture&, media_buffer_memory_t&);
     HRESULT feed_encoder(const media_sample_video_frame&);
 
     void process_request(const media_sample_h264_frames_t&, request_t&);
@@ -119,6 +137,9 @@ public:
 
     bool is_encoder_overloading() const {return this->encoder_requests.load() == 0;}
 
+    // key_frame_requester
+    void request_key_frame() override;
+
     // passing null d3d device implies that the system memory is used to feed the encoder;
     // software encoder flag overrides d3d device arg;
     // quality_vs_speed: 0: low quality, 100: high quality;
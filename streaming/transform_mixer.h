@@ -7,12 +7,15 @@
 #include "request_dispatcher.h"
 #include "request_queue_handler.h"
 #include "assert.h"
+#include "logger.h"
+#include "metrics.h"
 #include <utility>
 #include <memory>
 #include <vector>
 #include <limits>
 #include <algorithm>
 #include <mutex>
+#include <atomic>
 #include <iostream>
 
 #define TRANSFORM_MIXER_APPLY_STREAM_CONTROLLER_IMMEDIATELY
@@ -67,10 +70,17 @@ public:
         std::vector<packet_t> container;
     };
     typedef std::pair<unsigned short /*samples received*/, args_t> request_t;
+private:
+    // the amount of frames the common frame end of the inputs lags behind the request point
+    metric& cutoff_lag;
+    // the input count of the last started stream;
+    // the input slots of a new stream are reserved by it
+    std::atomic<size_t> last_input_count;
 protected:
     virtual stream_mixer_t create_derived_stream() = 0;
 public:
-    explicit transform_mixer(const media_session_t& session);
+    // the name identifies the mixer in the metrics
+    transform_mixer(const media_session_t& session, const std::string& name);
     virtual ~transform_mixer() {}
 
     stream_mixer_t create_stream(media_message_generator_t&& message_generator);
@@ -79,7 +89,8 @@ public:
 template<class TransformMixer>
 class stream_mixer : 
     public media_stream_message_listener, 
-    request_queue_handler<typename TransformMixer::request_t>
+    pipelined_request_queue_handler<typename TransformMixer::request_t,
+        typename ::request_queue<typename TransformMixer::out_arg_t>::request_t>
 {
     using media_stream::connect_streams;
 public:
@@ -97,6 +108,10 @@ public:
     typedef typename request_queue_handler<typename TransformMixer::request_t>::request_queue 
         request_queue;
     typedef media_stream::result_t result_t;
+    typedef pipelined_request_queue_handler<typename TransformMixer::request_t,
+        typename ::request_queue<typename TransformMixer::out_arg_t>::request_t> pipelined_handler;
+    typedef typename pipelined_handler::result_t completion_t;
+    typedef typename pipelined_handler::ticket_t ticket_t;
 
     struct input_stream_props_t
     {
@@ -105,12 +120,16 @@ public:
     };
     struct dispatcher_args_t
     {
+        ticket_t ticket;
         args_t packets; 
         frame_unit old_cutoff, cutoff;
     };
 
     typedef request_dispatcher<typename ::request_queue<dispatcher_args_t>::request_t> 
         request_dispatcher;
+    // the amount of requests that can be mixed concurrently;
+    // the mixed samples are given in the request order
+    static constexpr int max_mixes_in_flight = 4;
 private:
     transform_mixer_t transform;
     time_unit drain_point;
@@ -132,6 +151,8 @@ private:
     // request_queue_handler
     bool on_serve(typename request_queue::request_t&) override;
     typename request_queue::request_t* next_request() override;
+    // pipelined_request_queue_handler
+    void on_complete(completion_t&) override;
 protected:
     virtual void on_stream_start(time_unit) override;
     virtual void on_stream_stop(time_unit) override;
@@ -170,8 +191,10 @@ public:
 
 
 template<class T, class U, class V>
-transform_mixer<T, U, V>::transform_mixer(const media_session_t& session) :
-    media_component(session)
+transform_mixer<T, U, V>::transform_mixer(const media_session_t& session, const std::string& name) :
+    media_component(session),
+    cutoff_lag(metrics::get_gauge(name + "_cutoff_lag_frames")),
+    last_input_count(0)
 {
 }
 
@@ -193,11 +216,13 @@ typename transform_mixer<T, U, V>::stream_mixer_t transform_mixer<T, U, V>::crea
 template<class T>
 stream_mixer<T>::stream_mixer(const transform_mixer_t& transform) :
     media_stream_message_listener(transform.get()),
+    pipelined_handler(max_mixes_in_flight),
     transform(transform),
     drain_point(std::numeric_limits<time_unit>::min()),
     cutoff(std::numeric_limits<time_unit>::min()),
     dispatcher(new request_dispatcher)
 {
+    this->input_streams_props.reserve(this->transform->last_input_count);
 }
 
 template<class T>
@@ -208,6 +233,7 @@ void stream_mixer<T>::on_stream_start(time_unit t)
     // initialize the leftover buffer
     assert_(this->input_streams_props.size() > 0);
     this->leftover.reset(new args_t[this->input_streams_props.size()]);
+    this->transform->last_input_count = this->input_streams_props.size();
 }
 
 template<class T>
@@ -276,11 +302,15 @@ void stream_mixer<T>::process(typename request_queue::request_t& request)
     // the old cutoff and the current one;
     // old cutoff could be increased if the limit is reached
 
+    latency_tracer::stamp(request.rp.trace, latency_trace::STAGE_MIX);
+
     args_t& packets = request.sample.second;
     const frame_unit old_cutoff = this->cutoff;
     this->cutoff = this->find_common_frame_end(packets, old_cutoff);
     // component is allowed serve samples from zero up to the request point only
     assert_(this->cutoff <= this->convert_to_frame_unit(request.rp.request_time));
+    this->transform->cutoff_lag.set(
+        this->convert_to_frame_unit(request.rp.request_time) - this->cutoff);
 
     if(request.rp.flags & FLAG_LAST_PACKET)
     {
@@ -291,9 +321,9 @@ void stream_mixer<T>::process(typename request_queue::request_t& request)
         // for no gaps in the stream, the drain cutoff should be the same as new_cutoff
         assert_(drain_cutoff >= this->cutoff);
         if(drain_cutoff > this->cutoff)
-            std::cout << "warning: a source didn't serve samples up to the drain point" << std::endl;
+            LOG_WARNING("a source didn't serve samples up to the drain point");
         this->cutoff = drain_cutoff;
-        std::cout << "drain on mixer" << std::endl;
+        LOG_DEBUG("drain on mixer");
     }
 
     // move the packets to the leftover container
@@ -384,6 +414,7 @@ out:
         typename request_dispatcher::request_t dispatcher_request;
         dispatcher_request.stream = request.stream;
         dispatcher_request.rp = request.rp;
+        dispatcher_request.sample.ticket = this->begin_request();
         dispatcher_request.sample.packets = std::move(packets);
         dispatcher_request.sample.cutoff = cutoff;
         dispatcher_request.sample.old_cutoff = old_cutoff;
@@ -398,12 +429,16 @@ out:
         typename request_dispatcher::request_t dispatcher_request;
         dispatcher_request.stream = request.stream;
         dispatcher_request.rp = request.rp;
+        dispatcher_request.sample.ticket = this->begin_request();
 
         this->dispatcher->dispatch_request(std::move(dispatcher_request),
             [this_ = this->shared_from_this<stream_mixer>()](
                 typename request_dispatcher::request_t& request)
         {
-            this_->transform->session->give_sample(request.stream, NULL, request.rp);
+            completion_t completion;
+            completion.stream = request.stream;
+            completion.rp = request.rp;
+            this_->end_request(request.sample.ticket, std::move(completion));
         });
     }
 }
@@ -416,11 +451,19 @@ void stream_mixer<T>::dispatch(typename request_dispatcher::request_t& request)
 
     assert_(cutoff != old_cutoff);
 
-    out_arg_t out;
-    this->mix(out, request.sample.packets, old_cutoff, cutoff);
+    completion_t completion;
+    completion.stream = request.stream;
+    completion.rp = request.rp;
+    this->mix(completion.sample, request.sample.packets, old_cutoff, cutoff);
 
-    this->transform->session->give_sample(request.stream,
-        out.has_value() ? &(*out) : NULL, request.rp);
+    this->end_request(request.sample.ticket, std::move(completion));
+}
+
+template<class T>
+void stream_mixer<T>::on_complete(completion_t& completion)
+{
+    this->transform->session->give_sample(completion.stream,
+        completion.sample.has_value() ? &(*completion.sample) : NULL, completion.rp);
 }
 
 template<class T>
@@ -435,8 +478,10 @@ typename stream_mixer<T>::request_queue::request_t* stream_mixer<T>::next_reques
 {
     scoped_lock lock(this->next_request_mutex);
 
+    // the request is held back until a mix in flight completes
     typename request_queue::request_t* request = this->requests.get();
-    if(request && (size_t)request->sample.first == this->input_streams_props.size())
+    if(request && (size_t)request->sample.first == this->input_streams_props.size() &&
+        this->can_begin_request())
         return request;
     else
         return NULL;
@@ -460,28 +505,28 @@ typename stream_mixer<T>::result_t stream_mixer<T>::request_sample(
 {
     this->requests.initialize_queue(rp);
 
-    // push the request partially
+    // the request is built before it is pushed, so that the queued request is only
+    // modified under the queue lock;
+    // the request chains of other requests can push to the queue concurrently
     {
         typename request_queue::request_t request;
         request.rp = rp;
         request.stream = this;
-        this->requests.push(std::move(request));
-    }
-    typename request_queue::request_t* request = this->requests.get(rp.packet_number);
-    assert_(request->sample.second.container.empty());
+        request.sample.first = 0;
+        args_t& packets = request.sample.second;
 
-    request->sample.first = 0;
-    args_t& packets = request->sample.second;
+        // TODO: the current leftover size should be added to the reservation
+        // reserve twice the size to accommodate for leftover buffer merging
+        packets.container.reserve(this->input_streams_props.size() * 2);
+        for(size_t i = 0; i < this->input_streams_props.size(); i++)
+        {
+            packet_t packet;
+            packet.stream_index = i;
+            this->initialize_packet(packet);
+            packets.container.push_back(packet);
+        }
 
-    // TODO: the current leftover size should be added to the reservation
-    // reserve twice the size to accommodate for leftover buffer merging
-    packets.container.reserve(this->input_streams_props.size() * 2);
-    for(size_t i = 0; i < this->input_streams_props.size(); i++)
-    {
-        packet_t packet;
-        packet.stream_index = i;
-        this->initialize_packet(packet);
-        packets.container.push_back(packet);
+        this->requests.push(request);
     }
 
     if(!this->transform->session->request_sample(this, rp))
@@ -493,15 +538,17 @@ template<class T>
 typename stream_mixer<T>::result_t stream_mixer<T>::process_sample(
     const media_component_args* arg_, const request_packet& rp, const media_stream* prev_stream)
 {
-    typename request_queue::request_t* request = this->requests.get(rp.packet_number);
-    assert_(request);
-
     /*Sleep(10);*/
 
-    // find the right packet from the list and assign the sample to it
+    // find the right packet from the list and assign the sample to it;
+    // the lock order is the same as in next_request
     bool found = false;
     {
         scoped_lock lock(this->next_request_mutex);
+        typename request_queue::scoped_lock queue_lock(this->requests.get_mutex());
+        typename request_queue::request_t* request = this->requests.get(rp.packet_number);
+        assert_(request);
+
         for(auto&& item : request->sample.second.container)
             if(item.input_stream == prev_stream && !item.arg)
             {
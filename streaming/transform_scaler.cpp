@@ -0,0 +1,175 @@
+#include "transform_scaler.h"
+#include <iostream>
+#include <Mferror.h>
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
+
+transform_scaler::transform_scaler(const media_session_t& session) :
+    media_component(session),
+    memory_texture_pool(new buffer_pool_memory_texture_t("transform_scaler::memory_texture_pool")),
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "transform_scaler::buffer_pool_video_frames")),
+    frame_width_in(0), frame_height_in(0),
+    frame_width_out(0), frame_height_out(0)
+{
+}
+
+transform_scaler::~transform_scaler()
+{
+    {
+        buffer_pool_memory_texture_t::scoped_lock lock(this->memory_texture_pool->mutex);
+        this->memory_texture_pool->dispose();
+    }
+    {
+        buffer_pool_video_frames_t::scoped_lock lock(this->buffer_pool_video_frames->mutex);
+        this->buffer_pool_video_frames->dispose();
+    }
+}
+
+void transform_scaler::initialize(const control_class_t& ctrl_pipeline,
+    UINT32 frame_width_in, UINT32 frame_height_in,
+    UINT32 frame_width_out, UINT32 frame_height_out,
+    cpu_scaler::filter_t filter,
+    unsigned int thread_count)
+{
+    assert_(frame_width_in && frame_height_in && frame_width_out && frame_height_out);
+
+    this->ctrl_pipeline = ctrl_pipeline;
+    this->frame_width_in = frame_width_in;
+    this->frame_height_in = frame_height_in;
+    this->frame_width_out = frame_width_out;
+    this->frame_height_out = frame_height_out;
+    this->scaler.reset(new cpu_scaler(filter, thread_count));
+}
+
+media_stream_t transform_scaler::create_stream()
+{
+    return media_stream_t(new stream_scaler(this->shared_from_this<transform_scaler>()));
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+stream_scaler::stream_scaler(const transform_scaler_t& transform) : transform(transform)
+{
+}
+
+media_buffer_memory_texture_t stream_scaler::acquire_buffer()
+{
+    media_buffer_memory_texture_t buffer;
+    {
+        transform_scaler::buffer_pool_memory_texture_t::scoped_lock lock(
+            this->transform->memory_texture_pool->mutex);
+        buffer = this->transform->memory_texture_pool->acquire_buffer();
+    }
+
+    buffer->initialize(this->transform->frame_width_out, this->transform->frame_height_out);
+    return buffer;
+}
+
+void stream_scaler::process(media_component_h264_encoder_args_t& this_args,
+    const request_packet& this_rp)
+{
+    HRESULT hr = S_OK;
+    media_component_h264_encoder_args_t args;
+    media_sample_video_frames_t frames;
+
+    if(!this_args)
+        goto done;
+
+    {
+        transform_scaler::buffer_pool_video_frames_t::scoped_lock lock(
+            this->transform->buffer_pool_video_frames->mutex);
+        frames = this->transform->buffer_pool_video_frames->acquire_buffer();
+    }
+    frames->initialize();
+
+    for(const auto& item : this_args->sample->get_frames())
+    {
+        media_sample_video_frame frame(item.pos);
+
+        if(!item.buffer)
+        {
+            frames->add_consecutive_frames(frame);
+            continue;
+        }
+
+        const media_buffer_memory_texture* input =
+            dynamic_cast<const media_buffer_memory_texture*>(item.buffer.get());
+        // the scaler only operates on frames in system memory
+        if(!input || input->width != this->transform->frame_width_in ||
+            input->height != this->transform->frame_height_in)
+            CHECK_HR(hr = MF_E_INVALIDMEDIATYPE);
+
+        // unchanged frames reuse the last scaled output
+        if(item.unchanged)
+        {
+            std::lock_guard<std::mutex> lock(this->last_frame_mutex);
+            if(item.buffer == this->last_input_buffer)
+            {
+                frame.buffer = this->last_output_buffer;
+                frame.unchanged = true;
+            }
+        }
+
+        if(!frame.buffer)
+        {
+            media_buffer_memory_texture_t output = this->acquire_buffer();
+            this->transform->scaler->scale(
+                input->texture_buffer.get(), (int)input->pitch,
+                (int)input->width, (int)input->height,
+                output->texture_buffer.get(), (int)output->pitch,
+                (int)output->width, (int)output->height, 4);
+
+            frame.buffer = output;
+
+            std::lock_guard<std::mutex> lock(this->last_frame_mutex);
+            this->last_input_buffer = item.buffer;
+            this->last_output_buffer = output;
+        }
+
+        frames->add_consecutive_frames(frame);
+    }
+
+done:
+    if(FAILED(hr))
+    {
+        PRINT_ERROR(hr);
+        this->transform->request_reinitialization(this->transform->ctrl_pipeline);
+    }
+
+    args = this_args;
+    if(args)
+        args->sample = frames;
+
+    // set the args in pending packet to null so that the sample can be reused
+    this_args.reset();
+
+    // give the sample to downstream
+    this->transform->session->give_sample(this, args.has_value() ? &(*args) : NULL, this_rp);
+}
+
+media_stream::result_t stream_scaler::request_sample(const request_packet& rp, const media_stream*)
+{
+    if(!this->transform->session->request_sample(this, rp))
+        return FATAL_ERROR;
+    return OK;
+}
+
+media_stream::result_t stream_scaler::process_sample(
+    const media_component_args* args_, const request_packet& rp, const media_stream*)
+{
+    media_component_h264_encoder_args_t args;
+    if(args_)
+    {
+        args = std::make_optional(
+            static_cast<const media_component_h264_encoder_args&>(*args_));
+        assert_(args->is_valid());
+    }
+
+    this->process(args, rp);
+    return OK;
+}
\ No newline at end of file
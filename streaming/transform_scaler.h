@@ -0,0 +1,64 @@
+#pragma once
+
+#include "media_component.h"
+#include "media_stream.h"
+#include "cpu_scaler.h"
+#include <memory>
+#include <mutex>
+
+// resamples the bgra frames in system memory to the output size;
+// it is placed between the cpu videomixer and the encoder so that the canvas size
+// can differ from the encoded frame size
+
+class transform_scaler : public media_component
+{
+    friend class stream_scaler;
+public:
+    typedef buffer_pool<media_sample_video_frames_pooled> buffer_pool_video_frames_t;
+    typedef buffer_pool<media_buffer_memory_texture_pooled> buffer_pool_memory_texture_t;
+private:
+    control_class_t ctrl_pipeline;
+
+    std::shared_ptr<buffer_pool_memory_texture_t> memory_texture_pool;
+    std::shared_ptr<buffer_pool_video_frames_t> buffer_pool_video_frames;
+
+    UINT32 frame_width_in, frame_height_in;
+    UINT32 frame_width_out, frame_height_out;
+
+    // the scaler caches the filter tables and is shared between the streams
+    std::unique_ptr<cpu_scaler> scaler;
+public:
+    explicit transform_scaler(const media_session_t& session);
+    ~transform_scaler();
+
+    // thread count of 0 uses the hardware concurrency
+    void initialize(const control_class_t&,
+        UINT32 frame_width_in, UINT32 frame_height_in,
+        UINT32 frame_width_out, UINT32 frame_height_out,
+        cpu_scaler::filter_t = cpu_scaler::FILTER_LANCZOS3,
+        unsigned int thread_count = 0);
+    media_stream_t create_stream();
+};
+
+typedef std::shared_ptr<transform_scaler> transform_scaler_t;
+
+class stream_scaler : public media_stream
+{
+private:
+    transform_scaler_t transform;
+
+    std::mutex last_frame_mutex;
+    // the last scaled input and its output;
+    // the input is referenced so that it won't be recycled while compared against
+    media_buffer_texture_t last_input_buffer, last_output_buffer;
+
+    media_buffer_memory_texture_t acquire_buffer();
+    void process(media_component_h264_encoder_args_t& args, const request_packet&);
+public:
+    explicit stream_scaler(const transform_scaler_t& transform);
+
+    // called by the downstream from media session
+    result_t request_sample(const request_packet&, const media_stream*);
+    // called by the upstream from media session
+    result_t process_sample(const media_component_args*, const request_packet&, const media_stream*);
+};
\ No newline at end of file
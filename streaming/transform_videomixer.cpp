@@ -1,8 +1,10 @@
 #include "transform_videomixer.h"
 #include "assert.h"
+#include "logger.h"
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <cmath>
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) {goto done;}}
 
@@ -19,16 +21,27 @@ struct transform_videomixer::device_context_resources : media_buffer_texture
 
 transform_videomixer::transform_videomixer(
     const media_session_t& session, context_mutex_t context_mutex) :
-    transform_videomixer_base(session), 
+    transform_videomixer_base(session, "videomixer"), 
     context_mutex(context_mutex), 
-    texture_pool(new buffer_pool),
-    buffer_pool_video_frames(new buffer_pool_video_frames_t),
-    buffer_pool_video_mixer_frames(new buffer_pool_video_mixer_frames_t)
+    texture_pool(new buffer_pool("transform_videomixer::texture_pool")),
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "transform_videomixer::buffer_pool_video_frames")),
+    buffer_pool_video_mixer_frames(new buffer_pool_video_mixer_frames_t(
+        "transform_videomixer::buffer_pool_video_mixer_frames")),
+    memory_texture_pool(new buffer_pool_memory_texture_t(
+        "transform_videomixer::memory_texture_pool"))
 {
 }
 
 transform_videomixer::~transform_videomixer()
 {
+    LOG_INFO("videomixer frames composed: {}, reused: {}; layers drawn: {}, culled: {}",
+        this->statistics.frames_composed.load(), this->statistics.frames_reused.load(),
+        this->statistics.layers_drawn.load(), this->statistics.layers_culled.load());
+    if(this->compositor)
+        LOG_INFO("videomixer cpu frames composed: {}, in takes: {}",
+            this->statistics.cpu_frames_composed.load(), this->statistics.cpu_takes.load());
+
     {
         buffer_pool::scoped_lock lock(this->texture_pool->mutex);
         this->texture_pool->dispose();
@@ -41,6 +54,10 @@ transform_videomixer::~transform_videomixer()
         buffer_pool_video_mixer_frames_t::scoped_lock lock(this->buffer_pool_video_mixer_frames->mutex);
         this->buffer_pool_video_mixer_frames->dispose();
     }
+    {
+        buffer_pool_memory_texture_t::scoped_lock lock(this->memory_texture_pool->mutex);
+        this->memory_texture_pool->dispose();
+    }
 }
 
 void transform_videomixer::initialize(
@@ -60,6 +77,21 @@ void transform_videomixer::initialize(
     this->canvas_height = canvas_height;
 }
 
+void transform_videomixer::initialize(
+    const control_class_t& ctrl_pipeline,
+    UINT32 canvas_width, UINT32 canvas_height,
+    const CComPtr<ID3D11Device>& d3d11dev,
+    const CComPtr<ID3D11DeviceContext>& devctx,
+    unsigned int compositor_thread_count)
+{
+    this->ctrl_pipeline = ctrl_pipeline;
+    this->d3d11dev = d3d11dev;
+    this->d3d11devctx = devctx;
+    this->canvas_width = canvas_width;
+    this->canvas_height = canvas_height;
+    this->compositor.reset(new cpu_compositor(compositor_thread_count));
+}
+
 transform_videomixer::stream_mixer_t transform_videomixer::create_derived_stream()
 {
     return stream_videomixer_base_t(
@@ -144,6 +176,20 @@ stream_videomixer::device_context_resources_t stream_videomixer::acquire_buffer(
     }
 }
 
+media_buffer_memory_texture_t stream_videomixer::acquire_memory_buffer(
+    UINT32 width, UINT32 height)
+{
+    media_buffer_memory_texture_t buffer;
+    {
+        transform_videomixer::buffer_pool_memory_texture_t::scoped_lock lock(
+            this->transform->memory_texture_pool->mutex);
+        buffer = this->transform->memory_texture_pool->acquire_buffer();
+    }
+
+    buffer->initialize(width, height);
+    return buffer;
+}
+
 bool stream_videomixer::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t& reference,
     frame_unit end, bool discarded)
 {
@@ -157,7 +203,7 @@ bool stream_videomixer::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t
         to->frame_end = end;
 
         if(discarded)
-            std::cout << "discarded video frames" << std::endl;
+            LOG_WARNING("discarded video frames");
 
         return true;
     }
@@ -199,7 +245,7 @@ bool stream_videomixer::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t
 
         const bool moved = from->sample->move_frames_to(to->sample.get(), end);
         if(moved && discarded)
-            std::cout << "discarded video frames" << std::endl;
+            LOG_WARNING("discarded video frames");
     }
     if(end >= from->frame_end)
         from.reset();
@@ -214,65 +260,89 @@ bool stream_videomixer::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t
     return !from;
 }
 
-void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
-    frame_unit first, frame_unit end)
+D2D1::Matrix3x2F stream_videomixer::compute_world(
+    const stream_videomixer_controller::params_t& params,
+    const stream_videomixer_controller::params_t& user_params)
 {
-    // packets.container might be empty
+    using namespace D2D1;
+    Matrix3x2F src_to_dest, src2_to_dest2;
+
+    // src_rect_m * M = dest_rect_m <=> M = src_rect_t -1 * dest_rect_m
+    src_to_dest = Matrix3x2F::Scale(
+        params.source_rect.right - params.source_rect.left,
+        params.source_rect.bottom - params.source_rect.top) *
+        Matrix3x2F::Translation(params.source_rect.left, params.source_rect.top);
+    src_to_dest.Invert();
+    src_to_dest = src_to_dest * Matrix3x2F::Scale(
+        params.dest_rect.right - params.dest_rect.left,
+        params.dest_rect.bottom - params.dest_rect.top) *
+        Matrix3x2F::Translation(params.dest_rect.left, params.dest_rect.top) *
+        params.dest_m;
+
+    src2_to_dest2 = Matrix3x2F::Scale(
+        user_params.source_rect.right - user_params.source_rect.left,
+        user_params.source_rect.bottom - user_params.source_rect.top) *
+        Matrix3x2F::Translation(
+            user_params.source_rect.left, user_params.source_rect.top) *
+        user_params.source_m;
+    src2_to_dest2.Invert();
+    src2_to_dest2 = src2_to_dest2 * Matrix3x2F::Scale(
+        user_params.dest_rect.right - user_params.dest_rect.left,
+        user_params.dest_rect.bottom - user_params.dest_rect.top) *
+        Matrix3x2F::Translation(user_params.dest_rect.left, user_params.dest_rect.top) *
+        user_params.dest_m;
+
+    return src_to_dest * src2_to_dest2;
+}
 
-    assert_(!out_arg);
+bool stream_videomixer::equal_params(const stream_videomixer_controller::params_t& a,
+    const stream_videomixer_controller::params_t& b)
+{
+    auto equal_rect = [](const D2D1_RECT_F& a, const D2D1_RECT_F& b)
+    {
+        return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+    };
+    auto equal_matrix = [](const D2D1::Matrix3x2F& a, const D2D1::Matrix3x2F& b)
+    {
+        return a._11 == b._11 && a._12 == b._12 && a._21 == b._21 && a._22 == b._22 &&
+            a._31 == b._31 && a._32 == b._32;
+    };
 
-    // arg in packets can be null when frame_count == 0 or
-    // if a source passed null args on a drain point;
-    // the whole leftover buffer is merged to packets
+    return equal_rect(a.source_rect, b.source_rect) && equal_rect(a.dest_rect, b.dest_rect) &&
+        equal_matrix(a.source_m, b.source_m) && equal_matrix(a.dest_m, b.dest_m) &&
+        a.axis_aligned_clip == b.axis_aligned_clip;
+}
 
-    HRESULT hr = S_OK;
-    const frame_unit frame_count = end - first;
-    assert_(frame_count > 0);
+bool stream_videomixer::equal_layers(const std::vector<layer_t>& a, const std::vector<layer_t>& b)
+{
+    if(a.size() != b.size())
+        return false;
 
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        if(a[i].frame->buffer != b[i].frame->buffer ||
+            !equal_params(a[i].frame->params, b[i].frame->params) ||
+            !equal_params(*a[i].user_params, *b[i].user_params))
+            return false;
+    }
+
+    return true;
+}
+
+void stream_videomixer::collect_layers(args_t& packets, frame_unit first, frame_unit end,
+    frame_layers_t& layers, bool& has_frames) const
+{
     // limit the processing videomixer does in a single take;
-    // this greatly reduces the amount of vram being allocated when the pipeline is overloaded
-    constexpr size_t maximum_frame_count = 1;
-    frame_unit allowed_frames[maximum_frame_count];
+    // this greatly reduces the amount of vram being allocated when the pipeline is overloaded;
+    // the cpu compositor doesn't allocate vram and composes the frames of a take concurrently
+    const size_t maximum_frame_count = this->transform->compositor ? maximum_cpu_frame_count : 1;
+    frame_unit allowed_frames[maximum_cpu_frame_count];
     for(size_t i = 0; i < maximum_frame_count; i++)
         allowed_frames[i] = -1;
 
-    // TODO: use z order instead of stream_index so that the user input can be instant
-    // sort the packets list for correct z order
-    std::sort(packets.container.begin(), packets.container.end(),
-        [](const packet_t& a, const packet_t& b)
-        {
-            // user_params.z_order;
-            // control_pipeline stores all stream controllers and control_scene
-            // uses those to update z order
-
-            // TODO: stream controller should be reinitialized on activate
-            // (the params should be copied over)
-
-            // set streams with invalid user params behind everything else
-            return (a.stream_index < b.stream_index);
-        });
-
-    media_sample_video_frames::samples_t frames;
-    for(frame_unit i = 0; i < frame_count; i++)
-        frames.push_back(media_sample_video_frame(first + i));
-
-    // indicates whether the out arg will have any encodeable frames
-    bool has_frames = false;
+    layers.resize((size_t)(end - first));
+    has_frames = false;
 
-    // TODO: audio mixer should allocate a buffer of end-first,
-    // but after mixing it creates a buffer wrapper with min pos and max end of mixed samples;
-    // this will make the audio mixing process equivalent to video mixing;
-    // (this assumes that gaps won't occur between samples, which isn't true)
-    // if it turns out that mp4 container doesn't support aac with gaps,
-    // the media buffer wrapper ends can be extended to first and end;
-    // the audio sources should be modified like in video sources to provide silent
-    // buffers that cover gaps
-
-    // TODO: the end of samples in case if the sample is empty should be properly defined
-
-    media_sample_video_frames_t sample;
-
-    // draw
     for(auto&& item : packets.container)
     {
         // stream_mixer::process might create empty args and samples
@@ -309,129 +379,334 @@ void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
                     continue;
 
                 const size_t index = (size_t)(pos - first);
-                device_context_resources_t frame =
-                    std::static_pointer_cast<transform_videomixer::device_context_resources>(
-                        frames[index].buffer);
-                if(!frame)
-                {
-                    frame = this->acquire_buffer();
-                    frames[index].buffer = frame;
+                if(!layers[index])
+                    layers[index].emplace();
 
-                    frame->ctx->BeginDraw();
-                    frame->ctx->SetTarget(frame->bitmap);
-                    frame->ctx->Clear(D2D1::ColorF(D2D1::ColorF::Black));
-                }
+                // silent frames aren't drawn
+                if(!frame_.buffer)
+                    continue;
 
-                if(frame_.buffer)
-                {
-                    CComPtr<ID3D11Texture2D> texture = frame_.buffer->texture;
-                    // params is valid only when the frame stores a non silent buffer
-                    const auto& params = frame_.params;
-                    const auto& user_params = item.valid_user_params ? item.user_params : params;
-
-                    /////////////////////////////////////////////////////////////////
-                    /////////////////////////////////////////////////////////////////
-                    /////////////////////////////////////////////////////////////////
-
-                    // TODO: cache geometry
-
-                    using namespace D2D1;
-                    CComPtr<ID2D1Bitmap1> bitmap;
-                    CComPtr<IDXGISurface> surface;
-                    Matrix3x2F src_to_dest, src2_to_dest2;
-                    Matrix3x2F world, brush;
-                    bool invert;
-
-                    // src_rect_m * M = dest_rect_m <=> M = src_rect_t -1 * dest_rect_m
-                    src_to_dest = Matrix3x2F::Scale(
-                        params.source_rect.right - params.source_rect.left,
-                        params.source_rect.bottom - params.source_rect.top) *
-                        Matrix3x2F::Translation(params.source_rect.left, params.source_rect.top);
-                    invert = src_to_dest.Invert();
-                    src_to_dest = src_to_dest * Matrix3x2F::Scale(
-                        params.dest_rect.right - params.dest_rect.left,
-                        params.dest_rect.bottom - params.dest_rect.top) *
-                        Matrix3x2F::Translation(params.dest_rect.left, params.dest_rect.top) *
-                        params.dest_m;
-
-                    src2_to_dest2 = Matrix3x2F::Scale(
-                        user_params.source_rect.right - user_params.source_rect.left,
-                        user_params.source_rect.bottom - user_params.source_rect.top) *
-                        Matrix3x2F::Translation(
-                            user_params.source_rect.left, user_params.source_rect.top) *
-                        user_params.source_m;
-                    invert = src2_to_dest2.Invert();
-                    src2_to_dest2 = src2_to_dest2 * Matrix3x2F::Scale(
-                        user_params.dest_rect.right - user_params.dest_rect.left,
-                        user_params.dest_rect.bottom - user_params.dest_rect.top) *
-                        Matrix3x2F::Translation(user_params.dest_rect.left, user_params.dest_rect.top) *
-                        user_params.dest_m;
-
-                    world = src_to_dest * src2_to_dest2;
-                    brush = params.source_m;
-
-                    CHECK_HR(hr = texture->QueryInterface(&surface));
-                    CHECK_HR(hr = frame->ctx->CreateBitmapFromDxgiSurface(
-                        surface,
-                        BitmapProperties1(
-                            D2D1_BITMAP_OPTIONS_NONE,
-                            PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
-                        &bitmap));
-
-                    frame->bitmap_brush->SetBitmap(bitmap);
-                    /*frame->bitmap_brush->SetInterpolationMode1(D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC);*/
-                    frame->bitmap_brush->SetTransform(brush);
-
-                    if(!user_params.axis_aligned_clip)
-                    {
-                        CComPtr<ID2D1RectangleGeometry> geometry;
-                        D2D1_LAYER_PARAMETERS1 layer_params;
-                        Matrix3x2F world_inverted, layer;
+                layer_t layer;
+                layer.frame = &frame_;
+                // params is valid only when the frame stores a non silent buffer
+                layer.user_params = item.valid_user_params ? &item.user_params : &frame_.params;
+                layer.world = compute_world(frame_.params, *layer.user_params);
+                layers[index]->push_back(layer);
+            }
+        }
+    }
+}
 
-                        world_inverted = world;
-                        invert = world_inverted.Invert();
-                        layer = user_params.dest_m * world_inverted;
+void stream_videomixer::cull_layers(const std::vector<layer_t>& layers,
+    std::vector<layer_t>& visible_layers) const
+{
+    // a layer covers a canvas rect if it is opaque and both the world transform and
+    // the clip transform map rects to axis aligned rects;
+    // a layer is occluded if its bounds are inside the covered rect of a layer above it
+    auto is_rect_preserving = [](const D2D1::Matrix3x2F& m)
+    {
+        return (m._12 == 0.f && m._21 == 0.f) || (m._11 == 0.f && m._22 == 0.f);
+    };
+    auto transform_rect = [](const D2D1_RECT_F& rect, const D2D1::Matrix3x2F& m)
+    {
+        const D2D1_POINT_2F points[] = {
+            m.TransformPoint(D2D1::Point2F(rect.left, rect.top)),
+            m.TransformPoint(D2D1::Point2F(rect.right, rect.top)),
+            m.TransformPoint(D2D1::Point2F(rect.left, rect.bottom)),
+            m.TransformPoint(D2D1::Point2F(rect.right, rect.bottom))};
+        D2D1_RECT_F out = {points[0].x, points[0].y, points[0].x, points[0].y};
+        for(const auto& point : points)
+        {
+            out.left = std::min(out.left, point.x);
+            out.top = std::min(out.top, point.y);
+            out.right = std::max(out.right, point.x);
+            out.bottom = std::max(out.bottom, point.y);
+        }
+        return out;
+    };
+    auto intersect = [](const D2D1_RECT_F& a, const D2D1_RECT_F& b)
+    {
+        return D2D1::RectF(std::max(a.left, b.left), std::max(a.top, b.top),
+            std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+    };
 
-                        CHECK_HR(hr = this->transform->d2d1factory->CreateRectangleGeometry(
-                            user_params.dest_rect, &geometry));
-                        layer_params = LayerParameters1(
-                            InfiniteRect(), geometry, D2D1_ANTIALIAS_MODE_PER_PRIMITIVE, layer);
+    std::vector<D2D1_RECT_F> covered_rects;
+    visible_layers.clear();
 
-                        frame->ctx->SetTransform(world);
-                        frame->ctx->PushLayer(layer_params, NULL);
-                    }
-                    else
-                    {
-                        frame->ctx->SetTransform(user_params.dest_m);
-                        // the world transform is applied to the axis aligned clip when push is called
-                        frame->ctx->PushAxisAlignedClip(
-                            user_params.dest_rect,
-                            D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+    // traverse from top to bottom
+    for(auto it = layers.rbegin(); it != layers.rend(); it++)
+    {
+        // the skipped layers don't occlude the layers below them
+        if(!this->is_drawable(*it))
+        {
+            static metric& skipped_textures =
+                metrics::get_counter("videomixer_cpu_skipped_textures");
+            skipped_textures.add();
+            continue;
+        }
 
-                        frame->ctx->SetTransform(world);
-                    }
+        const stream_videomixer_controller::params_t& params = it->frame->params;
+        const stream_videomixer_controller::params_t& user_params = *it->user_params;
 
-                    frame->ctx->FillRectangle(params.source_rect, frame->bitmap_brush);
+        const D2D1_RECT_F clip_bounds = transform_rect(user_params.dest_rect, user_params.dest_m);
+        const D2D1_RECT_F bounds = intersect(
+            transform_rect(params.source_rect, it->world), clip_bounds);
 
-                    if(!user_params.axis_aligned_clip)
-                        frame->ctx->PopLayer();
-                    else
-                        frame->ctx->PopAxisAlignedClip();
-                }
-            }
+        // the bounds are expanded and the covered rect is shrunk to whole pixels,
+        // because the edges are antialiased
+        const D2D1_RECT_F outer_bounds = D2D1::RectF(std::floor(bounds.left),
+            std::floor(bounds.top), std::ceil(bounds.right), std::ceil(bounds.bottom));
+        const bool occluded = std::any_of(covered_rects.begin(), covered_rects.end(),
+            [&](const D2D1_RECT_F& rect)
+            {
+                return rect.left <= outer_bounds.left && rect.top <= outer_bounds.top &&
+                    rect.right >= outer_bounds.right && rect.bottom >= outer_bounds.bottom;
+            });
+        const bool empty = (bounds.left >= bounds.right || bounds.top >= bounds.bottom);
+
+        if(occluded || empty)
+            continue;
+
+        visible_layers.push_back(*it);
+
+        if(it->frame->opaque && is_rect_preserving(it->world) &&
+            (user_params.axis_aligned_clip || is_rect_preserving(user_params.dest_m)))
+        {
+            covered_rects.push_back(D2D1::RectF(std::ceil(bounds.left), std::ceil(bounds.top),
+                std::floor(bounds.right), std::floor(bounds.bottom)));
         }
     }
 
-    // call end draw for every frame
+    std::reverse(visible_layers.begin(), visible_layers.end());
+}
+
+media_buffer_texture_t stream_videomixer::find_composed_frame(
+    const std::vector<layer_t>& layers)
+{
+    scoped_lock lock(this->composed_frame_mutex);
+
+    if(!this->composed_frame.output || this->composed_frame.inputs.size() != layers.size())
+        return NULL;
+
+    for(size_t i = 0; i < layers.size(); i++)
+    {
+        const composed_input_t& input = this->composed_frame.inputs[i];
+        if(input.buffer != layers[i].frame->buffer ||
+            !equal_params(input.params, layers[i].frame->params) ||
+            !equal_params(input.user_params, *layers[i].user_params))
+            return NULL;
+    }
+
+    return this->composed_frame.output;
+}
+
+void stream_videomixer::store_composed_frame(const std::vector<layer_t>& layers,
+    const media_buffer_texture_t& output)
+{
+    scoped_lock lock(this->composed_frame_mutex);
+
+    // the input buffers are referenced so that they won't be recycled by the pool
+    // while they are compared against
+    this->composed_frame.inputs.clear();
+    for(const auto& layer : layers)
+    {
+        composed_input_t input;
+        input.buffer = layer.frame->buffer;
+        input.params = layer.frame->params;
+        input.user_params = *layer.user_params;
+        this->composed_frame.inputs.push_back(std::move(input));
+    }
+    this->composed_frame.output = output;
+}
+
+HRESULT stream_videomixer::compose_d2d(const std::vector<layer_t>& layers,
+    media_buffer_texture_t& output)
+{
+    HRESULT hr = S_OK;
+    device_context_resources_t frame = this->acquire_buffer();
+
+    frame->ctx->BeginDraw();
+    frame->ctx->SetTarget(frame->bitmap);
+    frame->ctx->Clear(D2D1::ColorF(D2D1::ColorF::Black));
+
+    for(const auto& item : layers)
+    {
+        CComPtr<ID3D11Texture2D> texture = item.frame->buffer->texture;
+        const auto& params = item.frame->params;
+        const auto& user_params = *item.user_params;
+
+        // TODO: cache geometry
+
+        using namespace D2D1;
+        CComPtr<ID2D1Bitmap1> bitmap;
+        CComPtr<IDXGISurface> surface;
+        const Matrix3x2F& world = item.world;
+        Matrix3x2F brush;
+
+        brush = params.source_m;
+
+        CHECK_HR(hr = texture->QueryInterface(&surface));
+        CHECK_HR(hr = frame->ctx->CreateBitmapFromDxgiSurface(
+            surface,
+            BitmapProperties1(
+                D2D1_BITMAP_OPTIONS_NONE,
+                PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
+            &bitmap));
+
+        frame->bitmap_brush->SetBitmap(bitmap);
+        /*frame->bitmap_brush->SetInterpolationMode1(D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC);*/
+        frame->bitmap_brush->SetTransform(brush);
+
+        if(!user_params.axis_aligned_clip)
+        {
+            CComPtr<ID2D1RectangleGeometry> geometry;
+            D2D1_LAYER_PARAMETERS1 layer_params;
+            Matrix3x2F world_inverted, layer;
+
+            world_inverted = world;
+            world_inverted.Invert();
+            layer = user_params.dest_m * world_inverted;
+
+            CHECK_HR(hr = this->transform->d2d1factory->CreateRectangleGeometry(
+                user_params.dest_rect, &geometry));
+            layer_params = LayerParameters1(
+                InfiniteRect(), geometry, D2D1_ANTIALIAS_MODE_PER_PRIMITIVE, layer);
+
+            frame->ctx->SetTransform(world);
+            frame->ctx->PushLayer(layer_params, NULL);
+        }
+        else
+        {
+            frame->ctx->SetTransform(user_params.dest_m);
+            // the world transform is applied to the axis aligned clip when push is called
+            frame->ctx->PushAxisAlignedClip(
+                user_params.dest_rect,
+                D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+
+            frame->ctx->SetTransform(world);
+        }
+
+        frame->ctx->FillRectangle(params.source_rect, frame->bitmap_brush);
+
+        if(!user_params.axis_aligned_clip)
+            frame->ctx->PopLayer();
+        else
+            frame->ctx->PopAxisAlignedClip();
+    }
+
+done:
+    // end draw must be called even if drawing failed
+    const HRESULT end_draw_hr = frame->ctx->EndDraw();
+    if(SUCCEEDED(hr))
+        hr = end_draw_hr;
+
+    if(SUCCEEDED(hr))
+        output = frame;
+
+    return hr;
+}
+
+void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
+    frame_unit first, frame_unit end)
+{
+    // packets.container might be empty
+
+    assert_(!out_arg);
+
+    // arg in packets can be null when frame_count == 0 or
+    // if a source passed null args on a drain point;
+    // the whole leftover buffer is merged to packets
+
+    HRESULT hr = S_OK;
+    const frame_unit frame_count = end - first;
+    assert_(frame_count > 0);
+
+    // TODO: use z order instead of stream_index so that the user input can be instant
+    // sort the packets list for correct z order
+    std::sort(packets.container.begin(), packets.container.end(),
+        [](const packet_t& a, const packet_t& b)
+        {
+            // user_params.z_order;
+            // control_pipeline stores all stream controllers and control_scene
+            // uses those to update z order
+
+            // TODO: stream controller should be reinitialized on activate
+            // (the params should be copied over)
+
+            // set streams with invalid user params behind everything else
+            return (a.stream_index < b.stream_index);
+        });
+
+    media_sample_video_frames::samples_t frames;
     for(frame_unit i = 0; i < frame_count; i++)
+        frames.push_back(media_sample_video_frame(first + i));
+
+    // TODO: audio mixer should allocate a buffer of end-first,
+    // but after mixing it creates a buffer wrapper with min pos and max end of mixed samples;
+    // this will make the audio mixing process equivalent to video mixing;
+    // (this assumes that gaps won't occur between samples, which isn't true)
+    // if it turns out that mp4 container doesn't support aac with gaps,
+    // the media buffer wrapper ends can be extended to first and end;
+    // the audio sources should be modified like in video sources to provide silent
+    // buffers that cover gaps
+
+    // TODO: the end of samples in case if the sample is empty should be properly defined
+
+    media_sample_video_frames_t sample;
+    frame_layers_t layers;
+    std::vector<layer_t> visible_layers;
+    // the frames are independent, so that the cpu compositor composes them concurrently
+    // after all frames have been collected
+    std::vector<cpu_frame_t> cpu_frames;
+    readback_frames_t readback_frames;
+    // the last composed frame of this take
+    const std::vector<layer_t>* composed_layers = NULL;
+    media_buffer_texture_t composed_output;
+    // indicates whether the out arg will have any encodeable frames
+    bool has_frames;
+
+    this->collect_layers(packets, first, end, layers, has_frames);
+
+    // draw
+    for(size_t i = 0; i < layers.size(); i++)
     {
-        device_context_resources_t frame =
-            std::static_pointer_cast<transform_videomixer::device_context_resources>(
-                frames[i].buffer);
-        if(frame)
-            frame->ctx->EndDraw();
+        if(!layers[i])
+            continue;
+
+        // the previous output is reused if the inputs haven't changed
+        media_buffer_texture_t output = this->find_composed_frame(*layers[i]);
+        if(!output && composed_layers && equal_layers(*composed_layers, *layers[i]))
+            output = composed_output;
+        if(output)
+        {
+            this->transform->statistics.frames_reused++;
+            frames[i].buffer = output;
+            frames[i].unchanged = true;
+            continue;
+        }
+
+        this->cull_layers(*layers[i], visible_layers);
+        this->transform->statistics.frames_composed++;
+        this->transform->statistics.layers_drawn += visible_layers.size();
+        this->transform->statistics.layers_culled += layers[i]->size() - visible_layers.size();
+
+        if(this->transform->compositor)
+            output = this->add_cpu_frame(visible_layers, cpu_frames, readback_frames);
+        else
+            CHECK_HR(hr = this->compose_d2d(visible_layers, output));
+
+        composed_layers = &*layers[i];
+        composed_output = output;
+        frames[i].buffer = output;
     }
 
+    if(!cpu_frames.empty())
+        this->compose_cpu(cpu_frames);
+    // the output is stored only after it has been composed, because
+    // the mixing of other requests might reuse it
+    if(composed_layers)
+        this->store_composed_frame(*composed_layers, composed_output);
+
     {
         transform_videomixer::buffer_pool_video_frames_t::scoped_lock lock(
             this->transform->buffer_pool_video_frames->mutex);
@@ -458,6 +733,172 @@ done:
     }
 }
 
+bool stream_videomixer::is_drawable(const layer_t& item) const
+{
+    // the d2d path draws all frames
+    if(!this->transform->compositor)
+        return true;
+
+    const media_buffer_texture* buffer = item.frame->buffer.get();
+    const media_buffer_memory_texture* memory_buffer =
+        dynamic_cast<const media_buffer_memory_texture*>(buffer);
+    if(memory_buffer)
+        return !!memory_buffer->texture_buffer;
+
+    // the frames of the capture sources reside in gpu memory and are read back;
+    // the cpu compositor reads bgra pixels
+    if(!buffer->texture || !this->transform->d3d11dev)
+        return false;
+    D3D11_TEXTURE2D_DESC desc;
+    buffer->texture->GetDesc(&desc);
+    return (desc.Format == DXGI_FORMAT_B8G8R8A8_UNORM);
+}
+
+void stream_videomixer::make_layer(const layer_t& item, cpu_compositor::layer_t& layer,
+    readback_frames_t& readback_frames)
+{
+    auto convert_matrix = [](const D2D1::Matrix3x2F& m) -> cpu_compositor::matrix_t
+    {
+        return {m._11, m._12, m._21, m._22, m._31, m._32};
+    };
+    auto convert_rect = [](const D2D1_RECT_F& r) -> cpu_compositor::rect_t
+    {
+        return {r.left, r.top, r.right, r.bottom};
+    };
+
+    const auto& params = item.frame->params;
+    const auto& user_params = *item.user_params;
+    const media_buffer_memory_texture* buffer =
+        dynamic_cast<const media_buffer_memory_texture*>(item.frame->buffer.get());
+    // the culled layers are drawable
+    if(!buffer)
+        buffer = this->read_back(*item.frame->buffer, readback_frames).get();
+    assert_(buffer->texture_buffer);
+
+    layer.data = buffer->texture_buffer.get();
+    layer.width = (int)buffer->width;
+    layer.height = (int)buffer->height;
+    layer.pitch = (int)buffer->pitch;
+    layer.fill_rect = convert_rect(params.source_rect);
+    layer.world = convert_matrix(item.world);
+    layer.brush = convert_matrix(params.source_m);
+    // the d2d path transforms the clip geometry by the user dest matrix
+    layer.clip_rect = convert_rect(user_params.dest_rect);
+    layer.clip_m = convert_matrix(user_params.dest_m);
+    layer.axis_aligned_clip = user_params.axis_aligned_clip;
+}
+
+media_buffer_memory_texture_t stream_videomixer::read_back(
+    const media_buffer_texture& buffer, readback_frames_t& readback_frames)
+{
+    static metric& readback_bytes = metrics::get_counter("videomixer_cpu_readback_bytes");
+
+    // the input frames are usually repeated between the output frames of a take
+    for(const auto& item : readback_frames)
+        if(item.first == &buffer)
+            return item.second;
+
+    HRESULT hr = S_OK;
+    D3D11_TEXTURE2D_DESC desc;
+    D3D11_MAPPED_SUBRESOURCE sub_rsrc;
+    media_buffer_memory_texture_t memory_buffer;
+
+    buffer.texture->GetDesc(&desc);
+    memory_buffer = this->acquire_memory_buffer(desc.Width, desc.Height);
+
+    {
+        std::lock_guard<context_mutex_t::element_type> lock(*this->transform->context_mutex);
+        ID3D11DeviceContext* devctx = this->transform->d3d11devctx;
+        CComPtr<ID3D11Texture2D>& readback_texture = this->transform->readback_texture;
+
+        // the staging texture is recreated if the input frame size changes
+        if(readback_texture)
+        {
+            D3D11_TEXTURE2D_DESC readback_desc;
+            readback_texture->GetDesc(&readback_desc);
+            if(readback_desc.Width != desc.Width || readback_desc.Height != desc.Height ||
+                readback_desc.MipLevels != desc.MipLevels ||
+                readback_desc.ArraySize != desc.ArraySize)
+                readback_texture = NULL;
+        }
+        if(!readback_texture)
+        {
+            D3D11_TEXTURE2D_DESC readback_desc = desc;
+            readback_desc.Usage = D3D11_USAGE_STAGING;
+            readback_desc.BindFlags = 0;
+            readback_desc.MiscFlags = 0;
+            readback_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            CHECK_HR(hr = this->transform->d3d11dev->CreateTexture2D(
+                &readback_desc, NULL, &readback_texture));
+        }
+
+        // the copy is waited for, because the frame is composed in this take
+        devctx->CopyResource(readback_texture, buffer.texture);
+        CHECK_HR(hr = devctx->Map(readback_texture, 0, D3D11_MAP_READ, 0, &sub_rsrc));
+
+        const size_t row_size = (size_t)desc.Width * 4;
+        const BYTE* src = (const BYTE*)sub_rsrc.pData;
+        BYTE* dst = memory_buffer->texture_buffer.get();
+        for(UINT y = 0; y < desc.Height; y++)
+        {
+            memcpy(dst, src, row_size);
+            src += sub_rsrc.RowPitch;
+            dst += memory_buffer->pitch;
+        }
+
+        devctx->Unmap(readback_texture, 0);
+        readback_bytes.add((int64_t)(row_size * desc.Height));
+    }
+
+    readback_frames.emplace_back(&buffer, memory_buffer);
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return memory_buffer;
+}
+
+media_buffer_memory_texture_t stream_videomixer::add_cpu_frame(
+    const std::vector<layer_t>& layers, std::vector<cpu_frame_t>& cpu_frames,
+    readback_frames_t& readback_frames)
+{
+    cpu_frame_t frame;
+    frame.layers.resize(layers.size());
+    for(size_t i = 0; i < layers.size(); i++)
+        this->make_layer(layers[i], frame.layers[i], readback_frames);
+    frame.canvas = this->acquire_memory_buffer(
+        this->transform->canvas_width, this->transform->canvas_height);
+
+    cpu_frames.push_back(std::move(frame));
+    return cpu_frames.back().canvas;
+}
+
+void stream_videomixer::compose_cpu(std::vector<cpu_frame_t>& cpu_frames)
+{
+    std::vector<cpu_compositor::frame_t> frames(cpu_frames.size());
+    for(size_t i = 0; i < cpu_frames.size(); i++)
+    {
+        const media_buffer_memory_texture_t& canvas = cpu_frames[i].canvas;
+        frames[i].canvas = {canvas->texture_buffer.get(),
+            (int)canvas->width, (int)canvas->height, (int)canvas->pitch};
+        frames[i].layers = cpu_frames[i].layers.data();
+        frames[i].layer_count = cpu_frames[i].layers.size();
+    }
+
+    this->transform->compositor->compose(frames.data(), frames.size());
+
+    // the batch size shows whether the takes of the cpu path actually span multiple frames
+    static metric& composed_frames = metrics::get_counter("videomixer_cpu_composed_frames");
+    static metric& takes = metrics::get_counter("videomixer_cpu_takes");
+    static metric& batch_frames = metrics::get_gauge("videomixer_cpu_batch_frames");
+    composed_frames.add((int64_t)frames.size());
+    takes.add();
+    batch_frames.set((int64_t)frames.size());
+    this->transform->statistics.cpu_frames_composed += frames.size();
+    this->transform->statistics.cpu_takes++;
+}
+
 
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -2,6 +2,7 @@
 
 #include "transform_mixer.h"
 #include "control_class.h"
+#include "cpu_compositor.h"
 #include <d3d11.h>
 #include <d2d1_1.h>
 #include <dxgi1_2.h>
@@ -9,6 +10,8 @@
 #include <memory>
 #include <mutex>
 #include <vector>
+#include <atomic>
+#include <optional>
 
 #pragma comment(lib, "D2d1.lib")
 #pragma comment(lib, "Dxgi.lib")
@@ -45,6 +48,11 @@ class media_sample_video_mixer_frame : public media_sample_video_frame
 public:
     // params are considered valid only if the buffer is not silent
     stream_videomixer_controller::params_t params;
+    // the buffer fully covers the source rect with opaque pixels;
+    // opaque frames are used for occluding the layers below them
+    bool opaque;
+
+    media_sample_video_mixer_frame() : opaque(false) {}
 };
 
 typedef media_sample_video_frames_template<media_sample_video_mixer_frame>
@@ -82,6 +90,17 @@ public:
     typedef buffer_pool<media_sample_video_frames_pooled> buffer_pool_video_frames_t;
     typedef buffer_pool<media_sample_video_mixer_frames_pooled> buffer_pool_video_mixer_frames_t;
     typedef buffer_pool<device_context_resources_pooled> buffer_pool;
+    typedef buffer_pool<media_buffer_memory_texture_pooled> buffer_pool_memory_texture_t;
+
+    // counters for the draws skipped by occlusion culling and by reusing
+    // the previous output
+    struct statistics_t
+    {
+        std::atomic<uint64_t> frames_composed{0}, frames_reused{0};
+        std::atomic<uint64_t> layers_drawn{0}, layers_culled{0};
+        // frames composed by the cpu compositor and the takes they were batched in
+        std::atomic<uint64_t> cpu_frames_composed{0}, cpu_takes{0};
+    };
 private:
     control_class_t ctrl_pipeline;
     context_mutex_t context_mutex;
@@ -96,6 +115,15 @@ private:
     CComPtr<ID3D11DeviceContext> d3d11devctx;
     CComPtr<ID2D1Device> d2d1dev;
 
+    // cpu compositor is used instead of d2d if the mixer is initialized without a device
+    std::shared_ptr<cpu_compositor> compositor;
+    std::shared_ptr<buffer_pool_memory_texture_t> memory_texture_pool;
+    // the staging texture that the gpu frames are read back through for the cpu compositor;
+    // guarded by the context mutex
+    CComPtr<ID3D11Texture2D> readback_texture;
+
+    statistics_t statistics;
+
     stream_mixer_t create_derived_stream() override;
 public:
     transform_videomixer(const media_session_t& session, context_mutex_t context_mutex);
@@ -103,6 +131,7 @@ public:
 
     void get_canvas_size(UINT32& width, UINT32& height) const
     { width = this->canvas_width; height = this->canvas_height; }
+    const statistics_t& get_statistics() const { return this->statistics; }
 
     void initialize(
         const control_class_t&,
@@ -111,6 +140,16 @@ public:
         const CComPtr<ID2D1Device>&,
         const CComPtr<ID3D11Device>&,
         const CComPtr<ID3D11DeviceContext>&);
+    // initializes the mixer to use the cpu compositor;
+    // the output frames are memory textures; the input frames in gpu memory are read back
+    // with the device, and they are skipped if the device is null;
+    // thread count of 0 uses the hardware concurrency
+    void initialize(
+        const control_class_t&,
+        UINT32 canvas_width, UINT32 canvas_height,
+        const CComPtr<ID3D11Device>&,
+        const CComPtr<ID3D11DeviceContext>&,
+        unsigned int compositor_thread_count = 0);
 };
 
 typedef std::shared_ptr<transform_videomixer> transform_videomixer_t;
@@ -119,11 +158,83 @@ class stream_videomixer final : public stream_videomixer_base
 {
 private:
     typedef transform_videomixer::device_context_resources_t device_context_resources_t;
+
+    // drawable input frame of an output frame
+    struct layer_t
+    {
+        // the buffer of the frame is not null
+        const media_sample_video_mixer_frame* frame;
+        const stream_videomixer_controller::params_t* user_params;
+        D2D1::Matrix3x2F world;
+    };
+    // layers of each output frame in z order; frames that aren't drawn are empty
+    typedef std::vector<std::optional<std::vector<layer_t>>> frame_layers_t;
+
+    struct composed_input_t
+    {
+        media_buffer_texture_t buffer;
+        stream_videomixer_controller::params_t params, user_params;
+    };
+    struct composed_frame_t
+    {
+        std::vector<composed_input_t> inputs;
+        media_buffer_texture_t output;
+    };
+    // frame that is composed by the cpu compositor after the layers of all frames
+    // have been collected
+    struct cpu_frame_t
+    {
+        media_buffer_memory_texture_t canvas;
+        std::vector<cpu_compositor::layer_t> layers;
+    };
+
+    // the gpu input frames of a take that have been read back to system memory;
+    // the output frames of a take share the read back frames
+    typedef std::vector<std::pair<const media_buffer_texture*, media_buffer_memory_texture_t>>
+        readback_frames_t;
+
+    // the maximum amount of frames the cpu compositor path composes in a single take
+    static constexpr size_t maximum_cpu_frame_count = 4;
+
     transform_videomixer_t transform;
 
+    std::mutex composed_frame_mutex;
+    // the last composed frame and its inputs
+    composed_frame_t composed_frame;
+
     void initialize_texture(const media_buffer_texture_t&);
     void initialize_resources(const device_context_resources_t& resources);
     device_context_resources_t acquire_buffer();
+    media_buffer_memory_texture_t acquire_memory_buffer(UINT32 width, UINT32 height);
+
+    // computes the transform from the frame's local space to the canvas
+    static D2D1::Matrix3x2F compute_world(
+        const stream_videomixer_controller::params_t& params,
+        const stream_videomixer_controller::params_t& user_params);
+    static bool equal_params(const stream_videomixer_controller::params_t&,
+        const stream_videomixer_controller::params_t&);
+    static bool equal_layers(const std::vector<layer_t>&, const std::vector<layer_t>&);
+    // the input frames that the cpu compositor can't read are skipped
+    bool is_drawable(const layer_t&) const;
+    void make_layer(const layer_t&, cpu_compositor::layer_t&, readback_frames_t&);
+    // copies the texture of a gpu frame to system memory
+    media_buffer_memory_texture_t read_back(const media_buffer_texture&, readback_frames_t&);
+
+    void collect_layers(args_t&, frame_unit first, frame_unit end,
+        frame_layers_t&, bool& has_frames) const;
+    // removes the layers that aren't drawn and the layers that are fully occluded by
+    // the opaque layers above them
+    void cull_layers(const std::vector<layer_t>&, std::vector<layer_t>& visible_layers) const;
+    // returns the previous output if the layers match the previously composed layers
+    media_buffer_texture_t find_composed_frame(const std::vector<layer_t>&);
+    void store_composed_frame(const std::vector<layer_t>&, const media_buffer_texture_t&);
+
+    HRESULT compose_d2d(const std::vector<layer_t>&, media_buffer_texture_t& output);
+    // acquires the canvas of a frame that is composed later by compose_cpu
+    media_buffer_memory_texture_t add_cpu_frame(const std::vector<layer_t>&,
+        std::vector<cpu_frame_t>&, readback_frames_t&);
+    // composes the frames of a request concurrently
+    void compose_cpu(std::vector<cpu_frame_t>&);
 
     bool move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t& reference,
         frame_unit end, bool discarded) override;
@@ -1,4 +1,6 @@
 #include "video_source_helper.h"
+#include "logger.h"
+#include "metrics.h"
 #include <iostream>
 
 #define FRAME_COUNT_PER_60_FPS 10
@@ -6,7 +8,8 @@
 
 video_source_helper::video_source_helper() :
     initialized(false),
-    buffer_pool_video_frames(new buffer_pool_video_frames_t),
+    buffer_pool_video_frames(new buffer_pool_video_frames_t(
+        "video_source_helper::buffer_pool_video_frames")),
     fully_initialized(false),
     maximum_frame_count(FRAME_COUNT_PER_60_FPS)
 {
@@ -14,6 +17,8 @@ video_source_helper::video_source_helper() :
 
 video_source_helper::~video_source_helper()
 {
+    metrics::get_gauge("video_source_buffered_frames").add(-(int64_t)this->captured_frames.size());
+
     buffer_pool_video_frames_t::scoped_lock lock(this->buffer_pool_video_frames->mutex);
     this->buffer_pool_video_frames->dispose();
 }
@@ -32,6 +37,8 @@ void video_source_helper::add_padding_frames(
         duplicate_frame.dur = skipped_frames_dur;
         duplicate_frame.buffer = last_frame.buffer;
         duplicate_frame.params = last_frame.params;
+        duplicate_frame.opaque = last_frame.opaque;
+        duplicate_frame.unchanged = true;
 
         sample->add_consecutive_frames(duplicate_frame);
     }
@@ -82,13 +89,20 @@ void video_source_helper::add_new_sample(const media_sample_video_mixer_frame& n
 
     this->fully_initialized = true;
 
+    // the gauge is the sum of the buffered frames of all video sources
+    static metric& buffered_frames = metrics::get_gauge("video_source_buffered_frames");
+    static metric& frames_dropped = metrics::get_counter("video_source_frames_dropped");
+
     if(this->captured_frames.size() == maximum_frame_count)
     {
-        std::cout << "captured frame dropped" << std::endl;
+        LOG_WARNING("captured frame dropped");
+        frames_dropped.add();
+        buffered_frames.add(-1);
         this->captured_frames.pop();
     }
 
     this->captured_frames.push(new_sample);
+    buffered_frames.add(1);
 }
 
 media_sample_video_mixer_frames_t video_source_helper::make_sample(frame_unit frame_end)
@@ -106,6 +120,7 @@ media_sample_video_mixer_frames_t video_source_helper::make_sample(frame_unit fr
     sample->initialize();
 
     // add captured frames to the collection and insert padding frames
+    static metric& buffered_frames = metrics::get_gauge("video_source_buffered_frames");
     while(!this->captured_frames.empty())
     {
         if(this->captured_frames.front().pos < frame_end)
@@ -116,6 +131,7 @@ media_sample_video_mixer_frames_t video_source_helper::make_sample(frame_unit fr
 
             this->last_served_frame = this->captured_frames.front();
             this->captured_frames.pop();
+            buffered_frames.add(-1);
         }
         else
         {
@@ -137,10 +153,16 @@ media_sample_video_mixer_frames_t video_source_helper::make_sample(frame_unit fr
     assert_(sample->get_end() == frame_end);
     this->last_served_frame.pos = frame_end - 1;
     this->last_served_frame.dur = 1;
+    // the last served frame is only served again as a repeated frame
+    this->last_served_frame.unchanged = true;
 
     // keep the frames buffer within the limits
     if(sample->move_frames_to(NULL, sample->get_end() - maximum_buffer_size))
-        std::cout << "frame limit reached; frames skipped" << std::endl;
+    {
+        static metric& frames_skipped = metrics::get_counter("video_source_frames_skipped");
+        frames_skipped.add();
+        LOG_WARNING("frame limit reached; frames skipped");
+    }
 
     assert_(sample->is_valid());
     return sample;
@@ -0,0 +1,88 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+#undef min
+#undef max
+
+worker_pool::worker_pool(unsigned int thread_count) :
+    job(nullptr),
+    part_count(0), next_part(0), parts_done(0),
+    stopped(false)
+{
+    if(thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // the thread calling run participates in the work
+    for(unsigned int i = 1; i < thread_count; i++)
+        this->workers.emplace_back(&worker_pool::worker_proc, this);
+}
+
+worker_pool::~worker_pool()
+{
+    {
+        scoped_lock lock(this->mutex);
+        this->stopped = true;
+    }
+    this->work_cv.notify_all();
+
+    for(auto&& worker : this->workers)
+        worker.join();
+}
+
+void worker_pool::worker_proc()
+{
+    scoped_lock lock(this->mutex);
+    for(;;)
+    {
+        this->work_cv.wait(lock, [this]()
+            {
+                return this->stopped || (this->job && this->next_part < this->part_count);
+            });
+        if(this->stopped)
+            return;
+
+        this->serve_part(lock);
+    }
+}
+
+bool worker_pool::serve_part(scoped_lock& lock)
+{
+    if(!this->job || this->next_part >= this->part_count)
+        return false;
+
+    const job_t& job = *this->job;
+    const int part = this->next_part++;
+
+    lock.unlock();
+    job(part);
+    lock.lock();
+
+    if(++this->parts_done == this->part_count)
+        this->done_cv.notify_all();
+
+    return true;
+}
+
+void worker_pool::run(int part_count, const job_t& job)
+{
+    if(this->workers.empty() || part_count <= 1)
+    {
+        for(int i = 0; i < part_count; i++)
+            job(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(this->run_mutex);
+
+    scoped_lock lock(this->mutex);
+    this->job = &job;
+    this->part_count = part_count;
+    this->next_part = 0;
+    this->parts_done = 0;
+    this->work_cv.notify_all();
+
+    while(this->serve_part(lock));
+    this->done_cv.wait(lock, [this]() { return this->parts_done == this->part_count; });
+
+    this->job = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// fork join pool for splitting a cpu bound operation into parts;
+// the parts are indexed from 0 to part_count - 1
+
+class worker_pool final
+{
+public:
+    typedef std::unique_lock<std::mutex> scoped_lock;
+    typedef std::function<void(int /*part*/)> job_t;
+private:
+    std::vector<std::thread> workers;
+    std::mutex run_mutex, mutex;
+    std::condition_variable work_cv, done_cv;
+    const job_t* job;
+    int part_count, next_part, parts_done;
+    bool stopped;
+
+    void worker_proc();
+    bool serve_part(scoped_lock&);
+public:
+    // thread count of 0 uses the hardware concurrency;
+    // thread count of 1 runs the jobs in the calling thread only
+    explicit worker_pool(unsigned int thread_count = 0);
+    ~worker_pool();
+
+    unsigned int get_thread_count() const { return (unsigned int)this->workers.size() + 1; }
+
+    // runs the job for each part and returns when all parts have been processed;
+    // the calling thread participates in the work;
+    // only one run is active at a time
+    void run(int part_count, const job_t&);
+};
\ No newline at end of file